@@ -0,0 +1,244 @@
+/**
+ * @file include/kobuki_driver/async_callback.hpp
+ *
+ * @brief Runs a callback on a worker pool instead of the driver's thread.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_ASYNC_CALLBACK_HPP_
+#define KOBUKI_ASYNC_CALLBACK_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <mutex>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include "callback_registry.hpp"
+#include "callback_worker_pool.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Enums
+*****************************************************************************/
+
+/**
+ * @brief What an AsyncCallback keeps while its callback is busy.
+ */
+enum AsyncPolicy {
+  LatestOnly = 0, /**< @brief Only the newest value, each one replacing the last (overflows() counts the replaced ones). **/
+  Fifo            /**< @brief Every value in order, up to the capacity; values arriving when full are dropped and counted. **/
+};
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief A callback connected to a CallbackRegistry but run on a CallbackWorkerPool.
+ *
+ * The driver's thread only copies the arguments into this subscriber's own
+ * bounded queue and, if the queue was empty, wakes a worker; the callback
+ * runs later on the pool. A slow consumer (a logger, a planner) then holds
+ * up neither the driver nor the other subscribers: its queue just fills and
+ * the policy decides what is kept.
+ *
+ * Callbacks of one AsyncCallback run one at a time and in order, those of
+ * different ones run in parallel as far as the pool's threads allow.
+ *
+ * The queue is allocated up front, so posting does not allocate unless
+ * copying an argument does.
+ *
+ * The callback may disconnect() its own AsyncCallback, e.g. to stop after a
+ * particular value; it must not connect() it again or destroy it, which
+ * would pull the queue and the callback out from under the running call.
+ *
+ * @code
+ * kobuki::AsyncCallback<const kobuki::BumperEvent&> bumper(kobuki.callbackPool(), kobuki::Fifo, 8);
+ * bumper.connect(kobuki.eventCallbacks().bumper, &Logger::bumper, logger);
+ * kobuki::AsyncCallback<> stream(kobuki.callbackPool(), kobuki::LatestOnly);
+ * stream.connect(kobuki.callbacks().stream_data, &Planner::update, planner);
+ * @endcode
+ */
+template <typename... Args>
+class AsyncCallback : private CallbackWorkerPool::Job {
+public:
+  /**
+   * @param pool : runs the callback, must outlive the connection.
+   * @param policy : what to keep while the callback is busy.
+   * @param capacity : values kept with Fifo (LatestOnly keeps one).
+   */
+  AsyncCallback(CallbackWorkerPool &pool, const AsyncPolicy &policy = LatestOnly, const unsigned int &capacity = 16) :
+    pool(pool),
+    policy(policy),
+    queue((policy == LatestOnly || capacity == 0) ? 1 : capacity),
+    first(0),
+    count(0),
+    overflow_count(0),
+    accepting(false),
+    detached(false),
+    registry(NULL),
+    handle(0)
+  {}
+
+  ~AsyncCallback() { disconnect(); }
+
+  /**
+   * @brief Connect a function to the registry, returns false if the pool has no threads.
+   */
+  bool connect(CallbackRegistry<Args...> &registry, void (*function)(Args...)) {
+    if ( !prepare() ) { return false; }
+    subscriber.connect(function);
+    attach(registry);
+    return true;
+  }
+
+  /**
+   * @brief Connect a member function to the registry, returns false if the pool has no threads.
+   */
+  template <typename C>
+  bool connect(CallbackRegistry<Args...> &registry, void (C::*method)(Args...), C &object) {
+    if ( !prepare() ) { return false; }
+    subscriber.connect(method, object);
+    attach(registry);
+    return true;
+  }
+
+  /**
+   * @brief Disconnect, dropping what is queued and waiting for a running callback to finish.
+   *
+   * Called from the callback itself, it does not wait; the callback is
+   * released once it returns.
+   */
+  void disconnect() {
+    bool from_callback = pool.isRunningJob(*this);
+    CallbackRegistry<Args...> *connected;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      connected = registry;
+      registry = NULL;
+    }
+    if ( connected != NULL ) {
+      connected->disconnect(handle); // no more posts after this
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      accepting = false;
+      count = 0;
+      detached = from_callback;
+    }
+    pool.cancel(*this); // returns at once from the callback
+    if ( !from_callback ) {
+      subscriber.clear(); // from the callback this would wait for its own emit, run() does it instead
+    }
+  }
+
+  bool isConnected() const { std::lock_guard<std::mutex> lock(mutex); return registry != NULL; }
+
+  unsigned long overflows() const { std::lock_guard<std::mutex> lock(mutex); return overflow_count; } /**< @brief Values dropped (Fifo) or replaced (LatestOnly) before the callback got them. **/
+  unsigned int pending() const { std::lock_guard<std::mutex> lock(mutex); return count; } /**< @brief Values waiting for the callback. **/
+
+private:
+  AsyncCallback(const AsyncCallback&); // non-copyable
+  AsyncCallback& operator=(const AsyncCallback&);
+
+  typedef std::tuple<typename std::decay<Args>::type...> Payload;
+
+  template <unsigned int... I> struct Indices {};
+  template <unsigned int N, unsigned int... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+  template <unsigned int... I> struct MakeIndices<0, I...> { typedef Indices<I...> Type; };
+
+  bool prepare() {
+    disconnect();
+    if ( pool.threads() == 0 ) { return false; }
+    std::lock_guard<std::mutex> lock(mutex);
+    first = 0;
+    count = 0;
+    overflow_count = 0;
+    accepting = true;
+    detached = false;
+    return true;
+  }
+
+  void attach(CallbackRegistry<Args...> &registry) {
+    typename CallbackRegistry<Args...>::Handle connection = registry.connect(&AsyncCallback::post, *this);
+    std::lock_guard<std::mutex> lock(mutex);
+    this->registry = &registry;
+    handle = connection;
+  }
+
+  /*
+   * Called by the driver's thread, through the registry.
+   */
+  void post(Args... args) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if ( !accepting ) { return; }
+    if ( count == queue.size() ) {
+      ++overflow_count;
+      if ( policy == LatestOnly ) {
+        queue[(first + count - 1) % queue.size()] = std::forward_as_tuple(args...);
+      }
+      return;
+    }
+    queue[(first + count) % queue.size()] = std::forward_as_tuple(args...);
+    if ( count++ == 0 ) {
+      pool.schedule(*this); // under the lock, so disconnect() cannot slip in between
+    }
+  }
+
+  /*
+   * Called on the pool, works through the queue.
+   */
+  void run() {
+    while ( true ) {
+      bool detach;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        detach = detached;
+        detached = false;
+        if ( !detach ) {
+          if ( count == 0 ) { return; }
+          std::swap(delivering, queue[first]); // no copy, and the slot keeps the old buffers for reuse
+          first = (first + 1) % queue.size();
+          --count;
+        }
+      }
+      if ( detach ) {
+        subscriber.clear(); // the callback disconnected itself and has now returned
+        return;
+      }
+      deliver(typename MakeIndices<sizeof...(Args)>::Type());
+    }
+  }
+
+  template <unsigned int... I>
+  void deliver(Indices<I...>) { subscriber.emit(std::get<I>(delivering)...); }
+
+  CallbackWorkerPool &pool;
+  const AsyncPolicy policy;
+  mutable std::mutex mutex; // guards the queue, the counters and the connection
+  std::vector<Payload> queue; // ring of count values from first
+  unsigned int first, count;
+  unsigned long overflow_count;
+  bool accepting;
+  bool detached; // disconnected from within the callback, run() releases it
+  Payload delivering; // pool side only, one run at a time
+  CallbackRegistry<Args...> subscriber; // holds the user's callback
+  CallbackRegistry<Args...> *registry;
+  typename CallbackRegistry<Args...>::Handle handle;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_ASYNC_CALLBACK_HPP_ */
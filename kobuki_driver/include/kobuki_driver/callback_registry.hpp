@@ -0,0 +1,227 @@
+/**
+ * @file include/kobuki_driver/callback_registry.hpp
+ *
+ * @brief Typed callbacks owned by the instance that calls them.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_CALLBACK_REGISTRY_HPP_
+#define KOBUKI_CALLBACK_REGISTRY_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief The callbacks connected to one of the driver's outputs.
+ *
+ * A typed alternative to the sigslots, to be used alongside them. Sigslots
+ * connect through global tables keyed by strings ("/mobile_base/stream_data"),
+ * whereas a registry belongs to the driver instance and is connected to
+ * directly, so there is no global state, no name to get wrong and nothing to
+ * look up.
+ *
+ * Callbacks are plain functions or member functions of an object, called
+ * through a function pointer without any allocation. The first few are held
+ * in the registry itself (inline_capacity), more spill onto the heap.
+ *
+ * Emitting is lock free and safe from any number of threads. Connecting and
+ * disconnecting may happen from any thread at any time, but not from inside
+ * one of the registry's own callbacks: the registry keeps two tables,
+ * rewrites the one not being emitted from and swaps them, and waits for
+ * emits still reading the old table to finish before rewriting it again
+ * (or, on disconnecting, before returning).
+ *
+ * @code
+ * class Logger {
+ * public:
+ *   void processStreamData() { ... }
+ * };
+ * Logger logger;
+ * kobuki::CallbackRegistry<>::Handle handle = kobuki.callbacks().stream_data.connect(&Logger::processStreamData, logger);
+ * ...
+ * kobuki.callbacks().stream_data.disconnect(handle);
+ * @endcode
+ */
+template <typename... Args>
+class CallbackRegistry {
+public:
+  typedef unsigned int Handle; /**< @brief Identifies a connection, 0 is never handed out. **/
+  static const unsigned int inline_capacity = 4; /**< @brief Callbacks held without allocating. **/
+
+  CallbackRegistry() : current(&tables[0]), next_handle(1) {}
+
+  /**
+   * @brief Connect a function.
+   */
+  Handle connect(void (*function)(Args...)) {
+    Entry entry;
+    entry.invoke = &CallbackRegistry::callFunction;
+    entry.object = NULL;
+    std::memcpy(entry.target, &function, sizeof(function));
+    return add(entry);
+  }
+
+  /**
+   * @brief Connect a member function, called on the object given.
+   *
+   * The object must outlive the connection.
+   */
+  template <typename C>
+  Handle connect(void (C::*method)(Args...), C &object) {
+    static_assert(sizeof(method) <= sizeof(Entry().target), "member function pointer too large for a callback entry");
+    Entry entry;
+    entry.invoke = &CallbackRegistry::template callMethod<C>;
+    entry.object = &object;
+    std::memcpy(entry.target, &method, sizeof(method));
+    return add(entry);
+  }
+
+  /**
+   * @brief Disconnect, returns false if the handle was not connected.
+   *
+   * Waits for emits already running the callback to finish, so once it
+   * returns the callback's object may go.
+   */
+  bool disconnect(const Handle &handle) {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    const Table &from = *current.load(std::memory_order_seq_cst);
+    Table &to = drained();
+    to.clear();
+    bool found = false;
+    for (unsigned int i = 0; i < from.size; ++i) {
+      if ( from[i].handle == handle ) { found = true; } else { to.push_back(from[i]); }
+    }
+    if ( found ) {
+      current.store(&to, std::memory_order_seq_cst);
+      while ( from.readers.load(std::memory_order_seq_cst) != 0 ) { std::this_thread::yield(); }
+    }
+    return found;
+  }
+
+  /**
+   * @brief Disconnect everything, waiting for running emits like disconnect().
+   */
+  void clear() {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    const Table &from = *current.load(std::memory_order_seq_cst);
+    Table &to = drained();
+    to.clear();
+    current.store(&to, std::memory_order_seq_cst);
+    while ( from.readers.load(std::memory_order_seq_cst) != 0 ) { std::this_thread::yield(); }
+  }
+
+  unsigned int size() const { return current.load(std::memory_order_acquire)->size; } /**< @brief Callbacks connected. **/
+  bool empty() const { return size() == 0; }
+
+  /**
+   * @brief Call every connected callback in the order they were connected.
+   */
+  void emit(Args... args) const {
+    const Table *table;
+    while ( true ) {
+      table = current.load(std::memory_order_seq_cst);
+      table->readers.fetch_add(1, std::memory_order_seq_cst);
+      if ( current.load(std::memory_order_seq_cst) == table ) { break; }
+      table->readers.fetch_sub(1, std::memory_order_release); // swapped under our feet, try the new one
+    }
+    for (unsigned int i = 0; i < table->size; ++i) {
+      const Entry &entry = (*table)[i];
+      entry.invoke(entry, args...);
+    }
+    table->readers.fetch_sub(1, std::memory_order_release);
+  }
+
+private:
+  CallbackRegistry(const CallbackRegistry&); // non-copyable
+  CallbackRegistry& operator=(const CallbackRegistry&);
+
+  class Dummy {};
+
+  struct Entry {
+    void (*invoke)(const Entry &entry, Args... args);
+    void *object;
+    Handle handle;
+    unsigned char target[sizeof(void (Dummy::*)())]; // the function or member function pointer
+  };
+
+  struct Table {
+    Table() : readers(0), size(0) {}
+    const Entry& operator[](const unsigned int &i) const { return (i < inline_capacity) ? local[i] : spill[i - inline_capacity]; }
+    void clear() { size = 0; spill.clear(); }
+    void push_back(const Entry &entry) {
+      if ( size < inline_capacity ) { local[size] = entry; } else { spill.push_back(entry); }
+      ++size;
+    }
+
+    mutable std::atomic<unsigned int> readers; // emits in progress on this table
+    unsigned int size;
+    Entry local[inline_capacity];
+    std::vector<Entry> spill;
+  };
+
+  static void callFunction(const Entry &entry, Args... args) {
+    void (*function)(Args...);
+    std::memcpy(&function, entry.target, sizeof(function));
+    function(args...);
+  }
+
+  template <typename C>
+  static void callMethod(const Entry &entry, Args... args) {
+    void (C::*method)(Args...);
+    std::memcpy(&method, entry.target, sizeof(method));
+    (static_cast<C*>(entry.object)->*method)(args...);
+  }
+
+  Handle add(Entry &entry) {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    const Table &from = *current.load(std::memory_order_seq_cst);
+    Table &to = drained();
+    to.clear();
+    for (unsigned int i = 0; i < from.size; ++i) { to.push_back(from[i]); }
+    entry.handle = next_handle++;
+    if ( next_handle == 0 ) { next_handle = 1; }
+    to.push_back(entry);
+    current.store(&to, std::memory_order_seq_cst);
+    return entry.handle;
+  }
+
+  /*
+   * The table not being emitted from, once the emits that started on it
+   * before the last swap are done. Call with the writer mutex held.
+   */
+  Table& drained() {
+    Table &table = ( current.load(std::memory_order_seq_cst) == &tables[0] ) ? tables[1] : tables[0];
+    while ( table.readers.load(std::memory_order_seq_cst) != 0 ) { std::this_thread::yield(); }
+    return table;
+  }
+
+  Table tables[2];
+  std::atomic<const Table*> current;
+  std::mutex writer_mutex; // serialises connect and disconnect
+  Handle next_handle;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_CALLBACK_REGISTRY_HPP_ */
@@ -0,0 +1,95 @@
+/**
+ * @file include/kobuki_driver/callback_worker_pool.hpp
+ *
+ * @brief Threads that run callbacks away from the driver's threads.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_CALLBACK_WORKER_POOL_HPP_
+#define KOBUKI_CALLBACK_WORKER_POOL_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <ecl/threads.hpp>
+#include "macros.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief A few threads working through the jobs handed to them.
+ *
+ * Jobs are scheduled, not queued: scheduling a job that is already waiting
+ * does nothing, and scheduling one that is running has it run once more
+ * when it is done. A job therefore never runs on two threads at once and
+ * is expected to work through everything it has pending each time it runs
+ * (see AsyncCallback).
+ *
+ * Scheduling takes a short lock and never allocates, so it is fine from the
+ * driver's threads.
+ */
+class kobuki_PUBLIC CallbackWorkerPool {
+public:
+  /**
+   * @brief Something to run on the pool.
+   */
+  class Job {
+  public:
+    Job() : next(NULL), state(Idle), rerun(false) {}
+    virtual ~Job() {}
+    virtual void run() = 0;
+
+  private:
+    friend class CallbackWorkerPool;
+    enum State { Idle, Queued, Running };
+    Job *next;  // in the pool's queue
+    State state;
+    bool rerun; // scheduled again while running
+    std::thread::id runner; // the thread running it, while Running
+  };
+
+  CallbackWorkerPool();
+  ~CallbackWorkerPool();
+
+  void start(const unsigned int &number_of_threads);
+  void stop();
+  unsigned int threads() const; /**< @brief Worker threads running, 0 if stopped. **/
+
+  void schedule(Job &job);
+  void cancel(Job &job);
+  bool isRunningJob(const Job &job) const;
+
+private:
+  CallbackWorkerPool(const CallbackWorkerPool&); // non-copyable
+  CallbackWorkerPool& operator=(const CallbackWorkerPool&);
+
+  void work();
+
+  mutable std::mutex mutex; // guards everything below, and the jobs' scheduling state
+  std::condition_variable job_available;
+  std::condition_variable job_finished;
+  Job *head, *tail; // jobs waiting for a thread
+  bool stopping;
+  std::vector<ecl::Thread*> workers;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_CALLBACK_WORKER_POOL_HPP_ */
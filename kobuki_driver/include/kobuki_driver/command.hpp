@@ -51,6 +51,12 @@ public:
     HardwareVersion = 0x01, FirmwareVersion = 0x02/*, Time = 0x04*/, UniqueDeviceID = 0x08
   };
 
+  /**
+   * The payload length field is a single byte, so this many bytes of sub-payloads
+   * fit in a single frame.
+   */
+  static const unsigned int max_payload_length = 255;
+
   /**
    * @brief Data structure containing data for commands.
    *
@@ -0,0 +1,87 @@
+/**
+ * @file include/kobuki_driver/command_queue.hpp
+ *
+ * @brief Lock free backlog for handing commands to the transmit thread.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_COMMAND_QUEUE_HPP_
+#define KOBUKI_COMMAND_QUEUE_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+#include "command.hpp"
+#include "macros.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief Bounded, lock free, multiple producer single consumer command backlog.
+ *
+ * Any number of threads may push (the user's setLed/playSoundSequence... calls
+ * and the driver's own base control updates) while the transmit thread pops.
+ * Pushing never blocks, whatever the state of the serial port. The policy is:
+ *
+ * - BaseControl : a single slot; a newer velocity command replaces an older
+ *   one that has not gone out yet (counted as superseded).
+ * - Everything else (sound, leds, gains, requests) : one shot commands that
+ *   must not be lost or reordered, kept in order in a bounded fifo. When the
+ *   fifo is full the new command is rejected and counted as an overflow.
+ *
+ * The pending base control always comes out first. The fifo is the array
+ * based queue of D. Vyukov - each cell carries a sequence number that tells
+ * producers and the consumer whose turn it is.
+ */
+class kobuki_PUBLIC CommandQueue {
+public:
+  CommandQueue(const unsigned int &capacity = 64);
+  ~CommandQueue();
+
+  bool push(const Command &command);
+  bool pop(Command &command);
+  unsigned int capacity() const { return static_cast<unsigned int>(mask + 1); } /**< Capacity of the one shot fifo. **/
+  unsigned long overflows() const { return overflow_count.load(std::memory_order_relaxed); } /**< Number of one shot commands rejected because the fifo was full. **/
+  unsigned long superseded() const { return superseded_count.load(std::memory_order_relaxed); } /**< Number of base control commands replaced before they were sent. **/
+
+private:
+  CommandQueue(const CommandQueue&); // non-copyable
+  CommandQueue& operator=(const CommandQueue&);
+
+  bool pushOneShot(const Command &command);
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    Command::Data data; // commands themselves aren't assignable, but their data is all we need
+  };
+
+  std::atomic<uint64_t> base_control; // pending flag | speed | radius
+  Cell *cells;
+  size_t mask;
+  char padding0[64];
+  std::atomic<size_t> enqueue_position; // shared by the producers
+  char padding1[64];
+  size_t dequeue_position; // consumer only
+  std::atomic<unsigned long> overflow_count;
+  std::atomic<unsigned long> superseded_count;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_COMMAND_QUEUE_HPP_ */
@@ -0,0 +1,338 @@
+/**
+ * @file include/kobuki_driver/coroutines.hpp
+ *
+ * @brief C++20 coroutine interface to the driver.
+ *
+ * Header only and entirely optional - the driver itself does not need it and
+ * is still built as c++11. Include it from code compiled with c++20.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_COROUTINES_HPP_
+#define KOBUKI_COROUTINES_HPP_
+
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <ecl/sigslots.hpp>
+#include "kobuki.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Task
+*****************************************************************************/
+/**
+ * @brief Fire and forget coroutine.
+ *
+ * Starts running as soon as it is called, up to its first co_await, and
+ * cleans up after itself when it finishes.
+ *
+ * @code
+ * kobuki::Task patrol(kobuki::Coroutines &robot) {
+ *   for (;;) {
+ *     kobuki::BumperEvent event = co_await robot.event<kobuki::BumperEvent>();
+ *     ...
+ *   }
+ * }
+ * @endcode
+ */
+struct Task {
+  struct promise_type {
+    Task get_return_object() { return Task(); }
+    std::suspend_never initial_suspend() noexcept { return std::suspend_never(); }
+    std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+/*****************************************************************************
+** Event Topics
+*****************************************************************************/
+
+namespace event_topics {
+template <typename Event> struct Topic;
+template <> struct Topic<ButtonEvent> { static const char* name() { return "/button_event"; } };
+template <> struct Topic<BumperEvent> { static const char* name() { return "/bumper_event"; } };
+template <> struct Topic<CliffEvent>  { static const char* name() { return "/cliff_event"; } };
+template <> struct Topic<WheelEvent>  { static const char* name() { return "/wheel_event"; } };
+template <> struct Topic<PowerEvent>  { static const char* name() { return "/power_event"; } };
+template <> struct Topic<InputEvent>  { static const char* name() { return "/input_event"; } };
+template <> struct Topic<RobotEvent>  { static const char* name() { return "/robot_event"; } };
+} // namespace event_topics
+
+/*****************************************************************************
+** Coroutines
+*****************************************************************************/
+/**
+ * @brief Awaitables driven by the driver's signals.
+ *
+ * Coroutines waiting for a frame are resumed from the driver's stream_data
+ * signal, those waiting for an event from that event's own signal (so a
+ * RobotEvent arrives while the robot is offline and no frames come in) and
+ * those waiting for controller gains from controller_info. These come from
+ * different threads (the reading thread, or the decode and publish stages of
+ * the staged pipeline), but the coroutines are resumed one at a time, under a
+ * single lock. They can use the driver's getters freely and share state among
+ * themselves without locks of their own, but must not block - a coroutine
+ * that sleeps holds up the driver.
+ *
+ * Events are handed out as they are raised, in the order they happened. A
+ * coroutine that goes straight back to waiting for the same kind of event
+ * gets the next one, even within the same frame.
+ *
+ * Destroying this object destroys the coroutines still waiting on it.
+ */
+class Coroutines {
+public:
+  /**
+   * @param kobuki : an initialised driver.
+   * @param sigslots_namespace : the namespace the driver was initialised with.
+   */
+  Coroutines(Kobuki &kobuki, const std::string &sigslots_namespace = "/kobuki") :
+    kobuki(kobuki),
+    resuming_thread(std::thread::id()),
+    event_channels(EventChannel<ButtonEvent>(*this), EventChannel<BumperEvent>(*this), EventChannel<CliffEvent>(*this),
+                   EventChannel<WheelEvent>(*this), EventChannel<PowerEvent>(*this), EventChannel<InputEvent>(*this),
+                   EventChannel<RobotEvent>(*this)),
+    slot_stream_data(&Coroutines::frameReceived, *this),
+    slot_controller_info(&Coroutines::controllerInfoReceived, *this)
+  {
+    std::apply([&](auto&... channel) { (channel.connect(sigslots_namespace), ...); }, event_channels);
+    slot_stream_data.connect(sigslots_namespace + std::string("/stream_data"));
+    slot_controller_info.connect(sigslots_namespace + std::string("/controller_info"));
+  }
+
+  ~Coroutines() {
+    slot_stream_data.disconnect();
+    slot_controller_info.disconnect();
+    std::apply([](auto&... channel) { (channel.disconnect(), ...); }, event_channels);
+    std::lock_guard<std::mutex> lock(resume_mutex);
+    for ( std::coroutine_handle<> handle : frame_waiters ) { handle.destroy(); }
+    for ( const GainWaiter &waiter : gain_waiters ) { waiter.handle.destroy(); }
+    std::apply([](auto&... channel) { (channel.destroyWaiters(), ...); }, event_channels);
+  }
+
+  Coroutines(const Coroutines&) = delete;
+  Coroutines& operator=(const Coroutines&) = delete;
+
+private:
+  /*********************
+  ** Events
+  **********************/
+  template <typename Event>
+  struct EventChannel {
+    explicit EventChannel(Coroutines &coroutines) : coroutines(&coroutines), current(), slot(&EventChannel::received, *this) {}
+    EventChannel(const EventChannel &other) : coroutines(other.coroutines), current(), slot(&EventChannel::received, *this) {}
+
+    void connect(const std::string &sigslots_namespace) { slot.connect(sigslots_namespace + event_topics::Topic<Event>::name()); }
+    void disconnect() { slot.disconnect(); }
+    void destroyWaiters() {
+      for ( std::coroutine_handle<> handle : waiters ) { handle.destroy(); }
+      waiters.clear();
+    }
+
+    // the thread raising the event
+    void received(const Event &event) {
+      std::lock_guard<std::mutex> lock(coroutines->resume_mutex);
+      Resumption resumption(*coroutines);
+      coroutines->eventReceived(event);
+      current = event;
+      Coroutines::resumeAll(waiters, resuming);
+    }
+
+    Coroutines *coroutines;
+    Event current;
+    std::vector<std::coroutine_handle<> > waiters, resuming;
+    ecl::Slot<const Event&> slot;
+  };
+
+  /*
+   * Marks the thread as resuming coroutines while the resume lock is held,
+   * so the awaitables they go on to suspend on know not to take it again.
+   */
+  struct Resumption {
+    explicit Resumption(Coroutines &coroutines) : coroutines(coroutines) { coroutines.resuming_thread.store(std::this_thread::get_id()); }
+    ~Resumption() { coroutines.resuming_thread.store(std::thread::id()); }
+    Coroutines &coroutines;
+  };
+
+public:
+
+  /*********************
+  ** Awaitables
+  **********************/
+  struct FrameAwaiter {
+    explicit FrameAwaiter(Coroutines &coroutines) : coroutines(coroutines) {}
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) { coroutines.suspend([&] { coroutines.frame_waiters.push_back(handle); }); }
+    Frame await_resume() const { return coroutines.kobuki.getFrame(); }
+    Coroutines &coroutines;
+  };
+
+  template <typename Event>
+  struct EventAwaiter {
+    explicit EventAwaiter(Coroutines &coroutines, Coroutines::EventChannel<Event> &channel) : coroutines(coroutines), channel(channel) {}
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) { coroutines.suspend([&] { channel.waiters.push_back(handle); }); }
+    Event await_resume() const { return channel.current; }
+    Coroutines &coroutines;
+    Coroutines::EventChannel<Event> &channel;
+  };
+
+  struct ControllerGainAwaiter {
+    ControllerGainAwaiter(Coroutines &coroutines, const double &timeout) :
+      coroutines(coroutines), timeout(timeout), received(false) {}
+    bool await_ready() {
+      // a robot that is not alive drops the request, don't wait for an answer that won't come
+      return !coroutines.kobuki.isAlive() || !coroutines.kobuki.getControllerGain();
+    }
+    void await_suspend(std::coroutine_handle<> handle) {
+      GainWaiter waiter;
+      waiter.handle = handle;
+      waiter.deadline = monotonicNow() + static_cast<MonotonicTime>(timeout * 1.0e9);
+      waiter.received = &received;
+      coroutines.suspend([&] { coroutines.gain_waiters.push_back(waiter); });
+    }
+    std::optional<ControllerInfo::Data> await_resume() const {
+      if ( !received ) { return std::nullopt; }
+      return coroutines.kobuki.getControllerInfoData();
+    }
+    Coroutines &coroutines;
+    double timeout;
+    bool received;
+  };
+
+  /**
+   * @brief Resume with the next frame (a self consistent snapshot).
+   */
+  FrameAwaiter nextFrame() { return FrameAwaiter(*this); }
+
+  /**
+   * @brief Resume with the next event of the given type (ButtonEvent, BumperEvent, ...).
+   */
+  template <typename Event>
+  EventAwaiter<Event> event() { return EventAwaiter<Event>(*this, std::get<EventChannel<Event> >(event_channels)); }
+
+  /**
+   * @brief Ask the robot for its controller gains and resume once they arrive.
+   *
+   * Resumes with nothing if the firmware doesn't support it, the robot is
+   * not alive or goes offline before answering, or no answer comes within
+   * the timeout (checked as frames come in).
+   *
+   * @param timeout : give up after this many seconds [s].
+   */
+  ControllerGainAwaiter requestControllerGain(const double &timeout = 1.0) { return ControllerGainAwaiter(*this, timeout); }
+
+private:
+  struct GainWaiter {
+    std::coroutine_handle<> handle;
+    MonotonicTime deadline;
+    bool *received; // in the suspended awaiter
+  };
+
+  /*********************
+  ** Resumption
+  **********************/
+  /**
+   * Resume everything waiting; anything they wait on next goes back into the
+   * (now empty) list for the next round.
+   */
+  static void resumeAll(std::vector<std::coroutine_handle<> > &waiters, std::vector<std::coroutine_handle<> > &resuming) {
+    resuming.swap(waiters);
+    for ( std::coroutine_handle<> handle : resuming ) { handle.resume(); }
+    resuming.clear();
+  }
+
+  /**
+   * Resume the gain waiters that got their answer (or gave up on it), keeping
+   * the others.
+   */
+  void resumeGainWaiters(const bool &answered, const bool &offline) {
+    MonotonicTime now = monotonicNow();
+    resuming_gains.swap(gain_waiters);
+    for ( const GainWaiter &waiter : resuming_gains ) {
+      if ( answered || offline || now >= waiter.deadline ) {
+        *waiter.received = answered;
+        waiter.handle.resume();
+      } else {
+        gain_waiters.push_back(waiter);
+      }
+    }
+    resuming_gains.clear();
+  }
+
+  /**
+   * Add to a list of waiters, taking the resume lock unless this thread is
+   * already resuming (a coroutine suspending again from within a resumption).
+   */
+  template <typename Add>
+  void suspend(Add add) {
+    if ( resuming_thread.load() == std::this_thread::get_id() ) {
+      add();
+    } else {
+      std::lock_guard<std::mutex> lock(resume_mutex);
+      add();
+    }
+  }
+
+  template <typename Event>
+  void eventReceived(const Event &) {}
+
+  void eventReceived(const RobotEvent &event) {
+    if ( event.state == RobotEvent::Offline ) { resumeGainWaiters(false, true); }
+  }
+
+  void frameReceived() {
+    std::lock_guard<std::mutex> lock(resume_mutex);
+    Resumption resumption(*this);
+    resumeGainWaiters(false, false); // time outs
+    resumeAll(frame_waiters, resuming);
+  }
+
+  void controllerInfoReceived() {
+    std::lock_guard<std::mutex> lock(resume_mutex);
+    Resumption resumption(*this);
+    resumeGainWaiters(true, false);
+  }
+
+  Kobuki &kobuki;
+  std::mutex resume_mutex; // one resumption at a time, whichever thread the signal comes from
+  std::atomic<std::thread::id> resuming_thread; // holder of the resume lock, while it resumes
+  std::tuple<EventChannel<ButtonEvent>, EventChannel<BumperEvent>, EventChannel<CliffEvent>,
+             EventChannel<WheelEvent>, EventChannel<PowerEvent>, EventChannel<InputEvent>,
+             EventChannel<RobotEvent> > event_channels;
+  std::vector<std::coroutine_handle<> > frame_waiters, resuming;
+  std::vector<GainWaiter> gain_waiters, resuming_gains;
+  ecl::Slot<> slot_stream_data;
+  ecl::Slot<> slot_controller_info;
+};
+
+} // namespace kobuki
+
+#endif /* __cplusplus >= 202002L */
+
+#endif /* KOBUKI_COROUTINES_HPP_ */
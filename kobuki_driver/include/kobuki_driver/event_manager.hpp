@@ -22,6 +22,10 @@
 #include <ecl/sigslots.hpp>
 
 #include "packets/core_sensors.hpp"
+#include "callback_registry.hpp"
+#include "frame_info.hpp"
+#include "slot_monitor.hpp"
+#include "profiler.hpp"
 #include "macros.hpp"
 
 /*****************************************************************************
@@ -105,9 +109,64 @@ struct RobotEvent {
   } state;
 };
 
+/**
+ * @brief All the events raised by one frame, handed out together.
+ *
+ * A bumper hit that also trips a cliff sensor, or several buttons changing
+ * at once, then costs a single dispatch with the frame's time stamps rather
+ * than one per changed bit. Robot (online/offline) events do not come from
+ * frames and are only signalled on their own.
+ */
+struct EventBatch {
+  EventBatch() { clear(); }
+
+  void clear() {
+    number_of_buttons = number_of_bumpers = number_of_cliffs = 0;
+    number_of_wheels = number_of_powers = 0;
+    has_input = false;
+  }
+  bool empty() const {
+    return !has_input && (number_of_buttons | number_of_bumpers | number_of_cliffs | number_of_wheels | number_of_powers) == 0;
+  }
+  void add(const ButtonEvent &event) { if ( number_of_buttons < 3 ) { buttons[number_of_buttons++] = event; } }
+  void add(const BumperEvent &event) { if ( number_of_bumpers < 3 ) { bumpers[number_of_bumpers++] = event; } }
+  void add(const CliffEvent &event) { if ( number_of_cliffs < 3 ) { cliffs[number_of_cliffs++] = event; } }
+  void add(const WheelEvent &event) { if ( number_of_wheels < 2 ) { wheels[number_of_wheels++] = event; } }
+  void add(const PowerEvent &event) { if ( number_of_powers < 2 ) { powers[number_of_powers++] = event; } }
+  void add(const InputEvent &event) { input = event; has_input = true; }
+
+  FrameInfo info; /**< @brief The frame the events came in, with its firmware (firmware_time) and host (host_time) time stamps. **/
+
+  unsigned int number_of_buttons; /**< @brief Valid entries in buttons, in the order they were raised. **/
+  ButtonEvent buttons[3];
+  unsigned int number_of_bumpers;
+  BumperEvent bumpers[3];
+  unsigned int number_of_cliffs;
+  CliffEvent cliffs[3];
+  unsigned int number_of_wheels;
+  WheelEvent wheels[2];
+  unsigned int number_of_powers;  /**< @brief Up to two: a charger change and a battery level change. **/
+  PowerEvent powers[2];
+  bool has_input;                 /**< @brief Whether the digital inputs changed (see input). **/
+  InputEvent input;
+};
+
 /*****************************************************************************
 ** Interfaces
 *****************************************************************************/
+/**
+ * @brief Typed counterparts of the event sigslots (see CallbackRegistry).
+ */
+struct EventCallbacks {
+  CallbackRegistry<const ButtonEvent&> button;
+  CallbackRegistry<const BumperEvent&> bumper;
+  CallbackRegistry<const CliffEvent&>  cliff;
+  CallbackRegistry<const WheelEvent&>  wheel;
+  CallbackRegistry<const PowerEvent&>  power;
+  CallbackRegistry<const InputEvent&>  input;
+  CallbackRegistry<const RobotEvent&>  robot;
+  CallbackRegistry<const EventBatch&>  batch;
+};
 
 class kobuki_PUBLIC EventManager {
 public:
@@ -120,17 +179,48 @@ public:
     last_state.battery    = 0;
     last_digital_input    = 0;
     last_robot_state      = RobotEvent::Unknown;
+    slot_monitor          = NULL;
+    profiler              = NULL;
+    single_events         = true;
   }
 
-  void init(const std::string &sigslots_namespace);
+  void init(const std::string &sigslots_namespace, SlotMonitor *slot_monitor = NULL, Profiler *profiler = NULL,
+            const bool &single_events = true);
   void update(const CoreSensors::Data &new_state, const std::vector<uint16_t> &cliff_data);
   void update(const uint16_t &digital_input);
   void update(bool is_plugged, bool is_alive);
+  void flush(const FrameInfo &frame_info);
+
+  EventCallbacks& callbacks() { return event_callbacks; }
 
 private:
   CoreSensors::Data last_state;
   uint16_t          last_digital_input;
   RobotEvent::State last_robot_state;
+  SlotMonitor      *slot_monitor;
+  Profiler         *profiler;
+  bool              single_events; // also signal each event on its own
+  EventBatch        batch;         // the events of the frame being decoded
+
+  template <typename Event>
+  void emit(ecl::Signal<const Event&> &signal, const CallbackRegistry<const Event&> &callbacks,
+            const Event &event, const SlotMonitor::Channel &channel) {
+    Profiler::Scope scope(profiler, Profiler::emitStage(channel));
+    MonotonicTime start_time = monotonicNow();
+    signal.emit(event);
+    callbacks.emit(event);
+    if ( slot_monitor != NULL ) { slot_monitor->record(channel, start_time); }
+  }
+
+  /*
+   * A frame's event: into the batch, and signalled right away if single events are on.
+   */
+  template <typename Event>
+  void raise(ecl::Signal<const Event&> &signal, const CallbackRegistry<const Event&> &callbacks,
+             const Event &event, const SlotMonitor::Channel &channel) {
+    batch.add(event);
+    if ( single_events ) { emit(signal, callbacks, event, channel); }
+  }
 
   ecl::Signal<const ButtonEvent&> sig_button_event;
   ecl::Signal<const BumperEvent&> sig_bumper_event;
@@ -139,6 +229,8 @@ private:
   ecl::Signal<const PowerEvent&>  sig_power_event;
   ecl::Signal<const InputEvent&>  sig_input_event;
   ecl::Signal<const RobotEvent&>  sig_robot_event;
+  ecl::Signal<const EventBatch&>  sig_event_batch;
+  EventCallbacks event_callbacks;
 };
 
 
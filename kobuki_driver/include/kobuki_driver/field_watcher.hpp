@@ -0,0 +1,161 @@
+/**
+ * @file include/kobuki_driver/field_watcher.hpp
+ *
+ * @brief Wakes subscribers when a field of the sensor stream changes.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_FIELD_WATCHER_HPP_
+#define KOBUKI_FIELD_WATCHER_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include "frame_info.hpp"
+#include "packets/core_sensors.hpp"
+#include "packets/current.hpp"
+#include "packets/gp_input.hpp"
+#include "macros.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief Watches fields of the sensor stream for the conditions subscribers ask for.
+ *
+ * A subscriber names a field and a condition, then blocks in wait() until the
+ * condition is met, rather than polling every frame for something that
+ * happens a few times an hour (the charger being plugged in, a bumper wired
+ * to an analog input, a stalled motor).
+ *
+ * The decode stage checks every active subscription against each frame with
+ * an integer comparison on the raw value (thresholds are converted to raw
+ * units when subscribing) and only touches a subscriber's lock when its
+ * condition is met, so idle subscriptions cost next to nothing and a
+ * subscriber is woken for its own field only.
+ *
+ * Events are not queued: if a condition is met again before the subscriber
+ * collects the last event, the newer one replaces it and missed() counts the
+ * one that was replaced.
+ *
+ * @code
+ * kobuki::FieldWatcher &watcher = kobuki.fieldWatcher();
+ * int id = watcher.subscribe(kobuki::FieldWatcher::BatteryVoltage, kobuki::FieldWatcher::ChangedBy, 0.1);
+ * kobuki::FieldWatcher::Event event;
+ * while ( watcher.wait(id, 60.0, event) ) {
+ *   std::cout << "battery: " << event.value << "V" << std::endl;
+ * }
+ * watcher.unsubscribe(id);
+ * @endcode
+ */
+class kobuki_PUBLIC FieldWatcher {
+public:
+  /**
+   * @brief The fields that can be watched, with the units of their values and thresholds.
+   */
+  enum Field {
+    BatteryVoltage = 0, /**< @brief Battery voltage [V], resolution 0.1V. **/
+    ChargerState,       /**< @brief Raw charger byte of the core sensors (CoreSensors::Flags), only ChangedBy makes sense. **/
+    AnalogInput0,       /**< @brief Analog input [adc counts], 0-4095 for 0-3.3V. **/
+    AnalogInput1,
+    AnalogInput2,
+    AnalogInput3,
+    LeftMotorCurrent,   /**< @brief Left motor current [A], resolution 10mA. **/
+    RightMotorCurrent,  /**< @brief Right motor current [A], resolution 10mA. **/
+    NumberOfFields
+  };
+
+  /**
+   * @brief What a subscriber is waiting for.
+   */
+  enum Condition {
+    ChangedBy = 0, /**< @brief Moved at least the threshold away from the last reported value (any change if under one raw unit). **/
+    RisesAbove,    /**< @brief Went from at or below the threshold to above it. **/
+    FallsBelow,    /**< @brief Went from at or above the threshold to below it. **/
+    Crosses        /**< @brief Either of the above. **/
+  };
+
+  /**
+   * @brief A condition being met.
+   */
+  struct Event {
+    Field field;
+    double value;      /**< @brief The new value, in the field's units. **/
+    double previous;   /**< @brief The value it was compared against (last reported, or the previous frame's for crossings). **/
+    FrameInfo info;    /**< @brief The frame it was met in. **/
+  };
+
+  static const unsigned int max_subscriptions = 32; /**< @brief Subscriptions that can be active at once. **/
+
+  FieldWatcher();
+
+  /*********************
+  ** Subscribers (any thread)
+  **********************/
+  int subscribe(const Field &field, const Condition &condition, const double &threshold = 0.0);
+  void unsubscribe(const int &id);
+  bool wait(const int &id, const double &timeout, Event &event);
+  bool poll(const int &id, Event &event);
+  unsigned long missed(const int &id) const;
+
+  static double value(const Field &field, const int &raw);
+
+  /*********************
+  ** Decode Stage
+  **********************/
+  void update(const FrameInfo &info, const uint32_t &payloads, const CoreSensors::Data &core_sensors,
+              const Current::Data &current, const GpInput::Data &gp_input);
+
+private:
+  FieldWatcher(const FieldWatcher&); // non-copyable
+  FieldWatcher& operator=(const FieldWatcher&);
+
+  struct Slot {
+    // set when subscribing, read by the decode stage
+    std::atomic<unsigned int> generation; // tells a reused slot apart, odd while subscribe() sets it up
+    std::atomic<int> field;
+    std::atomic<int> condition;
+    std::atomic<int> threshold; // raw units
+
+    // decode stage only
+    unsigned int seen_generation;
+    int reference; // last reported value for ChangedBy, previous frame's value for crossings
+
+    // handed to the subscriber
+    mutable std::mutex mutex;
+    std::condition_variable condition_met;
+    bool pending;
+    Event event;
+    unsigned long missed;
+  };
+
+  static int raw(const Field &field, const double &value);
+  static bool present(const Field &field, const uint32_t &payloads);
+  void notify(Slot &slot, const unsigned int &generation, const Field &field, const int &value, const int &previous,
+              const FrameInfo &info);
+  bool valid(const int &id) const { return id >= 0 && id < static_cast<int>(max_subscriptions); }
+
+  Slot slots[max_subscriptions];
+  std::atomic<uint32_t> claimed; // bitmask of the slots handed out
+  std::atomic<uint32_t> active;  // bitmask of the slots the decode stage checks, so an idle watcher costs one load
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_FIELD_WATCHER_HPP_ */
@@ -0,0 +1,79 @@
+/**
+ * @file include/kobuki_driver/frame.hpp
+ *
+ * @brief Flat snapshot of everything decoded from a single data frame.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_FRAME_HPP_
+#define KOBUKI_FRAME_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <stdint.h>
+#include "frame_info.hpp"
+#include "packets.hpp"
+#include "packet_handler/payload_headers.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief Raw bytes of a frame on their way from the io to the decode stage.
+ */
+struct RawFrame {
+  static const unsigned int max_size = 260; /**< @brief stx(2) + length(1) + payload(<=255) + checksum(1), rounded up. **/
+
+  MonotonicTime receive_time; /**< @brief See FrameInfo::receive_time. **/
+  bool resync;                /**< @brief The connection was lost since the previous frame, the firmware may have restarted. **/
+  unsigned int size;          /**< @brief Number of valid bytes. **/
+  unsigned char bytes[max_size];
+};
+
+/**
+ * @brief Everything the robot has told us, as of the end of a data frame.
+ *
+ * Sub-payloads that were not part of the frame (e.g. the version info, which
+ * only comes on request) keep their last received values; use
+ * contains() to check which ones actually arrived with it.
+ *
+ * The variable length containers of the packet data structures are flattened
+ * into fixed arrays so that the whole thing is trivially copyable. This lets
+ * the driver pass frames between threads without allocating.
+ */
+struct Frame {
+  bool contains(const Header::PayloadType &type) const { return (payloads & (1u << type)) != 0; }
+
+  FrameInfo info;
+  uint32_t payloads; /**< @brief Bit mask (1 << Header::PayloadType) of the sub-payloads received with this frame. **/
+
+  CoreSensors::Data core_sensors;
+  Inertia::Data inertia;
+  uint16_t cliff_bottom[3];
+  uint8_t current[2];
+  uint8_t dock_ir[3];
+  uint16_t digital_input;
+  uint16_t analog_input[4];
+  ThreeAxisGyro::Data three_axis_gyro;
+  ControllerInfo::Data controller_info;
+  uint32_t hardware_version;
+  uint32_t firmware_version;
+  uint32_t udid[3];
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_FRAME_HPP_ */
@@ -0,0 +1,98 @@
+/**
+ * @file include/kobuki_driver/frame_history.hpp
+ *
+ * @brief Time indexed history of the most recent frames.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_FRAME_HISTORY_HPP_
+#define KOBUKI_FRAME_HISTORY_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+#include "frame.hpp"
+#include "seqlock.hpp"
+#include "macros.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief The last few seconds of frames, for aligning with other sensors.
+ *
+ * Frames are kept in a fixed ring in the order they were published and looked
+ * up by host time (FrameInfo::host_time, which is free of usb delivery jitter)
+ * with a binary search over a contiguous array of time stamps.
+ *
+ * The publish stage adds frames; queries are lock free and safe from any
+ * thread. Each slot is sequence locked, so a query never sees a half written
+ * frame. A query that is preempted for long enough may find the oldest frames
+ * it was after overwritten, in which case it just leaves them out.
+ */
+class kobuki_PUBLIC FrameHistory {
+public:
+  /**
+   * @brief Encoders and heading interpolated to an arbitrary time.
+   */
+  struct Sample {
+    MonotonicTime time;    /**< @brief The time queried. **/
+    double left_encoder;   /**< @brief Left encoder [ticks], wrapping at 65536 like the raw counter. **/
+    double right_encoder;  /**< @brief Right encoder [ticks], wrapping at 65536 like the raw counter. **/
+    double heading;        /**< @brief Gyro heading [rad] in (-pi, pi], as reported (i.e. before any resetOdometry() offset). **/
+  };
+
+  FrameHistory(const unsigned int &capacity = 512);
+  ~FrameHistory();
+
+  void resize(const unsigned int &capacity);
+  void add(const Frame &frame);
+
+  unsigned int capacity() const { return number_of_slots; } /**< @brief Frames kept [0 if disabled]. **/
+  unsigned int size() const;
+  bool at(const MonotonicTime &time, Sample &sample) const;
+  bool nearest(const MonotonicTime &time, Frame &frame) const;
+  unsigned int range(const MonotonicTime &begin, const MonotonicTime &end, std::vector<Frame> &frames) const;
+
+  static MonotonicTime timeOf(const Frame &frame);
+
+private:
+  FrameHistory(const FrameHistory&); // non-copyable
+  FrameHistory& operator=(const FrameHistory&);
+
+  struct Entry {
+    uint64_t index; // position in the stream of added frames, tells an overwritten slot apart
+    Frame frame;
+  };
+
+  void span(uint64_t &first, uint64_t &end) const;
+  uint64_t lowerBound(const MonotonicTime &time, uint64_t first, uint64_t end) const;
+  uint64_t upperBound(const MonotonicTime &time, uint64_t first, uint64_t end) const;
+  MonotonicTime key(const uint64_t &index) const { return times[index & mask].load(std::memory_order_acquire); }
+  bool load(const uint64_t &index, Frame &frame) const;
+
+  unsigned int number_of_slots;
+  uint64_t mask;
+  Seqlock<Entry> *slots;
+  std::atomic<MonotonicTime> *times; // contiguous keys for the binary search
+  std::atomic<uint64_t> added;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_FRAME_HISTORY_HPP_ */
@@ -0,0 +1,73 @@
+/**
+ * @file include/kobuki_driver/frame_info.hpp
+ *
+ * @brief Host side meta information attached to each incoming data frame.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_FRAME_INFO_HPP_
+#define KOBUKI_FRAME_INFO_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <stdint.h>
+#include "macros.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Monotonic Time
+*****************************************************************************/
+/**
+ * @brief Nanoseconds on the host's monotonic clock.
+ *
+ * Unlike ecl::TimeStamp (wall clock), this never jumps with ntp adjustments,
+ * so it is safe to difference and to use for sensor fusion.
+ */
+typedef int64_t MonotonicTime;
+
+/**
+ * @brief Current time on the host's monotonic clock (CLOCK_MONOTONIC on posix).
+ */
+kobuki_PUBLIC MonotonicTime monotonicNow();
+
+/**
+ * @brief Convert a monotonic time (or difference) to seconds.
+ */
+inline double toSeconds(const MonotonicTime &time) { return static_cast<double>(time) * 1.0e-9; }
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief Timing information for the last decoded data frame.
+ *
+ * Retrieve it with Kobuki::getFrameInfo() from within the stream_data slot
+ * (or with data access locked), or alongside an odometry update with
+ * Kobuki::updateOdometry().
+ */
+struct FrameInfo {
+  FrameInfo() : sequence(0), periods(1), receive_time(0), host_time(0), firmware_time(0) {}
+
+  uint64_t sequence;          /**< @brief Number of frames decoded so far, including this one (0 before the first). **/
+  unsigned int periods;       /**< @brief Stream periods since the previous frame (see FrameLossMonitor), more than 1 if frames were lost. **/
+
+  MonotonicTime receive_time; /**< @brief Host time at which the serial read delivering the first byte of the frame returned. **/
+  MonotonicTime host_time;    /**< @brief Host time at which the firmware stamped the frame, free of usb delivery jitter (see FirmwareClock). **/
+  int64_t firmware_time;      /**< @brief Firmware time stamp unwrapped to 64 bits [ms]. **/
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_FRAME_INFO_HPP_ */
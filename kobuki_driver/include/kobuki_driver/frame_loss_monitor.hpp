@@ -0,0 +1,86 @@
+/**
+ * @file include/kobuki_driver/frame_loss_monitor.hpp
+ *
+ * @brief Detects data frames lost on the way from the robot via gaps in the firmware time stamps.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_FRAME_LOSS_MONITOR_HPP_
+#define KOBUKI_FRAME_LOSS_MONITOR_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+#include "frame_info.hpp"
+#include "macros.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief Frame loss accounting for the 50Hz data stream.
+ *
+ * The firmware stamps every frame it streams, so a step in the (unwrapped)
+ * firmware time of more than one stream period means frames went missing
+ * somewhere between the firmware and the decoder - garbled on the wire,
+ * lost in a usb hiccup or dropped by the driver's own pipeline.
+ *
+ * The decode stage updates it, any thread may read it. All counters are
+ * relaxed atomics, so the figures read together may be a frame apart.
+ */
+class kobuki_PUBLIC FrameLossMonitor {
+public:
+  static const int64_t stream_period = 20;  /**< @brief Nominal period of the data stream [ms]. **/
+  static const unsigned int window = 60;    /**< @brief Length of the rate window [s]. **/
+
+  FrameLossMonitor() { reset(); }
+
+  unsigned int update(const int64_t &firmware_time, const MonotonicTime &host_time);
+  void resync() { previous_firmware_time = -1; }
+  void reset();
+
+  unsigned long received() const { return frames_received.load(std::memory_order_relaxed); } /**< @brief Frames decoded. **/
+  unsigned long lost() const { return frames_lost.load(std::memory_order_relaxed); } /**< @brief Frames missing between those decoded. **/
+  int64_t maximumGap() const { return maximum_gap.load(std::memory_order_relaxed); } /**< @brief Longest step between consecutive frames [ms]. **/
+  unsigned long receivedLastMinute(const MonotonicTime &now) const;
+  unsigned long lostLastMinute(const MonotonicTime &now) const;
+  double lossRate(const MonotonicTime &now) const;
+  std::string toString(const MonotonicTime &now) const;
+
+private:
+  FrameLossMonitor(const FrameLossMonitor&); // non-copyable
+  FrameLossMonitor& operator=(const FrameLossMonitor&);
+
+  struct Second {
+    std::atomic<int64_t> second;           // host time [s] the counts belong to
+    std::atomic<unsigned long> received;
+    std::atomic<unsigned long> lost;
+  };
+  void lastMinute(const MonotonicTime &now, unsigned long &received, unsigned long &lost) const;
+  static double lossRate(const unsigned long &received, const unsigned long &lost);
+
+  int64_t previous_firmware_time; // decode stage only, -1 after a resync
+  std::atomic<unsigned long> frames_received;
+  std::atomic<unsigned long> frames_lost;
+  std::atomic<int64_t> maximum_gap;
+  Second seconds[window]; // per second counts over the last minute, indexed by host time
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_FRAME_LOSS_MONITOR_HPP_ */
@@ -19,6 +19,10 @@
 
 #include <string>
 #include <iomanip>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <ecl/config.hpp>
 #include <ecl/threads.hpp>
 #include <ecl/devices.hpp>
@@ -26,9 +30,25 @@
 #include <ecl/exceptions/standard_exception.hpp>
 #include <ecl/geometry/legacy_pose2d.hpp>
 #include "version_info.hpp"
+#include "frame_info.hpp"
+#include "frame.hpp"
 #include "parameters.hpp"
 #include "event_manager.hpp"
+#include "callback_registry.hpp"
+#include "callback_worker_pool.hpp"
+#include "async_callback.hpp"
+#include "slot_monitor.hpp"
+#include "profiler.hpp"
 #include "command.hpp"
+#include "command_queue.hpp"
+#include "latency_histogram.hpp"
+#include "frame_loss_monitor.hpp"
+#include "spsc_ring.hpp"
+#include "seqlock.hpp"
+#include "frame_history.hpp"
+#include "field_watcher.hpp"
+#include "shared_frame_ring.hpp"
+#include "thread_interrupter.hpp"
 #include "modules.hpp"
 #include "packets.hpp"
 #include "packet_handler/packet_finder.hpp"
@@ -74,15 +94,29 @@ class PacketFinder : public PacketFinderBase
 public:
   virtual ~PacketFinder() {}
   bool checkSum();
+  unsigned int copyBuffer(unsigned char *bytes, const unsigned int &capacity) const;
 };
 
 /*****************************************************************************
  ** Interface [Kobuki]
  *****************************************************************************/
+/**
+ * @brief Typed counterparts of the driver's data sigslots (see CallbackRegistry).
+ *
+ * Each is called right after the sigslot of the same name.
+ */
+struct KobukiCallbacks {
+  CallbackRegistry<> stream_data, controller_info;
+  CallbackRegistry<const VersionInfo&> version_info;
+  CallbackRegistry<Command::Buffer&> raw_data_command;
+  CallbackRegistry<PacketFinder::BufferType&> raw_data_stream;
+  CallbackRegistry<const std::vector<short>&> raw_control_command; // don't call disable() from these
+};
+
 /**
  * @brief  The core kobuki driver class.
  *
- * This connects to the outside world via sigslots and get accessors.
+ * This connects to the outside world via sigslots, typed callbacks and get accessors.
  **/
 class kobuki_PUBLIC Kobuki
 {
@@ -93,18 +127,21 @@ public:
   /*********************
    ** Configuration
    **********************/
-  void init(Parameters &parameters) throw (ecl::StandardException);
+  void init(Parameters &parameters); // throws ecl::StandardException
   bool isAlive() const { return is_alive; } /**< Whether the connection to the robot is alive and currently streaming. **/
   bool isShutdown() const { return shutdown_requested; } /**< Whether the worker thread is alive or not. **/
   bool isEnabled() const { return is_enabled; } /**< Whether the motor power is enabled or disabled. **/
   bool enable(); /**< Enable power to the motors. **/
   bool disable(); /**< Disable power to the motors. **/
-  void shutdown() { shutdown_requested = true; } /**< Gently terminate the worker thread. **/
+  void shutdown();
+  void reconnect();
 
   /******************************************
   ** Packet Processing
   *******************************************/
   void spin();
+  void spinDecode();
+  void spinPublish();
   void fixPayload(ecl::PushAndPop<unsigned char> & byteStream);
 
   /******************************************
@@ -116,26 +153,50 @@ public:
   /******************************************
   ** Getters - User Friendly Api
   *******************************************/
-  /* Be sure to lock/unlock the data access (lockDataAccess and unlockDataAccess)
-   * around any getXXX calls - see the doxygen notes for lockDataAccess. */
+  /* Each getXXX call returns data from a single frame, but successive calls may
+   * straddle two frames - use getFrame() or lock/unlock the data access
+   * (lockDataAccess and unlockDataAccess) around them if that matters. */
   ecl::Angle<double> getHeading() const;
   double getAngularVelocity() const;
-  VersionInfo versionInfo() const { return VersionInfo(firmware.data.version, hardware.data.version, unique_device_id.data.udid0, unique_device_id.data.udid1, unique_device_id.data.udid2); }
-  Battery batteryStatus() const { return Battery(core_sensors.data.battery, core_sensors.data.charger); }
+  VersionInfo versionInfo() const;
+  Battery batteryStatus() const;
 
   /******************************************
   ** Getters - Raw Data Api
   *******************************************/
-  /* Be sure to lock/unlock the data access (lockDataAccess and unlockDataAccess)
-   * around any getXXX calls - see the doxygen notes for lockDataAccess. */
-  CoreSensors::Data getCoreSensorData() const { return core_sensors.data; }
-  DockIR::Data getDockIRData() const { return dock_ir.data; }
-  Cliff::Data getCliffData() const { return cliff.data; }
-  Current::Data getCurrentData() const { return current.data; }
-  Inertia::Data getInertiaData() const { return inertia.data; }
-  GpInput::Data getGpInputData() const { return gp_input.data; }
-  ThreeAxisGyro::Data getRawInertiaData() const { return three_axis_gyro.data; }
-  ControllerInfo::Data getControllerInfoData() const { return controller_info.data; }
+  /* As above. */
+  CoreSensors::Data getCoreSensorData() const { return snapshot().core_sensors; }
+  DockIR::Data getDockIRData() const;
+  Cliff::Data getCliffData() const;
+  Current::Data getCurrentData() const;
+  Inertia::Data getInertiaData() const { return snapshot().inertia; }
+  GpInput::Data getGpInputData() const;
+  ThreeAxisGyro::Data getRawInertiaData() const { return snapshot().three_axis_gyro; }
+  ControllerInfo::Data getControllerInfoData() const { return snapshot().controller_info; }
+  FrameInfo getFrameInfo() const { return snapshot().info; }
+  Frame getFrame() const { return snapshot(); }
+
+  /******************************************
+  ** Getters - Blocking
+  *******************************************/
+  bool waitForFrame(const uint64_t &last_sequence, const double &timeout, Frame &frame);
+
+  /******************************************
+  ** Getters - History
+  *******************************************/
+  const FrameHistory& history() const { return frame_history; } /**< The last few seconds of frames, queried by host time. **/
+
+  /******************************************
+  ** Getters - Field Subscriptions
+  *******************************************/
+  FieldWatcher& fieldWatcher() { return field_watcher; } /**< Block until a field changes or crosses a threshold, instead of polling. **/
+
+  /******************************************
+  ** Callbacks
+  *******************************************/
+  KobukiCallbacks& callbacks() { return kobuki_callbacks; } /**< Typed alternative to the data sigslots, connect without a namespace. **/
+  EventCallbacks& eventCallbacks() { return event_manager.callbacks(); } /**< Typed alternative to the event sigslots. **/
+  CallbackWorkerPool& callbackPool() { return callback_pool; } /**< Runs AsyncCallback's off the driver's threads, see Parameters::callback_threads. **/
 
   /*********************
   ** Feedback
@@ -144,6 +205,10 @@ public:
                            double &wheel_right_angle, double &wheel_right_angle_rate);
   void updateOdometry(ecl::LegacyPose2D<double> &pose_update,
                       ecl::linear_algebra::Vector3d &pose_update_rates);
+  void updateOdometry(ecl::LegacyPose2D<double> &pose_update,
+                      ecl::linear_algebra::Vector3d &pose_update_rates,
+                      FrameInfo &frame_info);
+  bool predictState(const MonotonicTime &time, StateExtrapolator::State &state) const { return state_extrapolator.predict(time, state); }
 
   /*********************
   ** Soft Commands
@@ -162,17 +227,49 @@ public:
                          const unsigned int &i_gain, const unsigned int &d_gain);
   bool getControllerGain();
 
+  /*********************
+  ** Transmit Statistics
+  **********************/
+  unsigned long commandOverflows() const { return command_queue.overflows(); } /**< One shot commands dropped because the transmit backlog was full. **/
+  unsigned long commandsSuperseded() const { return command_queue.superseded(); } /**< Velocity commands replaced by a newer one before they were sent. **/
+  const LatencyHistogram& baseControlLatency() const { return base_control_latency; } /**< Time from a frame's arrival to the write of the first velocity command after it. **/
+
+  /*********************
+  ** Receive Statistics
+  **********************/
+  unsigned long framesDropped() const { return frames_dropped.load(std::memory_order_relaxed); } /**< Frames dropped because a later stage of the receive pipeline fell behind. **/
+  const FrameLossMonitor& frameLoss() const { return frame_loss; } /**< Frames missing from the stream, wherever they were lost. **/
+
+  /*********************
+  ** Slot Timing
+  **********************/
+  const SlotMonitor& slotMonitor() const { return slot_monitor; } /**< Execution times of the slots connected to each of the driver's signals. **/
+
+  /*********************
+  ** Profiling
+  **********************/
+  Profiler& profiler() { return loop_profiler; } /**< Time spent in each stage of the driver's loops, switch it on and off at will. **/
+
   /*********************
   ** Debugging
   **********************/
   void printSigSlotConnections() const;
+  void enableRawSigslots(const bool &enable) { raw_sigslots.store(enable, std::memory_order_relaxed); } /**< Switch the raw data and serial debug sigslots on or off (see Parameters::enable_raw_sigslots). **/
+  bool rawSigslotsEnabled() const { return raw_sigslots.load(std::memory_order_relaxed); }
 
 private:
   /*********************
   ** Thread
   **********************/
   ecl::Thread thread;
-  bool shutdown_requested; // helper to shutdown the worker thread.
+  std::atomic<bool> shutdown_requested; // helper to shutdown the worker thread.
+  std::atomic<bool> reconnect_requested;
+  ThreadInterrupter io_interrupter; // knocks the worker thread out of a blocking read
+  std::mutex wake_mutex;
+  std::condition_variable wake_condition; // cuts short the worker thread's reconnection wait, signals its exit
+  bool io_running; // the worker thread is in spin()
+  ecl::Thread transmit_thread; // writes the queued commands, so the reading thread never waits on the serial port
+  ecl::Thread decode_thread, publish_thread; // only with the staged pipeline
 
   /*********************
   ** Odometry
@@ -183,7 +280,7 @@ private:
   /*********************
   ** Inertia
   **********************/
-  double heading_offset;
+  std::atomic<double> heading_offset; // set by the decode stage and resetOdometry(), read by getHeading()
 
   /*********************
   ** Driver Paramters
@@ -210,33 +307,82 @@ private:
   UniqueDeviceID unique_device_id; // requestable
   ThreeAxisGyro three_axis_gyro;
   ControllerInfo controller_info; // requestable
+  FirmwareClock firmware_clock; // maps firmware time stamps to host time
+  FrameLossMonitor frame_loss; // decode stage, counts the gaps in the firmware time stamps
+  int64_t odometry_firmware_time; // firmware time of the frame used for the last odometry update, -1 if none
 
   ecl::Serial serial;
   PacketFinder packet_finder;
-  PacketFinder::BufferType data_buffer;
+  PacketFinder::BufferType raw_buffer; // the whole frame, for the raw data stream
+  PacketFinder::BufferType data_buffer; // the frame's payload, consumed as it is decoded
   bool is_alive; // used as a flag set by the data stream watchdog
 
-  int version_info_reminder;
-  int controller_info_reminder;
+  // set by the io stage on (re)connecting, cleared by the decode stage, read when sending the cycle's commands
+  std::atomic<int> version_info_reminder;
+  std::atomic<int> controller_info_reminder;
+
+  /*********************
+  ** Receive Pipeline
+  **********************/
+  // io (spin) -> raw_frames -> decode (spinDecode) -> frames -> publish (spinPublish)
+  // Without the staged pipeline the io thread runs all three in turn.
+  void decodeFrame(const RawFrame &raw_frame);
+  void publishFrame(const Frame &frame);
+  void configureThread(const std::string &name, const int &cpu);
+  SpscRing<RawFrame> raw_frames;
+  SpscRing<Frame> frames;
+  bool resync_pending; // io stage only, the next frame follows a loss of connection
+  std::atomic<unsigned long> frames_dropped;
+  Seqlock<Frame> published_frame; // what the getters see, written by the publish stage only
+  Frame snapshot() const;
+  Frame locked_frame; // what the getters see while lockDataAccess() is in effect
+  FrameHistory frame_history; // written by the publish stage only
+  StateExtrapolator state_extrapolator; // updated by the publish stage only
+  FieldWatcher field_watcher; // checked by the decode stage
+  SharedFrameWriter shared_frames; // written by the publish stage only, open if parameters.shared_memory_name is set
+  std::atomic<std::thread::id> data_access_holder; // the thread that called lockDataAccess(), if any
+  uint64_t decoded_frames; // decode stage only
+  std::atomic<uint64_t> published_sequence;
+  std::mutex frame_wait_mutex;
+  std::condition_variable frame_wait_condition; // wakes waitForFrame() callers
 
   /*********************
   ** Commands
   **********************/
   void sendBaseControlCommand();
+  void sendCycleCommands();
   void sendCommand(Command command);
-  ecl::Mutex command_mutex; // protection against the user calling the command functions from multiple threads
-  // data_mutex is protection against reading and writing data structures simultaneously as well as
-  // ensuring multiple get*** calls are synchronised to the same data update
-  // refer to https://github.com/yujinrobot/kobuki/issues/240
+  void requestTransmit();
+  void transmit();
+  void writeCommands();
+  void finaliseCommandFrame();
+  CommandQueue command_queue; // lock free, so the user can call the command functions from any thread without blocking
+  std::mutex transmit_mutex;
+  std::condition_variable transmit_condition; // wakes the transmit thread once per cycle
+  bool transmit_requested, transmit_shutdown_requested;
+  std::atomic<MonotonicTime> last_frame_time; // receive time of the newest decoded frame
+  MonotonicTime last_measured_frame_time; // transmit thread only, the frame the last latency sample refers to
+  LatencyHistogram base_control_latency;
+  // data_mutex serialises the users of lockDataAccess(), which pins a snapshot (locked_frame) so
+  // that multiple get*** calls are synchronised to the same data update; the getters themselves
+  // are lock free. refer to https://github.com/yujinrobot/kobuki/issues/240
   ecl::Mutex data_mutex;
   Command kobuki_command; // used to maintain some state about the command history
   Command::Buffer command_buffer;
-  std::vector<short> velocity_commands_debug;
+  Command::Buffer sub_payload_buffer; // scratch space for serialising a single command
+  Command pending_command; // scratch space for the command being pulled off the queue
+  std::vector<unsigned char> outgoing_bytes; // all frames of a cycle, handed to the serial port in one write
+  std::vector<short> velocity_commands_debug; // sized once, refilled in place
+  // sendBaseControlCommand() runs on the stage that owns base control and from disable() on the
+  // user's thread, this keeps the acceleration limiter and velocity_commands_debug to one at a time
+  std::mutex base_control_mutex;
 
   /*********************
   ** Events
   **********************/
   EventManager event_manager;
+  SlotMonitor slot_monitor;
+  Profiler loop_profiler;
 
   /*********************
   ** Logging
@@ -261,6 +407,14 @@ private:
   ecl::Signal<Command::Buffer&> sig_raw_data_command; // should be const, but pushnpop is not fully realised yet for const args in the formatters.
   ecl::Signal<PacketFinder::BufferType&> sig_raw_data_stream; // should be const, but pushnpop is not fully realised yet for const args in the formatters.
   ecl::Signal<const std::vector<short>&> sig_raw_control_command;
+  KobukiCallbacks kobuki_callbacks;
+  CallbackWorkerPool callback_pool;
+
+  // Whether anyone takes the raw and debug outputs, checked before building their payloads.
+  // ecl does not tell who is connected to a sigslot, so those are switched on explicitly.
+  std::atomic<bool> raw_sigslots;
+  template <typename Registry>
+  bool wanted(const Registry &callbacks) const { return raw_sigslots.load(std::memory_order_relaxed) || !callbacks.empty(); }
 };
 
 } // namespace kobuki
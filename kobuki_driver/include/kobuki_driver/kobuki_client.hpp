@@ -0,0 +1,178 @@
+/**
+ * @file include/kobuki_driver/kobuki_client.hpp
+ *
+ * @brief Drives a kobuki shared through a KobukiServer.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_CLIENT_HPP_
+#define KOBUKI_CLIENT_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <stdint.h>
+#include <ecl/threads.hpp>
+#include <ecl/geometry/angle.hpp>
+#include <ecl/geometry/legacy_pose2d.hpp>
+#include <ecl/linear_algebra.hpp>
+#include "frame.hpp"
+#include "seqlock.hpp"
+#include "server_protocol.hpp"
+#include "version_info.hpp"
+#include "modules.hpp"
+#include "packets.hpp"
+#include "macros.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief The Kobuki api, for a robot owned by a KobukiServer in another process (posix only).
+ *
+ * The getters, odometry and commands work as they do on Kobuki, with frames
+ * received from the server rather than the serial port. Each client keeps its
+ * own odometry and heading offset, so resetting them does not disturb the
+ * other clients.
+ *
+ * Velocities compete with those of the other clients: the base follows the
+ * client with the highest priority that keeps its velocity up (call
+ * setBaseControl() at your control rate, at least every few hundred
+ * milliseconds, see KobukiServer). inControl() tells whether this client
+ * currently has the base. The other commands act immediately.
+ *
+ * There are no sigslots; follow the stream with waitForFrame().
+ *
+ * @code
+ * kobuki::KobukiClient kobuki;
+ * std::string error;
+ * if ( !kobuki.connect("/tmp/kobuki.sock", error, 10, "teleop") ) { ... }
+ * kobuki::Frame frame;
+ * uint64_t sequence = 0;
+ * while ( kobuki.waitForFrame(sequence, 1.0, frame) ) {
+ *   sequence = frame.info.sequence;
+ *   kobuki.setBaseControl(0.1, 0.0);
+ * }
+ * @endcode
+ */
+class kobuki_PUBLIC KobukiClient {
+public:
+  KobukiClient();
+  ~KobukiClient();
+
+  /*********************
+   ** Configuration
+   **********************/
+  bool connect(const std::string &socket_path, std::string &error,
+               const unsigned char &priority = 0, const std::string &name = "");
+  void disconnect();
+  bool isConnected() const { return connected; } /**< Whether the server is (still) there. **/
+  bool isAlive() const { return (flags.load(std::memory_order_relaxed) & protocol::RobotAlive) != 0; } /**< Whether the server's connection to the robot is alive and streaming. **/
+  bool isEnabled() const { return (flags.load(std::memory_order_relaxed) & protocol::MotorsEnabled) != 0; } /**< Whether the motor power is enabled or disabled. **/
+  bool inControl() const { return (flags.load(std::memory_order_relaxed) & protocol::InControl) != 0; } /**< Whether this client's velocity is the one being sent to the base. **/
+  bool enable(); /**< Enable power to the motors (for all clients). **/
+  bool disable(); /**< Disable power to the motors (for all clients). **/
+
+  /******************************************
+  ** Getters - User Friendly Api
+  *******************************************/
+  ecl::Angle<double> getHeading() const;
+  double getAngularVelocity() const;
+  VersionInfo versionInfo() const;
+  Battery batteryStatus() const;
+
+  /******************************************
+  ** Getters - Raw Data Api
+  *******************************************/
+  CoreSensors::Data getCoreSensorData() const { return published_frame.load().core_sensors; }
+  DockIR::Data getDockIRData() const;
+  Cliff::Data getCliffData() const;
+  Current::Data getCurrentData() const;
+  Inertia::Data getInertiaData() const { return published_frame.load().inertia; }
+  GpInput::Data getGpInputData() const;
+  ThreeAxisGyro::Data getRawInertiaData() const { return published_frame.load().three_axis_gyro; }
+  ControllerInfo::Data getControllerInfoData() const { return published_frame.load().controller_info; }
+  FrameInfo getFrameInfo() const { return published_frame.load().info; }
+  Frame getFrame() const { return published_frame.load(); }
+
+  /******************************************
+  ** Getters - Blocking
+  *******************************************/
+  bool waitForFrame(const uint64_t &last_sequence, const double &timeout, Frame &frame);
+
+  /*********************
+  ** Feedback
+  **********************/
+  void getWheelJointStates(double &wheel_left_angle, double &wheel_left_angle_rate,
+                           double &wheel_right_angle, double &wheel_right_angle_rate);
+  void updateOdometry(ecl::LegacyPose2D<double> &pose_update,
+                      ecl::linear_algebra::Vector3d &pose_update_rates);
+  void updateOdometry(ecl::LegacyPose2D<double> &pose_update,
+                      ecl::linear_algebra::Vector3d &pose_update_rates,
+                      FrameInfo &frame_info);
+
+  /*********************
+  ** Soft Commands
+  **********************/
+  void resetOdometry();
+
+  /*********************
+  ** Hard Commands
+  **********************/
+  void setBaseControl(const double &linear_velocity, const double &angular_velocity);
+  void releaseBaseControl();
+  void setLed(const enum LedNumber &number, const enum LedColour &colour);
+  void setDigitalOutput(const DigitalOutput &digital_output);
+  void setExternalPower(const DigitalOutput &digital_output);
+  void playSoundSequence(const enum SoundSequences &number);
+  bool setControllerGain(const unsigned char &type, const unsigned int &p_gain,
+                         const unsigned int &i_gain, const unsigned int &d_gain);
+  bool getControllerGain();
+
+private:
+  KobukiClient(const KobukiClient&); // non-copyable
+  KobukiClient& operator=(const KobukiClient&);
+
+  void receive();
+  bool process();
+  bool send(const protocol::MessageType &type, const void *body = NULL, const unsigned int &length = 0);
+
+  int connection; // the socket to the server
+  std::atomic<bool> connected;
+  ecl::Thread thread; // receives the frames
+  std::mutex send_mutex;
+
+  // written by the receiving thread only
+  protocol::MessageStream stream;
+  Frame received_frame;
+  Seqlock<Frame> published_frame;
+  std::atomic<uint8_t> flags; // protocol::FrameFlags of the last frame
+  std::atomic<uint64_t> published_sequence;
+  std::mutex frame_wait_mutex;
+  std::condition_variable frame_wait_condition;
+
+  // odometry, as in Kobuki
+  DiffDrive diff_drive;
+  double heading_offset;
+  int64_t odometry_firmware_time;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_CLIENT_HPP_ */
@@ -0,0 +1,109 @@
+/**
+ * @file include/kobuki_driver/kobuki_server.hpp
+ *
+ * @brief Shares one driver between several processes over unix domain sockets.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_SERVER_HPP_
+#define KOBUKI_SERVER_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <ecl/threads.hpp>
+#include "kobuki.hpp"
+#include "server_protocol.hpp"
+#include "macros.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief Serves a driver's frames and commands to KobukiClient's (posix only).
+ *
+ * Only one process can own the serial port. The server runs alongside the
+ * driver in that process, listens on a unix domain socket and sends every
+ * frame the driver publishes to every connected client (see
+ * server_protocol.hpp), so that several processes share the one serial
+ * stack.
+ *
+ * Velocity commands are arbitrated: each client connects with a priority and
+ * the base follows the highest priority client with a recent command (ties
+ * go to the most recent). A client's command lapses if it is not renewed
+ * within the command timeout, which hands the base back to the next client
+ * down, or stops it if there is none. All other commands (leds, outputs,
+ * sounds, gains, motor power) are passed straight on to the driver.
+ *
+ * A client that cannot keep up does not hold the others up; frames that do
+ * not fit in its socket are dropped for it and counted.
+ *
+ * @code
+ * kobuki::Kobuki kobuki;
+ * kobuki.init(parameters);
+ * kobuki::KobukiServer server(kobuki);
+ * std::string error;
+ * if ( !server.start("/tmp/kobuki.sock", error) ) { ... }
+ * @endcode
+ */
+class kobuki_PUBLIC KobukiServer {
+public:
+  KobukiServer(Kobuki &kobuki);
+  ~KobukiServer();
+
+  bool start(const std::string &socket_path, std::string &error, const double &command_timeout = 0.5);
+  void stop();
+  bool isRunning() const { return running; }
+
+  unsigned int clients() const;
+  unsigned long framesDropped() const { return frames_dropped.load(std::memory_order_relaxed); } /**< @brief Frames not sent to clients that fell behind. **/
+
+private:
+  KobukiServer(const KobukiServer&); // non-copyable
+  KobukiServer& operator=(const KobukiServer&);
+
+  struct Connection; // see kobuki_server.cpp
+
+  void serve();
+  void broadcast();
+  void accept();
+  bool receive(Connection &connection);
+  bool handle(Connection &connection, const protocol::MessageHeader &header, const unsigned char *body);
+  bool send(Connection &connection, const unsigned char *bytes, const unsigned int &size);
+  void disconnect(const std::size_t &index);
+  void arbitrate(const MonotonicTime &now);
+
+  Kobuki &kobuki;
+  std::string socket_path;
+  MonotonicTime command_timeout;
+  int listener;
+  int wake_pipe[2]; // knocks serve() out of poll() on stop()
+  std::atomic<bool> running;
+  std::atomic<bool> shutdown_requested;
+  ecl::Thread serve_thread, broadcast_thread;
+  std::atomic<unsigned long> frames_dropped;
+
+  mutable std::mutex connections_mutex; // guards everything below
+  std::vector<Connection*> connections;
+  Connection *base_controller; // the client whose velocity is in effect, if any
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_SERVER_HPP_ */
@@ -0,0 +1,71 @@
+/**
+ * @file include/kobuki_driver/latency_histogram.hpp
+ *
+ * @brief Lock free latency histogram for the driver's timing statistics.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_LATENCY_HISTOGRAM_HPP_
+#define KOBUKI_LATENCY_HISTOGRAM_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <string>
+#include "frame_info.hpp"
+#include "macros.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief Histogram of latencies with power of two microsecond buckets.
+ *
+ * Bucket 0 counts latencies under 1us, bucket i (i > 0) those in
+ * [2^(i-1), 2^i) us and the last bucket everything beyond. Any number of
+ * threads may add samples and read at once; all counters are relaxed atomics,
+ * so a reader may see a sample in the count before it shows in the buckets.
+ */
+class kobuki_PUBLIC LatencyHistogram {
+public:
+  static const unsigned int number_of_buckets = 24; /**< @brief The last one starts at ~4s. **/
+
+  LatencyHistogram() { reset(); }
+
+  void add(const MonotonicTime &latency);
+  void reset();
+
+  unsigned long count() const { return sample_count.load(std::memory_order_relaxed); }
+  unsigned long bucket(const unsigned int &i) const { return buckets[i].load(std::memory_order_relaxed); }
+  MonotonicTime maximum() const { return maximum_latency.load(std::memory_order_relaxed); } /**< @brief Worst latency [ns]. **/
+  MonotonicTime mean() const; /**< @brief Mean latency [ns]. **/
+  MonotonicTime percentile(const double &fraction) const;
+  static MonotonicTime bucketUpperBound(const unsigned int &i);
+  std::string toString() const;
+
+private:
+  LatencyHistogram(const LatencyHistogram&); // non-copyable
+  LatencyHistogram& operator=(const LatencyHistogram&);
+
+  std::atomic<unsigned long> buckets[number_of_buckets];
+  std::atomic<unsigned long> sample_count;
+  std::atomic<MonotonicTime> total_latency;
+  std::atomic<MonotonicTime> maximum_latency;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_LATENCY_HISTOGRAM_HPP_ */
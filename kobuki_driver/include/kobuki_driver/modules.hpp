@@ -23,5 +23,7 @@
 #include "modules/diff_drive.hpp"
 #include "modules/sound.hpp"
 #include "modules/acceleration_limiter.hpp"
+#include "modules/firmware_clock.hpp"
+#include "modules/state_extrapolator.hpp"
 
 #endif /* KOBUKI_MODULES_HPP_ */
@@ -23,6 +23,7 @@
 #include <iostream>
 #include <stdint.h>
 #include <ecl/time.hpp>
+#include "../velocity_mailbox.hpp"
 
 /*****************************************************************************
 ** Namespaces
@@ -52,7 +53,9 @@ public:
   AccelerationLimiter() :
     is_enabled(true),
     last_speed(0),
-    last_timestamp(ecl::TimeStamp())
+    last_timestamp(ecl::TimeStamp()),
+    last_vx(0.0),
+    last_wz(0.0)
   {}
   void init(bool enable_acceleration_limiter
     , double linear_acceleration_max_= 0.5, double angular_acceleration_max_= 3.5
@@ -78,48 +81,62 @@ public:
 
   std::vector<double> limit(const double &vx, const double &wz)
   {
-    if( is_enabled ) {
-      //get current time
-      ecl::TimeStamp curr_timestamp;
-      //get time difference
-      ecl::TimeStamp duration = curr_timestamp - last_timestamp;
-      //calculate acceleration
-      double linear_acceleration = ((double)(vx - last_vx)) / duration; // in [m/s^2]
-      double angular_acceleration = ((double)(wz - last_wz)) / duration; // in [rad/s^2]
-
-      //std::ostringstream oss;
-      //oss << std::fixed << std::setprecision(4);
-      //oss << "[" << std::setw(6) << (double)duration << "]";
-      //oss << "[" << std::setw(6) << last_vx << ", " << std::setw(6) << last_wz << "]";
-      //oss << "[" << std::setw(6) << vx << ", " << std::setw(6) << wz << "]";
-      //oss << "[" << std::setw(6) << linear_acceleration << ", " << std::setw(6) << angular_acceleration << "]";
-
-      if( linear_acceleration > linear_acceleration_max )
-        command_vx = last_vx + linear_acceleration_max * duration;
-      else if( linear_acceleration < linear_deceleration_max )
-        command_vx = last_vx + linear_deceleration_max * duration;
-      else
-        command_vx = vx;
-      last_vx = command_vx;
-
-      if( angular_acceleration > angular_acceleration_max )
-        command_wz = last_wz + angular_acceleration_max * duration;
-      else if( angular_acceleration < angular_deceleration_max )
-        command_wz = last_wz + angular_deceleration_max * duration;
-      else
-        command_wz = wz;
-      last_wz = command_wz;
-
-      last_timestamp = curr_timestamp;
-
-      //oss << "[" << std::setw(6) << command_vx << ", " << std::setw(6) << command_wz << "]";
-      //std::cout << oss.str() << std::endl;
-
-      std::vector<double> ret_val;
-      ret_val.push_back(command_vx);
-      ret_val.push_back(command_wz);
-      return ret_val;
+    double command_vx, command_wz;
+    limit(vx, wz, command_vx, command_wz);
+    std::vector<double> ret_val;
+    ret_val.push_back(command_vx);
+    ret_val.push_back(command_wz);
+    return ret_val;
+  }
+
+  /**
+   * @brief Limits a velocity command without allocating, keeping its time stamp.
+   */
+  VelocityCommand limit(const VelocityCommand &command)
+  {
+    VelocityCommand limited = command;
+    limit(command.linear, command.angular, limited.linear, limited.angular);
+    return limited;
+  }
+
+  /**
+   * @brief Limits the input velocity commands if gatekeeper is enabled (passes them through if not).
+   *
+   * @param vx, wz : the commanded velocities [m/s], [rad/s].
+   * @param command_vx, command_wz : the limited velocities [m/s], [rad/s].
+   */
+  void limit(const double &vx, const double &wz, double &command_vx, double &command_wz)
+  {
+    if( !is_enabled ) {
+      command_vx = vx;
+      command_wz = wz;
+      return;
     }
+    //get current time
+    ecl::TimeStamp curr_timestamp;
+    //get time difference
+    ecl::TimeStamp duration = curr_timestamp - last_timestamp;
+    //calculate acceleration
+    double linear_acceleration = ((double)(vx - last_vx)) / duration; // in [m/s^2]
+    double angular_acceleration = ((double)(wz - last_wz)) / duration; // in [rad/s^2]
+
+    if( linear_acceleration > linear_acceleration_max )
+      command_vx = last_vx + linear_acceleration_max * duration;
+    else if( linear_acceleration < linear_deceleration_max )
+      command_vx = last_vx + linear_deceleration_max * duration;
+    else
+      command_vx = vx;
+    last_vx = command_vx;
+
+    if( angular_acceleration > angular_acceleration_max )
+      command_wz = last_wz + angular_acceleration_max * duration;
+    else if( angular_acceleration < angular_deceleration_max )
+      command_wz = last_wz + angular_deceleration_max * duration;
+    else
+      command_wz = wz;
+    last_wz = command_wz;
+
+    last_timestamp = curr_timestamp;
   }
 
 private:
@@ -130,7 +147,6 @@ private:
   ecl::TimeStamp last_timestamp;
 
   double last_vx, last_wz; // In [m/s] and [rad/s]
-  double command_vx, command_wz; // In [m/s] and [rad/s]
   double linear_acceleration_max, linear_deceleration_max; // In [m/s^2]
   double angular_acceleration_max, angular_deceleration_max; // In [rad/s^2]
 };
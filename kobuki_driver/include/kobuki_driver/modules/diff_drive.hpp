@@ -23,6 +23,7 @@
 #include <ecl/geometry/legacy_pose2d.hpp>
 #include <ecl/mobile_robot.hpp>
 #include <ecl/threads/mutex.hpp>
+#include "../velocity_mailbox.hpp"
 #include "../macros.hpp"
 
 /*****************************************************************************
@@ -47,6 +48,8 @@ public:
   void reset();
   void getWheelJointStates(double &wheel_left_angle, double &wheel_left_angle_rate,
                            double &wheel_right_angle, double &wheel_right_angle_rate);
+  void getWheelAngles(const uint16_t &left_encoder, const uint16_t &right_encoder,
+                      double &wheel_left_angle, double &wheel_right_angle);
   void setVelocityCommands(const double &vx, const double &wz);
   void velocityCommands(const double &vx, const double &wz);
   void velocityCommands(const short &cmd_speed, const short &cmd_radius);
@@ -56,8 +59,10 @@ public:
   /*********************
   ** Command Accessors
   **********************/
+  VelocityCommand velocityCommand() const { return velocity_command.latest(); } // the latest setVelocityCommands(), lock free
+  void getVelocityCommands(short &cmd_speed, short &cmd_radius); // in [mm/s] and [mm]
   std::vector<short> velocityCommands(); // (speed, radius), in [mm/s] and [mm]
-  std::vector<double> pointVelocity() const; // (vx, wz), in [m/s] and [rad/s]
+  std::vector<double> pointVelocity() const; // (vx, wz), in [m/s] and [rad/s], allocates - prefer velocityCommand()
 
   /*********************
   ** Property Accessors
@@ -70,10 +75,11 @@ private:
   double last_diff_time;
 
   unsigned short last_tick_left, last_tick_right;
+  bool has_ticks; // update() has been called, the last ticks are real readings
   double last_rad_left, last_rad_right;
 
   //double v, w; // in [m/s] and [rad/s]
-  std::vector<double> point_velocity; // (vx, wz), in [m/s] and [rad/s]
+  VelocityMailbox velocity_command; // (vx, wz), in [m/s] and [rad/s]
   double radius; // in [mm]
   double speed;  // in [mm/s]
   double bias; //wheelbase, wheel_to_wheel, in [m]
@@ -0,0 +1,90 @@
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/firmware_clock.hpp
+ *
+ * @brief Maps the firmware's millisecond time stamps onto host monotonic time.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_FIRMWARE_CLOCK_HPP_
+#define KOBUKI_FIRMWARE_CLOCK_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <vector>
+#include <stdint.h>
+#include "../frame_info.hpp"
+#include "../macros.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Online estimator for the firmware to host clock mapping.
+ *
+ * The core sensors time stamp is a 16 bit millisecond counter that wraps every
+ * 65.536s. This unwraps it into a 64 bit firmware time and estimates the host
+ * monotonic time at which each frame was actually generated.
+ *
+ * Every frame gives an offset sample (host receive time - firmware time) that
+ * is the true clock offset plus a non-negative delivery delay. The estimator
+ * keeps the minimum sample of each block of frames (the one least disturbed by
+ * usb latency) and fits a line through the recent block minima to track the
+ * drift between the two oscillators. The result is a low jitter host time stamp
+ * that ignores usb delivery spikes.
+ */
+class kobuki_PUBLIC FirmwareClock {
+public:
+  FirmwareClock(const unsigned int &block_size = 50, const unsigned int &max_blocks = 30);
+
+  void reset();
+  MonotonicTime update(const uint16_t &time_stamp, const MonotonicTime &receive_time);
+
+  bool isInitialised() const { return initialised; } /**< Whether a time stamp has been seen since the last reset. **/
+  bool isSynchronised() const { return number_of_blocks > 1; } /**< Whether the drift estimate is available yet. **/
+  int64_t firmwareTime() const { return firmware_time; } /**< Unwrapped firmware time of the last update [ms]. **/
+  MonotonicTime hostTime(const int64_t &firmware_time) const;
+  double drift() const { return fit_drift * 1.0e-6; } /**< Estimated host clock drift relative to firmware [s/s]. **/
+
+private:
+  struct Sample {
+    int64_t firmware_time; // [ms]
+    MonotonicTime offset;  // host - firmware [ns]
+  };
+
+  void fit();
+
+  const unsigned int block_size;
+  const unsigned int max_blocks;
+
+  bool initialised;
+  uint16_t last_time_stamp;
+  MonotonicTime last_receive_time;
+  int64_t firmware_time;
+
+  Sample block_minimum;
+  unsigned int block_count;
+  std::vector<Sample> blocks; // ring buffer of block minima
+  unsigned int oldest_block, number_of_blocks;
+
+  int64_t fit_reference; // firmware time the fit is centred on [ms]
+  double fit_offset;     // offset at the reference [ns]
+  double fit_drift;      // offset change per firmware millisecond [ns/ms]
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_FIRMWARE_CLOCK_HPP_ */
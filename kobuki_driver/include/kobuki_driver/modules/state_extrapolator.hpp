@@ -0,0 +1,115 @@
+/**
+ * @file /kobuki_driver/include/kobuki_driver/modules/state_extrapolator.hpp
+ *
+ * @brief Predicts the robot's state between (and just beyond) frames.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_STATE_EXTRAPOLATOR_HPP_
+#define KOBUKI_STATE_EXTRAPOLATOR_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <stdint.h>
+#include "../frame.hpp"
+#include "../seqlock.hpp"
+#include "../macros.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Enums
+*****************************************************************************/
+
+enum ExtrapolationModel {
+  ConstantVelocityModel,     /**< @brief Rates held at those over the last frame. **/
+  ConstantAccelerationModel  /**< @brief Rates ramped on with the change over the last two frames. **/
+};
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief Estimates pose, heading and wheel joint states at any time.
+ *
+ * Frames arrive at 50Hz; controllers often run much faster. Each frame
+ * anchors the state (pose integrated from the encoders and the gyro heading,
+ * wheel angles taken from DiffDrive so they match getWheelJointStates) at the
+ * host time the firmware stamped it, with rates taken over the firmware time
+ * between frames. A prediction runs the model on from the anchor to the time queried,
+ * which costs the same however far out it goes.
+ *
+ * One thread updates (the driver's publish stage), any thread predicts. The
+ * anchor is sequence locked, so predictions take no lock and never hold up
+ * the updates.
+ */
+class kobuki_PUBLIC StateExtrapolator {
+public:
+  /**
+   * @brief Predicted state.
+   */
+  struct State {
+    MonotonicTime time;            /**< @brief Time predicted for. **/
+    double x, y;                   /**< @brief Position since the last reset [m]. **/
+    double heading;                /**< @brief Gyro heading since the last reset [rad], in (-pi, pi]. **/
+    double linear_velocity;        /**< @brief [m/s] **/
+    double angular_velocity;       /**< @brief [rad/s] **/
+    double wheel_left_angle;       /**< @brief [rad] **/
+    double wheel_left_angle_rate;  /**< @brief [rad/s] **/
+    double wheel_right_angle;      /**< @brief [rad] **/
+    double wheel_right_angle_rate; /**< @brief [rad/s] **/
+    double horizon;                /**< @brief How far the prediction is from the newest frame [s], negative if before it. **/
+  };
+
+  StateExtrapolator(const double &wheel_bias = 0.23, const double &wheel_radius = 0.035,
+                    const double &tick_to_rad = 0.002436916871363930187454);
+
+  void configure(const ExtrapolationModel &model, const double &maximum_horizon);
+  void update(const Frame &frame, const double &wheel_left_angle, const double &wheel_right_angle);
+  void reset() { reset_requested.store(true, std::memory_order_release); }
+  bool predict(const MonotonicTime &time, State &state) const;
+
+private:
+  StateExtrapolator(const StateExtrapolator&); // non-copyable
+  StateExtrapolator& operator=(const StateExtrapolator&);
+
+  struct Anchor {
+    bool valid;
+    MonotonicTime time;
+    double x, y, heading;
+    double wheel_left_angle, wheel_right_angle;
+    double wheel_left_rate, wheel_right_rate;               // [rad/s]
+    double wheel_left_acceleration, wheel_right_acceleration; // [rad/s^2]
+    double angular_velocity, angular_acceleration;
+  };
+
+  const double wheel_bias, wheel_radius, tick_to_rad;
+  std::atomic<int> model;
+  std::atomic<MonotonicTime> maximum_horizon; // [ns]
+  std::atomic<bool> reset_requested;
+  Seqlock<Anchor> published_anchor;
+
+  // updating thread only
+  Anchor anchor;
+  bool initialised;
+  int64_t last_firmware_time;
+  uint16_t last_left_encoder, last_right_encoder;
+  int16_t last_angle;
+  double gyro_heading, heading_offset; // unwrapped [rad]
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_STATE_EXTRAPOLATOR_HPP_ */
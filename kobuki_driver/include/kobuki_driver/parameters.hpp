@@ -19,6 +19,8 @@
 
 #include <string>
 #include "modules/battery.hpp"
+#include "scheduling.hpp"
+#include "modules/state_extrapolator.hpp"
 
 /*****************************************************************************
  ** Namespaces
@@ -27,6 +29,19 @@
 namespace kobuki
 {
 
+/*****************************************************************************
+ ** Enums
+ *****************************************************************************/
+/**
+ * @brief When the velocity command goes out relative to the incoming frames.
+ */
+enum BaseControlTiming
+{
+  BaseControlAfterCallbacks = 0, /**< @brief Once per frame, after the stream_data slots have run (the original behaviour). **/
+  BaseControlAfterDecode,        /**< @brief Once per frame, as soon as it is decoded, before any slots run. **/
+  BaseControlFixedRate           /**< @brief On a timer of its own (base_control_period), independent of the frames. **/
+};
+
 /*****************************************************************************
  ** Interface
  *****************************************************************************/
@@ -47,7 +62,28 @@ public:
     linear_acceleration_limit(0.3),
     linear_deceleration_limit(-0.3*1.2),
     angular_acceleration_limit(3.5),
-    angular_deceleration_limit(-3.5*1.2)
+    angular_deceleration_limit(-3.5*1.2),
+    enable_staged_pipeline(false),
+    io_stage_cpu(-1),
+    decode_stage_cpu(-1),
+    publish_stage_cpu(-1),
+    scheduling_policy(DefaultScheduling),
+    scheduling_priority(0),
+    cpu_affinity_mask(0),
+    lock_memory(false),
+    prefault_stack_size(0),
+    base_control_timing(BaseControlAfterCallbacks),
+    base_control_period(0.02),
+    slot_budget(0.002),
+    enable_raw_sigslots(true),
+    callback_threads(0),
+    enable_single_events(true),
+    enable_profiler(false),
+    history_size(512),
+    extrapolation_model(ConstantVelocityModel),
+    extrapolation_horizon(0.1),
+    shared_memory_name(""),
+    shared_memory_frames(256)
   {
   } /**< @brief Default constructor. **/
 
@@ -64,6 +100,30 @@ public:
   double angular_acceleration_limit;
   double angular_deceleration_limit;
 
+  bool enable_staged_pipeline;     /**< @brief Read, decode and publish incoming frames in three separate threads [false] **/
+  int io_stage_cpu;                /**< @brief Pin the serial reading thread to this cpu, -1 to leave it to the os [-1] **/
+  int decode_stage_cpu;            /**< @brief Pin the decoding thread to this cpu (staged pipeline only), -1 to leave it to the os [-1] **/
+  int publish_stage_cpu;           /**< @brief Pin the publishing thread to this cpu (staged pipeline only), -1 to leave it to the os [-1] **/
+
+  SchedulingPolicy scheduling_policy; /**< @brief Scheduling policy of the driver's threads, needs privileges for the real time ones [DefaultScheduling] **/
+  int scheduling_priority;         /**< @brief Real time priority of the driver's threads, clamped to what the policy allows (1-99 on linux) [0] **/
+  unsigned long long cpu_affinity_mask; /**< @brief Cpus the driver's threads may run on (bit i for cpu i), the *_stage_cpu pins take precedence, 0 to leave it to the os [0] **/
+  bool lock_memory;                /**< @brief Lock the whole process in ram (mlockall) so the driver never waits on paging [false] **/
+  unsigned int prefault_stack_size;/**< @brief Bytes of stack each driver thread touches before entering its loop, at most maximumPrefaultStackSize() [0] **/
+
+  BaseControlTiming base_control_timing; /**< @brief When to send the velocity command, the staged pipeline always sends it after decoding unless on a fixed rate [BaseControlAfterCallbacks] **/
+  double base_control_period;      /**< @brief Period of the velocity command with BaseControlFixedRate [0.02s] **/
+  double slot_budget;              /**< @brief Warn when the slots of a signal take longer than this, 0 to never warn [0.002s] **/
+  bool enable_raw_sigslots;        /**< @brief Emit the raw_data_stream, raw_data_command, raw_control_command and per read ros_named debug sigslots, which copy and format on every frame. Switch off if nothing connects to them (the driver cannot see sigslot subscribers); the typed callbacks are served regardless [true] **/
+  unsigned int callback_threads;   /**< @brief Worker threads for the callbacks connected through an AsyncCallback (Kobuki::callbackPool()), 0 for none [0] **/
+  bool enable_single_events;       /**< @brief Signal each changed bit (button_event, bumper_event, ...) on its own as well as in the per frame event_batch; the coroutines need them [true] **/
+  bool enable_profiler;            /**< @brief Start with the hot loop profiler running, it can be switched on and off later through Kobuki::profiler() [false] **/
+  unsigned int history_size;       /**< @brief Frames kept for Kobuki::history() queries, rounded up to a power of two, 0 to keep none [512 ~ 10s] **/
+  ExtrapolationModel extrapolation_model; /**< @brief Motion model of Kobuki::predictState() [ConstantVelocityModel] **/
+  double extrapolation_horizon;    /**< @brief Kobuki::predictState() predicts no further than this from the newest frame [0.1s] **/
+  std::string shared_memory_name;  /**< @brief Also publish frames to other processes through this posix shared memory (see SharedFrameReader), empty to not ["", e.g. "/kobuki_frames"] **/
+  unsigned int shared_memory_frames; /**< @brief Frames in the shared memory ring, rounded up to a power of two [256 ~ 5s] **/
+
   /**
    * @brief A validator to ensure the user has supplied correct/sensible parameter values.
    *
@@ -73,7 +133,22 @@ public:
    */
   bool validate()
   {
-    // not doing anything right now -  delete it, if we can find a use case ...
+    if ( base_control_timing == BaseControlFixedRate && !(base_control_period > 0.0) ) {
+      error_msg = "base_control_period must be positive for fixed rate base control";
+      return false;
+    }
+    if ( prefault_stack_size > maximumPrefaultStackSize() ) {
+      error_msg = "prefault_stack_size is larger than the stack limit allows";
+      return false;
+    }
+    if ( extrapolation_horizon < 0.0 ) {
+      error_msg = "extrapolation_horizon must not be negative";
+      return false;
+    }
+    if ( !shared_memory_name.empty() && shared_memory_frames < 2 ) {
+      error_msg = "shared_memory_frames must be at least 2";
+      return false;
+    }
     return true;
   }
 
@@ -0,0 +1,159 @@
+/**
+ * @file include/kobuki_driver/profiler.hpp
+ *
+ * @brief Low overhead profiler for the stages of the driver's hot loops.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_PROFILER_HPP_
+#define KOBUKI_PROFILER_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+#include "frame_info.hpp"
+#include "slot_monitor.hpp"
+#include "macros.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief Accumulates the time spent in each stage of the driver's loops.
+ *
+ * Stages are timed with a Scope on the stack. Scopes nest, and each stage is
+ * charged its self time (its own duration less that of the stages nested in
+ * it), so folded() can be fed straight to flamegraph.pl or speedscope to get
+ * a flame graph of the driver, one tower per thread. The graph follows the
+ * scopes as they really nested at runtime: a stage that runs in several
+ * places (the event manager, a signal emitted from both a driver and a user
+ * thread) shows up under each of them.
+ *
+ * Each thread records into a buffer of its own, found through a thread local
+ * cache, so recording takes no locks and shares no cache lines between the
+ * driver's threads. Readers may dump at any time; all counters are relaxed
+ * atomics, so a dump may be a sample apart between stages.
+ *
+ * It is off by default and can be switched on and off at runtime. Switched
+ * off, a scope costs a single relaxed load.
+ *
+ * @code
+ * kobuki.profiler().enable();
+ * ...
+ * std::ofstream("kobuki.folded") << kobuki.profiler().folded();
+ * // flamegraph.pl --countname=us kobuki.folded > kobuki.svg
+ * @endcode
+ */
+class kobuki_PUBLIC Profiler {
+private:
+  struct ThreadRecord; // each thread's own accumulators
+
+public:
+  enum Stage {
+    Read = 0,             // io : the blocking serial read
+    Framing,              // io : hunting for frames in the bytes read
+    DebugLog,             // io : formatting and emitting the per read debug log
+    Decode,               // decode : the whole frame
+    DecodeCoreSensors,    // decode : per sub-payload deserialisation
+    DecodeDockIR,
+    DecodeInertia,
+    DecodeCliff,
+    DecodeCurrent,
+    DecodeHardware,
+    DecodeFirmware,
+    DecodeThreeAxisGyro,
+    DecodeGpInput,
+    DecodeUniqueDeviceID,
+    DecodeControllerInfo,
+    DecodeUnknown,        // decode : garbled or unsupported sub-payloads
+    EventManagerUpdate,   // decode : working out the events
+    FieldWatch,           // decode : checking the field subscriptions
+    Publish,              // publish : the whole frame
+    SnapshotStore,        // publish : handing the frame to the getters
+    BaseControl,          // computing the velocity command
+    Transmit,             // transmit : serialising the commands
+    TransmitWrite,        // transmit : the serial write
+    FirstEmit,            // one per signal, see emitStage()
+    NumberOfStages = FirstEmit + SlotMonitor::NumberOfChannels
+  };
+
+  static const unsigned int max_threads = 16; /**< @brief Threads beyond this go unrecorded. **/
+  static const unsigned int max_depth = 16;   /**< @brief Scopes nested deeper than this go unrecorded. **/
+  static const unsigned int max_paths = 128;  /**< @brief Distinct nestings of stages per thread, those beyond go unrecorded. **/
+
+  /**
+   * @brief Times a stage for as long as it is in scope.
+   *
+   * Whether it records is decided when it is constructed, so switching the
+   * profiler on or off never leaves a stage half recorded.
+   */
+  class Scope {
+  public:
+    Scope(Profiler *profiler, const Stage &stage) : thread(NULL), start_time(0) {
+      if ( profiler != NULL && profiler->enabled() ) {
+        thread = profiler->push(stage);
+        if ( thread != NULL ) { start_time = monotonicNow(); }
+      }
+    }
+    ~Scope() {
+      if ( thread != NULL ) { Profiler::pop(*thread, start_time); }
+    }
+  private:
+    Scope(const Scope&); // non-copyable
+    Scope& operator=(const Scope&);
+    ThreadRecord *thread;
+    MonotonicTime start_time;
+  };
+
+  Profiler();
+  ~Profiler();
+
+  void enable() { is_enabled.store(true, std::memory_order_relaxed); }
+  void disable() { is_enabled.store(false, std::memory_order_relaxed); }
+  bool enabled() const { return is_enabled.load(std::memory_order_relaxed); }
+  void reset();
+  void nameCurrentThread(const std::string &name);
+
+  unsigned long count(const Stage &stage) const;
+  MonotonicTime selfTime(const Stage &stage) const;
+  MonotonicTime totalTime(const Stage &stage) const;
+  MonotonicTime maximumTime(const Stage &stage) const;
+  std::string folded() const;
+  std::string toString() const;
+
+  static std::string name(const Stage &stage);
+  static Stage payloadStage(const unsigned char &header_id);
+  static Stage emitStage(const SlotMonitor::Channel &channel) { return static_cast<Stage>(static_cast<int>(FirstEmit) + static_cast<int>(channel)); }
+
+private:
+  Profiler(const Profiler&); // non-copyable
+  Profiler& operator=(const Profiler&);
+
+  ThreadRecord* push(const Stage &stage);
+  static void pop(ThreadRecord &thread, const MonotonicTime &start_time);
+  ThreadRecord* currentThread();
+  static std::string path(const ThreadRecord &thread, const int &node);
+
+  const uint64_t instance; // tells the thread local caches of different profilers apart
+  std::atomic<bool> is_enabled;
+  ThreadRecord *threads; // max_threads of them
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_PROFILER_HPP_ */
@@ -0,0 +1,108 @@
+/**
+ * @file include/kobuki_driver/scheduling.hpp
+ *
+ * @brief Helpers for placing the driver's worker threads on the host.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_SCHEDULING_HPP_
+#define KOBUKI_SCHEDULING_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <string>
+#include "macros.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Enums
+*****************************************************************************/
+
+enum SchedulingPolicy {
+  DefaultScheduling = 0, /**< @brief Time sharing, whatever the os gives us (SCHED_OTHER). **/
+  FifoScheduling,        /**< @brief Real time, run until blocked or preempted by a higher priority (SCHED_FIFO). **/
+  RoundRobinScheduling   /**< @brief Real time, time sliced among equal priorities (SCHED_RR). **/
+};
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief Restrict the calling thread to a single cpu.
+ *
+ * @param cpu : index of the cpu to run on.
+ * @param error : filled with the reason if it failed.
+ * @return bool : false if the platform does not support it or the request was refused.
+ */
+kobuki_PUBLIC bool pinCurrentThread(const int &cpu, std::string &error);
+
+/**
+ * @brief Restrict the calling thread to a set of cpus.
+ *
+ * @param mask : bit i set allows cpu i.
+ * @param error : filled with the reason if it failed.
+ * @return bool : false if the platform does not support it or the request was refused.
+ */
+kobuki_PUBLIC bool setCurrentThreadAffinity(const unsigned long long &mask, std::string &error);
+
+/**
+ * @brief Change the scheduling policy and priority of the calling thread.
+ *
+ * The priority is clamped to the range the policy supports. Real time
+ * policies usually need privileges (root, CAP_SYS_NICE or an rtprio limit);
+ * without them this fails and the thread is left as it was.
+ *
+ * @param policy : the policy.
+ * @param priority : the real time priority (ignored for the default policy).
+ * @param error : filled with the reason if it failed.
+ * @return bool : false if the request was refused.
+ */
+kobuki_PUBLIC bool setCurrentThreadScheduling(const SchedulingPolicy &policy, const int &priority, std::string &error);
+
+/**
+ * @brief Lock all current and future pages of the process in ram (mlockall).
+ *
+ * @param error : filled with the reason if it failed.
+ * @return bool : false if the platform does not support it or the request was refused.
+ */
+kobuki_PUBLIC bool lockProcessMemory(std::string &error);
+
+/**
+ * @brief Touch the given amount of the calling thread's stack.
+ *
+ * Together with lockProcessMemory() this makes sure the thread never takes a
+ * page fault on its stack once it is running. The size is clamped to what is
+ * left of the thread's stack, less a margin for the frames it still needs.
+ *
+ * @param size : number of bytes to touch.
+ * @return unsigned int : number of bytes actually touched.
+ */
+kobuki_PUBLIC unsigned int prefaultStack(const unsigned int &size);
+
+/**
+ * @brief The most prefaultStack() may touch on a thread with the default stack size.
+ *
+ * The stack limit (RLIMIT_STACK) less the margin prefaultStack() keeps.
+ */
+kobuki_PUBLIC unsigned int maximumPrefaultStackSize();
+
+/**
+ * @brief Describe the policy, priority and cpus the calling thread actually has.
+ */
+kobuki_PUBLIC std::string describeCurrentThreadScheduling();
+
+} // namespace kobuki
+
+#endif /* KOBUKI_SCHEDULING_HPP_ */
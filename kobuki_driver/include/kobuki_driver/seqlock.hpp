@@ -0,0 +1,97 @@
+/**
+ * @file include/kobuki_driver/seqlock.hpp
+ *
+ * @brief Single writer snapshot that readers copy without locking.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_SEQLOCK_HPP_
+#define KOBUKI_SEQLOCK_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <cstring>
+#include <stdint.h>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief Sequence locked value: one writer, any number of lock free readers.
+ *
+ * The writer bumps the sequence to odd, writes and bumps it back to even; a
+ * reader copies the value out and retries if the sequence was odd or moved in
+ * the meantime. The writer never waits for readers and readers never block
+ * the writer - at worst a reader that overlaps a store copies twice.
+ *
+ * The value is kept in relaxed atomic words so that the overlapping copies are
+ * well defined, which limits T to trivially copyable types.
+ */
+template <typename T>
+class Seqlock {
+public:
+  Seqlock() : sequence(0) {
+    store(T());
+  }
+
+  /**
+   * @brief Writer : publish a new value (only one thread may store).
+   */
+  void store(const T &value) {
+    uint64_t buffer[number_of_words];
+    buffer[number_of_words - 1] = 0;
+    std::memcpy(buffer, &value, sizeof(T));
+    unsigned long position = sequence.load(std::memory_order_relaxed);
+    sequence.store(position + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for ( unsigned int i = 0; i < number_of_words; ++i ) {
+      words[i].store(buffer[i], std::memory_order_relaxed);
+    }
+    sequence.store(position + 2, std::memory_order_release);
+  }
+
+  /**
+   * @brief Reader : a consistent copy of the latest value (any thread).
+   */
+  T load() const {
+    uint64_t buffer[number_of_words];
+    unsigned long before, after;
+    do {
+      before = sequence.load(std::memory_order_acquire);
+      for ( unsigned int i = 0; i < number_of_words; ++i ) {
+        buffer[i] = words[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = sequence.load(std::memory_order_relaxed);
+    } while ( (before & 1) != 0 || before != after );
+    T value;
+    std::memcpy(&value, buffer, sizeof(T));
+    return value;
+  }
+
+private:
+  Seqlock(const Seqlock&); // non-copyable
+  Seqlock& operator=(const Seqlock&);
+
+  static const unsigned int number_of_words = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+  std::atomic<unsigned long> sequence;
+  std::atomic<uint64_t> words[number_of_words];
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_SEQLOCK_HPP_ */
@@ -0,0 +1,179 @@
+/**
+ * @file include/kobuki_driver/server_protocol.hpp
+ *
+ * @brief Messages between the kobuki server and its clients.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_SERVER_PROTOCOL_HPP_
+#define KOBUKI_SERVER_PROTOCOL_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cstddef>
+#include <stdint.h>
+#include "frame.hpp"
+#include "macros.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+namespace protocol {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+/*
+ * Server and clients run on the same machine, so the messages are in the
+ * host's byte order and layout. The hello/welcome exchange checks the
+ * version and the size of a frame to catch builds that do not match.
+ */
+const uint32_t version = 1;
+const unsigned int max_body_size = 1024; /**< @brief Larger than any message, including a frame with every sub-payload. **/
+
+/*****************************************************************************
+** Messages
+*****************************************************************************/
+
+enum MessageType {
+  // client -> server
+  Hello = 1,             /**< @brief HelloData, the first message from a client. **/
+  SetBaseControl,        /**< @brief VelocityData, kept up by the client at its control rate. **/
+  ReleaseBaseControl,    /**< @brief No body, stop competing for the base. **/
+  SetLed,                /**< @brief LedData **/
+  SetDigitalOutput,      /**< @brief OutputsData **/
+  SetExternalPower,      /**< @brief OutputsData **/
+  PlaySoundSequence,     /**< @brief SoundData **/
+  SetControllerGain,     /**< @brief GainData **/
+  GetControllerGain,     /**< @brief No body, the answer arrives with the frames. **/
+  EnableMotors,          /**< @brief No body. **/
+  DisableMotors,         /**< @brief No body. **/
+
+  // server -> client
+  Welcome = 64,          /**< @brief WelcomeData, the server accepted the client. **/
+  Refused,               /**< @brief Text, why the server closed the connection. **/
+  FrameData              /**< @brief A frame, see encodeFrame(). **/
+};
+
+/**
+ * @brief Precedes every message.
+ */
+struct MessageHeader {
+  uint8_t type;    /**< @brief MessageType **/
+  uint8_t flags;   /**< @brief FrameFlags with FrameData, otherwise 0. **/
+  uint16_t length; /**< @brief Bytes in the body that follows. **/
+};
+
+/**
+ * @brief Server state sent along with each frame.
+ */
+enum FrameFlags {
+  RobotAlive = 0x01,   /**< @brief Kobuki::isAlive() **/
+  MotorsEnabled = 0x02,/**< @brief Kobuki::isEnabled() **/
+  InControl = 0x04     /**< @brief This client's velocity is the one being sent to the base. **/
+};
+
+struct HelloData {
+  uint32_t version;    /**< @brief protocol::version **/
+  uint32_t frame_size; /**< @brief sizeof(Frame) **/
+  uint8_t priority;    /**< @brief Of this client's velocity commands, the highest wins. **/
+  char name[31];       /**< @brief For the server's logs, null terminated. **/
+};
+
+struct WelcomeData {
+  uint32_t version;
+  uint32_t frame_size;
+};
+
+struct VelocityData {
+  double linear;  /**< @brief [m/s] **/
+  double angular; /**< @brief [rad/s] **/
+};
+
+struct LedData {
+  uint8_t number;  /**< @brief LedNumber **/
+  uint16_t colour; /**< @brief LedColour **/
+};
+
+struct OutputsData {
+  uint8_t values; /**< @brief Bit i for pin i. **/
+  uint8_t mask;   /**< @brief Bit i to set pin i. **/
+};
+
+struct SoundData {
+  uint8_t sequence; /**< @brief SoundSequences **/
+};
+
+struct GainData {
+  uint8_t type;
+  uint32_t p_gain, i_gain, d_gain;
+};
+
+/*****************************************************************************
+** Encoding
+*****************************************************************************/
+
+kobuki_PUBLIC unsigned int encode(const MessageType &type, const void *body, const unsigned int &length,
+                                  unsigned char *buffer);
+kobuki_PUBLIC unsigned int encodeFrame(const Frame &frame, const uint8_t &flags, unsigned char *buffer);
+kobuki_PUBLIC bool decodeFrame(const unsigned char *body, const unsigned int &length, Frame &frame);
+
+/**
+ * @brief Encode a message with a fixed size body.
+ *
+ * @param buffer : at least sizeof(MessageHeader) + sizeof(Body) bytes.
+ * @return unsigned int : bytes written.
+ */
+template <typename Body>
+unsigned int encode(const MessageType &type, const Body &body, unsigned char *buffer) {
+  return encode(type, &body, sizeof(Body), buffer);
+}
+
+/*****************************************************************************
+** Receiving
+*****************************************************************************/
+/**
+ * @brief Gathers the bytes arriving on a stream into whole messages.
+ *
+ * Fixed size, so receiving never allocates.
+ *
+ * @code
+ * ssize_t received = recv(socket, stream.space(), stream.spaceLeft(), 0);
+ * stream.commit(received);
+ * protocol::MessageHeader header;
+ * const unsigned char *body;
+ * while ( stream.next(header, body) ) { ... }
+ * if ( stream.corrupt() ) { // close the connection }
+ * @endcode
+ */
+class kobuki_PUBLIC MessageStream {
+public:
+  MessageStream() : begin(0), end(0), is_corrupt(false) {}
+
+  unsigned char* space();
+  std::size_t spaceLeft() const { return capacity - end; }
+  void commit(const std::size_t &bytes) { end += bytes; }
+  bool next(MessageHeader &header, const unsigned char *&body);
+  bool corrupt() const { return is_corrupt; } /**< @brief A message was too long to be one of ours. **/
+  void clear() { begin = end = 0; is_corrupt = false; }
+
+private:
+  static const std::size_t capacity = 4 * (sizeof(MessageHeader) + max_body_size);
+  unsigned char buffer[capacity];
+  std::size_t begin, end; // unread bytes
+  bool is_corrupt;
+};
+
+} // namespace protocol
+} // namespace kobuki
+
+#endif /* KOBUKI_SERVER_PROTOCOL_HPP_ */
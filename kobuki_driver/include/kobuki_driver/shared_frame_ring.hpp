@@ -0,0 +1,128 @@
+/**
+ * @file include/kobuki_driver/shared_frame_ring.hpp
+ *
+ * @brief Frames published to other processes through a shared memory ring.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_SHARED_FRAME_RING_HPP_
+#define KOBUKI_SHARED_FRAME_RING_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <string>
+#include <stdint.h>
+#include "frame.hpp"
+#include "macros.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+struct SharedFrameRing; // the layout in shared memory, see shared_frame_ring.cpp
+
+/**
+ * @brief Writes the driver's frames into a POSIX shared memory ring.
+ *
+ * The driver owns the writer (see Parameters::shared_memory_name); other
+ * processes on the robot attach a SharedFrameReader to the same name and read
+ * the frames without any serialisation or socket in between. There is one
+ * writer and any number of readers, and the readers never write to the
+ * shared memory, so they can neither block the driver nor each other.
+ *
+ * Each slot carries the sequence number of the frame in it (odd while it is
+ * being written), which is how readers find their place and notice when the
+ * writer has lapped them.
+ */
+class kobuki_PUBLIC SharedFrameWriter {
+public:
+  SharedFrameWriter();
+  ~SharedFrameWriter();
+
+  bool open(const std::string &name, const unsigned int &capacity, std::string &error);
+  void close();
+  bool isOpen() const { return ring != NULL; }
+  void write(const Frame &frame);
+
+private:
+  SharedFrameWriter(const SharedFrameWriter&); // non-copyable
+  SharedFrameWriter& operator=(const SharedFrameWriter&);
+
+  std::string name;
+  SharedFrameRing *ring;
+  size_t size;
+};
+
+/**
+ * @brief Reads the driver's frames from another process.
+ *
+ * Readers follow the stream at their own pace, one frame at a time with
+ * read(), or skip straight to the newest frame with latest(). A reader that
+ * falls more than the ring's capacity behind has lost frames: read() reports
+ * the overrun, counts the frames lost and picks up again at the oldest frame
+ * still in the ring.
+ *
+ * @code
+ * kobuki::SharedFrameReader reader;
+ * std::string error;
+ * if ( !reader.open("/kobuki_frames", error) ) { ... }
+ * kobuki::Frame frame;
+ * for (;;) {
+ *   while ( reader.read(frame) != kobuki::SharedFrameReader::NoNewFrame ) { ... }
+ *   usleep(5000);
+ * }
+ * @endcode
+ */
+class kobuki_PUBLIC SharedFrameReader {
+public:
+  enum Result {
+    FrameRead,  /**< @brief The next frame in the stream. **/
+    NoNewFrame, /**< @brief Caught up with the writer. **/
+    Overrun     /**< @brief The writer lapped this reader; the frame is the oldest still available. **/
+  };
+
+  SharedFrameReader();
+  ~SharedFrameReader();
+
+  bool open(const std::string &name, std::string &error);
+  void close();
+  bool isOpen() const { return ring != NULL; }
+
+  Result read(Frame &frame);
+  bool latest(Frame &frame);
+
+  uint64_t sequence() const { return next_sequence; }   /**< @brief Frames the writer had published before the next one this reader will read. **/
+  uint64_t available() const;                            /**< @brief Frames waiting to be read. **/
+  unsigned long overruns() const { return overrun_count; } /**< @brief Times the writer lapped this reader. **/
+  unsigned long framesLost() const { return frames_lost; } /**< @brief Frames skipped because of overruns. **/
+  bool writerAlive() const;
+
+private:
+  SharedFrameReader(const SharedFrameReader&); // non-copyable
+  SharedFrameReader& operator=(const SharedFrameReader&);
+
+  bool copy(const uint64_t &sequence, Frame &frame) const;
+
+  const SharedFrameRing *ring;
+  size_t size;
+  uint64_t next_sequence;
+  unsigned long overrun_count;
+  unsigned long frames_lost;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_SHARED_FRAME_RING_HPP_ */
@@ -0,0 +1,93 @@
+/**
+ * @file include/kobuki_driver/slot_monitor.hpp
+ *
+ * @brief Execution time monitoring for the slots the driver signals.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_SLOT_MONITOR_HPP_
+#define KOBUKI_SLOT_MONITOR_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <string>
+#include <ecl/sigslots.hpp>
+#include "frame_info.hpp"
+#include "latency_histogram.hpp"
+#include "macros.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief Times the slots run by each of the driver's signals.
+ *
+ * Every emit is timed from start to finish, which covers all the slots
+ * connected to that signal (sigslots runs them in turn and gives no way to
+ * time them individually). Each signal keeps a histogram of its emit times
+ * and a count of the emits that exceeded the budget. Overruns are reported
+ * on ros_warn, at most once a second per signal.
+ *
+ * The signals of the data stream are emitted in the reading thread (or the
+ * decode and publish stages), so an emit that runs over the budget is a
+ * subscriber holding up the driver. Some are also emitted from the user's
+ * threads (raw_control_command through enable() and disable()), so recording
+ * is safe from any thread.
+ */
+class kobuki_PUBLIC SlotMonitor {
+public:
+  enum Channel {
+    StreamDataSlots = 0,
+    ControllerInfoSlots,
+    VersionInfoSlots,
+    RawDataStreamSlots,
+    RawDataCommandSlots,
+    RawControlCommandSlots,
+    ButtonEventSlots,
+    BumperEventSlots,
+    CliffEventSlots,
+    WheelEventSlots,
+    PowerEventSlots,
+    InputEventSlots,
+    RobotEventSlots,
+    EventBatchSlots,
+    NumberOfChannels
+  };
+
+  SlotMonitor();
+
+  void init(const std::string &sigslots_namespace, const double &budget);
+  void record(const Channel &channel, const MonotonicTime &start_time);
+
+  MonotonicTime budget() const { return slot_budget; } /**< @brief Budget per emit [ns], 0 if overruns are not reported. **/
+  const LatencyHistogram& histogram(const Channel &channel) const { return histograms[channel]; } /**< @brief Emit times of a signal. **/
+  unsigned long overruns(const Channel &channel) const { return overrun_counts[channel].load(std::memory_order_relaxed); } /**< @brief Emits that ran over the budget. **/
+  static const char* name(const Channel &channel);
+  std::string toString() const;
+
+private:
+  MonotonicTime slot_budget;
+  LatencyHistogram histograms[NumberOfChannels];
+  std::atomic<unsigned long> overrun_counts[NumberOfChannels];
+  std::atomic<MonotonicTime> last_warning_times[NumberOfChannels]; // a channel may be emitted from several threads (raw_control_command)
+  std::string sigslots_namespace;
+  ecl::Signal<const std::string&> sig_warn;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_SLOT_MONITOR_HPP_ */
@@ -0,0 +1,143 @@
+/**
+ * @file include/kobuki_driver/spsc_ring.hpp
+ *
+ * @brief Single producer, single consumer ring buffer linking pipeline stages.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_SPSC_RING_HPP_
+#define KOBUKI_SPSC_RING_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <mutex>
+#include <condition_variable>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief Fixed capacity ring of preallocated slots between two threads.
+ *
+ * The producer fills a slot in place (claim, then publish) and the consumer
+ * works on it in place (front or wait, then release), so nothing is copied or
+ * allocated on the way through. The data path is lock free; the mutex and
+ * condition variable only serve to put an idle consumer to sleep.
+ *
+ * The producer never blocks - when the ring is full claim() returns NULL and
+ * it is up to the producer to drop (and count) the item.
+ */
+template <typename T>
+class SpscRing {
+public:
+  /**
+   * @param capacity : number of slots, rounded up to a power of two.
+   */
+  SpscRing(const unsigned int &capacity = 16) :
+    head(0),
+    tail(0),
+    interrupted(false)
+  {
+    size_t size = 2;
+    while ( size < capacity ) { size <<= 1; }
+    slots.resize(size);
+    mask = size - 1;
+  }
+
+  /**
+   * @brief Producer : slot to fill in, or NULL if the ring is full.
+   */
+  T* claim() {
+    size_t position = head.load(std::memory_order_relaxed);
+    if ( position - tail.load(std::memory_order_acquire) > mask ) {
+      return NULL;
+    }
+    return &slots[position & mask];
+  }
+
+  /**
+   * @brief Producer : hand the claimed slot over to the consumer.
+   */
+  void publish() {
+    head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    { std::lock_guard<std::mutex> lock(mutex); } // closes the window between the consumer's check and its wait
+    condition.notify_one();
+  }
+
+  /**
+   * @brief Consumer : oldest published slot, or NULL if the ring is empty.
+   */
+  T* front() {
+    size_t position = tail.load(std::memory_order_relaxed);
+    if ( position == head.load(std::memory_order_acquire) ) {
+      return NULL;
+    }
+    return &slots[position & mask];
+  }
+
+  /**
+   * @brief Consumer : sleep until a slot is published.
+   *
+   * @return T* : the oldest published slot, or NULL if interrupted with nothing left to consume.
+   */
+  T* wait() {
+    T* slot = front();
+    if ( slot != NULL ) { return slot; }
+    std::unique_lock<std::mutex> lock(mutex);
+    while ( (slot = front()) == NULL && !interrupted ) {
+      condition.wait(lock);
+    }
+    return slot;
+  }
+
+  /**
+   * @brief Consumer : done with the front slot, hand it back to the producer.
+   */
+  void release() {
+    tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  /**
+   * @brief Wake up the consumer for good (shutdown); it drains what is left and then sees NULL.
+   */
+  void interrupt() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      interrupted = true;
+    }
+    condition.notify_all();
+  }
+
+  unsigned int capacity() const { return static_cast<unsigned int>(mask + 1); }
+
+private:
+  std::vector<T> slots;
+  size_t mask;
+  char padding0[64];
+  std::atomic<size_t> head; // written by the producer
+  char padding1[64];
+  std::atomic<size_t> tail; // written by the consumer
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool interrupted;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_SPSC_RING_HPP_ */
@@ -0,0 +1,91 @@
+/**
+ * @file include/kobuki_driver/thread_interrupter.hpp
+ *
+ * @brief Wakes a thread out of a blocking system call.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_THREAD_INTERRUPTER_HPP_
+#define KOBUKI_THREAD_INTERRUPTER_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <mutex>
+#include <ecl/config.hpp>
+#include "macros.hpp"
+
+#ifdef ECL_IS_POSIX
+  #include <pthread.h>
+#endif
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief Knocks a registered thread out of a blocking system call.
+ *
+ * The serial device gives no way of cancelling a read that is waiting for
+ * data, so the thread is sent a signal (one of the real time signals, with a
+ * handler that does nothing and no SA_RESTART); the read returns early with
+ * an error and the thread gets to check its flags.
+ *
+ * Only the call the thread marks with a BlockingCall is interrupted; the
+ * signal is never sent while the thread is elsewhere, e.g. running user
+ * callbacks whose own sleeps and waits must not be cut short. A signal sent
+ * just before the thread enters the call is not seen by it, so callers
+ * waiting for the thread should keep interrupting until it responds. If the
+ * signal is already in use by the application, nothing is installed and
+ * interrupt() does nothing (available() is false) - blocking calls then run
+ * to their timeout as before.
+ */
+class kobuki_PUBLIC ThreadInterrupter {
+public:
+  /**
+   * @brief Marks the blocking call the registered thread makes in its scope as interruptible.
+   */
+  class BlockingCall {
+  public:
+    explicit BlockingCall(ThreadInterrupter &interrupter) : interrupter(interrupter) { interrupter.enterBlockingCall(); }
+    ~BlockingCall() { interrupter.leaveBlockingCall(); }
+  private:
+    ThreadInterrupter &interrupter;
+  };
+
+  ThreadInterrupter();
+
+  bool available() const { return installed; } /**< @brief Whether interrupt() can do anything on this platform. **/
+  void registerCurrentThread();
+  void unregisterCurrentThread();
+  bool isCurrentThread() const;
+  void interrupt();
+
+private:
+  void enterBlockingCall();
+  void leaveBlockingCall();
+
+  bool installed;
+  std::atomic<bool> registered;
+  std::atomic<bool> in_blocking_call;
+  std::mutex blocking_call_mutex; // a signal is never sent after the call is left
+#ifdef ECL_IS_POSIX
+  pthread_t thread;
+#endif
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_THREAD_INTERRUPTER_HPP_ */
@@ -0,0 +1,85 @@
+/**
+ * @file include/kobuki_driver/velocity_mailbox.hpp
+ *
+ * @brief Hands the latest velocity command from the user to the driver.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_VELOCITY_MAILBOX_HPP_
+#define KOBUKI_VELOCITY_MAILBOX_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include "frame_info.hpp"
+#include "seqlock.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+/**
+ * @brief A velocity command, as posted by the user.
+ */
+struct VelocityCommand {
+  double linear;      /**< @brief [m/s] **/
+  double angular;     /**< @brief [rad/s] **/
+  MonotonicTime time; /**< @brief Host time it was posted, 0 if nothing has been. **/
+};
+
+/**
+ * @brief The latest velocity command, posted from any thread and taken without a lock.
+ *
+ * Only the latest command matters, so there is no queue: posting overwrites
+ * and taking reads whatever is there, as often as the driver sends. The
+ * command sits in a Seqlock, so neither side allocates and the driver's side
+ * never waits. Posts from several threads take turns on a spin flag held only
+ * for the copy.
+ */
+class VelocityMailbox {
+public:
+  VelocityMailbox() {
+    posting.clear();
+  }
+
+  /**
+   * @brief Post a command, replacing the previous one (any thread).
+   */
+  void post(const double &linear, const double &angular, const MonotonicTime &time = monotonicNow()) {
+    VelocityCommand command;
+    command.linear = linear;
+    command.angular = angular;
+    command.time = time;
+    while ( posting.test_and_set(std::memory_order_acquire) ) {}
+    mailbox.store(command);
+    posting.clear(std::memory_order_release);
+  }
+
+  /**
+   * @brief The latest command (any thread, lock free), all zeros if none was posted.
+   */
+  VelocityCommand latest() const { return mailbox.load(); }
+
+private:
+  VelocityMailbox(const VelocityMailbox&); // non-copyable
+  VelocityMailbox& operator=(const VelocityMailbox&);
+
+  std::atomic_flag posting; // serialises the posting threads, Seqlock has a single writer
+  Seqlock<VelocityCommand> mailbox;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_VELOCITY_MAILBOX_HPP_ */
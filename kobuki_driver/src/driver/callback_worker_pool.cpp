@@ -0,0 +1,179 @@
+/**
+ * @file /kobuki_driver/src/driver/callback_worker_pool.cpp
+ *
+ * @brief Implementation of the callback worker pool.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include "../../include/kobuki_driver/callback_worker_pool.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+CallbackWorkerPool::CallbackWorkerPool() :
+  head(NULL),
+  tail(NULL),
+  stopping(false)
+{}
+
+CallbackWorkerPool::~CallbackWorkerPool()
+{
+  stop();
+}
+
+/**
+ * @brief Start the worker threads, if not already running.
+ *
+ * @param number_of_threads : 0 starts none.
+ */
+void CallbackWorkerPool::start(const unsigned int &number_of_threads)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if ( !workers.empty() ) { return; }
+  stopping = false;
+  for (unsigned int i = 0; i < number_of_threads; ++i) {
+    workers.push_back(new ecl::Thread());
+    workers.back()->start(&CallbackWorkerPool::work, *this);
+  }
+}
+
+/**
+ * @brief Finish the jobs that are running and join the threads.
+ *
+ * Jobs still waiting for a thread are dropped.
+ */
+void CallbackWorkerPool::stop()
+{
+  std::vector<ecl::Thread*> stopped;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    stopped.swap(workers);
+  }
+  job_available.notify_all();
+  for (unsigned int i = 0; i < stopped.size(); ++i) {
+    stopped[i]->join();
+    delete stopped[i];
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  while ( head != NULL ) {
+    Job *job = head;
+    head = job->next;
+    job->next = NULL;
+    job->state = Job::Idle;
+    job->rerun = false;
+  }
+  tail = NULL;
+  job_finished.notify_all();
+}
+
+unsigned int CallbackWorkerPool::threads() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return workers.size();
+}
+
+/**
+ * @brief Have a job run on one of the threads (any thread).
+ */
+void CallbackWorkerPool::schedule(Job &job)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  switch ( job.state ) {
+    case Job::Idle :
+      job.state = Job::Queued;
+      job.next = NULL;
+      if ( tail == NULL ) { head = &job; } else { tail->next = &job; }
+      tail = &job;
+      lock.unlock();
+      job_available.notify_one();
+      break;
+    case Job::Running :
+      job.rerun = true;
+      break;
+    default : // already waiting
+      break;
+  }
+}
+
+/**
+ * @brief Take a job off the queue, waiting for it to finish if it is running.
+ *
+ * The job is not run again unless it is scheduled again. Called from the
+ * job itself, it does not wait (the job would be waiting on itself).
+ */
+void CallbackWorkerPool::cancel(Job &job)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  job.rerun = false;
+  if ( job.state == Job::Queued ) {
+    Job *previous = NULL;
+    for (Job *queued = head; queued != NULL; previous = queued, queued = queued->next) {
+      if ( queued != &job ) { continue; }
+      if ( previous == NULL ) { head = job.next; } else { previous->next = job.next; }
+      if ( tail == &job ) { tail = previous; }
+      break;
+    }
+    job.next = NULL;
+    job.state = Job::Idle;
+  }
+  while ( job.state == Job::Running && job.runner != std::this_thread::get_id() ) {
+    job_finished.wait(lock);
+  }
+}
+
+/**
+ * @brief Whether the calling thread is inside the job's run().
+ */
+bool CallbackWorkerPool::isRunningJob(const Job &job) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return job.state == Job::Running && job.runner == std::this_thread::get_id();
+}
+
+void CallbackWorkerPool::work()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while ( true ) {
+    while ( head == NULL && !stopping ) {
+      job_available.wait(lock);
+    }
+    if ( stopping ) { return; }
+    Job *job = head;
+    head = job->next;
+    if ( head == NULL ) { tail = NULL; }
+    job->next = NULL;
+    job->state = Job::Running;
+    job->runner = std::this_thread::get_id();
+    lock.unlock();
+    job->run();
+    lock.lock();
+    job->runner = std::thread::id();
+    if ( job->rerun && !stopping ) {
+      job->rerun = false;
+      job->state = Job::Queued;
+      if ( tail == NULL ) { head = job; } else { tail->next = job; }
+      tail = job;
+      job_available.notify_one();
+    } else {
+      job->rerun = false;
+      job->state = Job::Idle;
+    }
+    job_finished.notify_all();
+  }
+}
+
+} // namespace kobuki
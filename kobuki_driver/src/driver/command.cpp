@@ -157,9 +157,10 @@ Command Command::GetVersionInfo()
 Command Command::SetVelocityControl(DiffDrive& diff_drive)
 {
   Command outgoing;
-  std::vector<short> velocity_commands = diff_drive.velocityCommands();
-  outgoing.data.speed = velocity_commands[0];
-  outgoing.data.radius = velocity_commands[1];
+  short speed, radius;
+  diff_drive.getVelocityCommands(speed, radius);
+  outgoing.data.speed = speed;
+  outgoing.data.radius = radius;
   outgoing.data.command = Command::BaseControl;
   return outgoing;
 }
@@ -201,7 +202,7 @@ Command Command::GetControllerGain()
  */
 void Command::resetBuffer(Buffer& buffer) {
   buffer.clear();
-  buffer.resize(64);
+  buffer.resize(3 + max_payload_length + 1); // header, length, sub-payloads and checksum
   buffer.push_back(Command::header0);
   buffer.push_back(Command::header1);
   buffer.push_back(0); // just initialise, we usually write in the payload here later (size of payload only, not stx, not etx, not length)
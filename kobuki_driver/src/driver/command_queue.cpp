@@ -0,0 +1,121 @@
+/**
+ * @file /kobuki_driver/src/driver/command_queue.cpp
+ *
+ * @brief Implementation of the lock free command queue.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include "../../include/kobuki_driver/command_queue.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+/**
+ * @param capacity : maximum number of queued commands, rounded up to a power of two.
+ */
+CommandQueue::CommandQueue(const unsigned int &capacity) :
+  base_control(0),
+  cells(NULL),
+  mask(0),
+  enqueue_position(0),
+  dequeue_position(0),
+  overflow_count(0),
+  superseded_count(0)
+{
+  size_t size = 2;
+  while ( size < capacity ) { size <<= 1; }
+  mask = size - 1;
+  cells = new Cell[size];
+  for ( size_t i = 0; i < size; ++i ) {
+    cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+CommandQueue::~CommandQueue() {
+  delete[] cells;
+}
+
+/**
+ * @brief Queue a command (safe to call from any thread).
+ *
+ * @param command : the command to queue.
+ * @return bool : false if the fifo was full and the command was dropped.
+ */
+bool CommandQueue::push(const Command &command) {
+  if ( command.data.command == Command::BaseControl ) {
+    uint64_t packed = (static_cast<uint64_t>(1) << 32)
+                    | (static_cast<uint64_t>(static_cast<uint16_t>(command.data.speed)) << 16)
+                    | static_cast<uint64_t>(static_cast<uint16_t>(command.data.radius));
+    if ( base_control.exchange(packed, std::memory_order_acq_rel) != 0 ) {
+      superseded_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+  }
+  return pushOneShot(command);
+}
+
+bool CommandQueue::pushOneShot(const Command &command) {
+  Cell *cell;
+  size_t position = enqueue_position.load(std::memory_order_relaxed);
+  for (;;) {
+    cell = &cells[position & mask];
+    size_t sequence = cell->sequence.load(std::memory_order_acquire);
+    ptrdiff_t difference = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(position);
+    if ( difference == 0 ) {
+      if ( enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed) ) {
+        break;
+      }
+    } else if ( difference < 0 ) {
+      overflow_count.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      position = enqueue_position.load(std::memory_order_relaxed);
+    }
+  }
+  cell->data = command.data;
+  cell->sequence.store(position + 1, std::memory_order_release);
+  return true;
+}
+
+/**
+ * @brief Retrieve the next command (only the transmit thread may call this).
+ *
+ * The pending base control command comes first, then the one shot commands in
+ * the order they were queued.
+ *
+ * @param command : filled with the command if one was available.
+ * @return bool : false if the queue was empty.
+ */
+bool CommandQueue::pop(Command &command) {
+  uint64_t packed = base_control.exchange(0, std::memory_order_acq_rel);
+  if ( packed != 0 ) {
+    command.data = Command::Data();
+    command.data.command = Command::BaseControl;
+    command.data.speed = static_cast<int16_t>(static_cast<uint16_t>(packed >> 16));
+    command.data.radius = static_cast<int16_t>(static_cast<uint16_t>(packed));
+    return true;
+  }
+  Cell *cell = &cells[dequeue_position & mask];
+  size_t sequence = cell->sequence.load(std::memory_order_acquire);
+  if ( static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(dequeue_position + 1) < 0 ) {
+    return false;
+  }
+  command.data = cell->data;
+  cell->sequence.store(dequeue_position + mask + 1, std::memory_order_release);
+  ++dequeue_position;
+  return true;
+}
+
+} // namespace kobuki
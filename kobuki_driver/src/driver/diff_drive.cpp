@@ -27,11 +27,11 @@ DiffDrive::DiffDrive() :
   last_velocity_right(0.0),
   last_tick_left(0),
   last_tick_right(0),
+  has_ticks(false),
   last_rad_left(0.0),
   last_rad_right(0.0),
 //  v(0.0), w(0.0), // command velocities, in [m/s] and [rad/s]
   radius(0.0), speed(0.0), // command velocities, in [mm] and [mm/s]
-  point_velocity(2,0.0), // command velocities, in [m/s] and [rad/s]
   bias(0.23), // wheelbase, wheel_to_wheel, in [m]
   wheel_radius(0.035), // radius of main wheel, in [m]
   tick_to_rad(0.002436916871363930187454f),
@@ -82,6 +82,7 @@ void DiffDrive::update(const uint16_t &time_stamp,
   right_diff_ticks = (double)(short)((curr_tick_right - last_tick_right) & 0xffff);
   last_tick_right = curr_tick_right;
   last_rad_right += tick_to_rad * right_diff_ticks;
+  has_ticks = true;
 
   // TODO this line and the last statements are really ugly; refactor, put in another place
   pose_update = diff_drive_kinematics.forward(tick_to_rad * left_diff_ticks, tick_to_rad * right_diff_ticks);
@@ -121,13 +122,29 @@ void DiffDrive::getWheelJointStates(double &wheel_left_angle, double &wheel_left
   state_mutex.unlock();
 }
 
+/**
+ * @brief The wheel angles getWheelJointStates() reports once update() has taken these encoder readings.
+ *
+ * Lets a frame that update() has not seen yet be placed on the same scale.
+ * Before the first update() the readings are taken as the starting point,
+ * as update() does.
+ */
+void DiffDrive::getWheelAngles(const uint16_t &left_encoder, const uint16_t &right_encoder,
+                               double &wheel_left_angle, double &wheel_right_angle) {
+  state_mutex.lock();
+  wheel_left_angle = last_rad_left;
+  wheel_right_angle = last_rad_right;
+  if ( has_ticks ) {
+    wheel_left_angle += tick_to_rad * (double)(short)((left_encoder - last_tick_left) & 0xffff);
+    wheel_right_angle += tick_to_rad * (double)(short)((right_encoder - last_tick_right) & 0xffff);
+  }
+  state_mutex.unlock();
+}
+
 void DiffDrive::setVelocityCommands(const double &vx, const double &wz) {
   // vx: in m/s
   // wz: in rad/s
-  std::vector<double> cmd_vel;
-  cmd_vel.push_back(vx);
-  cmd_vel.push_back(wz);
-  point_velocity = cmd_vel;
+  velocity_command.post(vx, wz);
 }
 
 void DiffDrive::velocityCommands(const double &vx, const double &wz) {
@@ -171,17 +188,25 @@ void DiffDrive::velocityCommands(const short &cmd_speed, const short &cmd_radius
   return;
 }
 
-std::vector<short> DiffDrive::velocityCommands() {
+void DiffDrive::getVelocityCommands(short &cmd_speed, short &cmd_radius) {
   velocity_mutex.lock();
-  std::vector<short> cmd(2);
-  cmd[0] = bound(speed);  // In [mm/s]
-  cmd[1] = bound(radius); // In [mm]
+  cmd_speed = bound(speed);   // In [mm/s]
+  cmd_radius = bound(radius); // In [mm]
   velocity_mutex.unlock();
+}
+
+std::vector<short> DiffDrive::velocityCommands() {
+  std::vector<short> cmd(2);
+  getVelocityCommands(cmd[0], cmd[1]);
   return cmd;
 }
 
 std::vector<double> DiffDrive::pointVelocity() const {
-  return point_velocity;
+  VelocityCommand command = velocity_command.latest();
+  std::vector<double> cmd_vel(2);
+  cmd_vel[0] = command.linear;
+  cmd_vel[1] = command.angular;
+  return cmd_vel;
 }
 
 short DiffDrive::bound(const double &value) {
@@ -25,7 +25,17 @@ namespace kobuki {
 ** Implementation
 *****************************************************************************/
 
-void EventManager::init ( const std::string &sigslots_namespace ) {
+/**
+ * @param sigslots_namespace : namespace of the event signals.
+ * @param slot_monitor : times the event slots, if not NULL.
+ * @param profiler : profiles the event emits, if not NULL.
+ * @param single_events : signal each event on its own as well as in the per frame batch.
+ */
+void EventManager::init ( const std::string &sigslots_namespace, SlotMonitor *slot_monitor, Profiler *profiler,
+                          const bool &single_events ) {
+  this->slot_monitor = slot_monitor;
+  this->profiler = profiler;
+  this->single_events = single_events;
   sig_button_event.connect(sigslots_namespace + std::string("/button_event"));
   sig_bumper_event.connect(sigslots_namespace + std::string("/bumper_event"));
   sig_cliff_event.connect(sigslots_namespace  + std::string("/cliff_event"));
@@ -33,6 +43,7 @@ void EventManager::init ( const std::string &sigslots_namespace ) {
   sig_power_event.connect(sigslots_namespace  + std::string("/power_event"));
   sig_input_event.connect(sigslots_namespace  + std::string("/input_event"));
   sig_robot_event.connect(sigslots_namespace  + std::string("/robot_event"));
+  sig_event_batch.connect(sigslots_namespace  + std::string("/event_batch"));
 }
 
 /**
@@ -60,7 +71,7 @@ void EventManager::update(const CoreSensors::Data &new_state, const std::vector<
       } else {
         event.state = ButtonEvent::Released;
       }
-      sig_button_event.emit(event);
+      raise(sig_button_event, event_callbacks.button, event, SlotMonitor::ButtonEventSlots);
     }
 
     if ((new_state.buttons ^ last_state.buttons) & CoreSensors::Flags::Button1) {
@@ -70,7 +81,7 @@ void EventManager::update(const CoreSensors::Data &new_state, const std::vector<
       } else {
         event.state = ButtonEvent::Released;
       }
-      sig_button_event.emit(event);
+      raise(sig_button_event, event_callbacks.button, event, SlotMonitor::ButtonEventSlots);
     }
 
     if ((new_state.buttons ^ last_state.buttons) & CoreSensors::Flags::Button2) {
@@ -80,7 +91,7 @@ void EventManager::update(const CoreSensors::Data &new_state, const std::vector<
       } else {
         event.state = ButtonEvent::Released;
       }
-      sig_button_event.emit(event);
+      raise(sig_button_event, event_callbacks.button, event, SlotMonitor::ButtonEventSlots);
     }
   }
 
@@ -100,7 +111,7 @@ void EventManager::update(const CoreSensors::Data &new_state, const std::vector<
       } else {
         event.state = BumperEvent::Released;
       }
-      sig_bumper_event.emit(event);
+      raise(sig_bumper_event, event_callbacks.bumper, event, SlotMonitor::BumperEventSlots);
     }
 
     if ((new_state.bumper ^ last_state.bumper) & CoreSensors::Flags::CenterBumper) {
@@ -110,7 +121,7 @@ void EventManager::update(const CoreSensors::Data &new_state, const std::vector<
       } else {
         event.state = BumperEvent::Released;
       }
-      sig_bumper_event.emit(event);
+      raise(sig_bumper_event, event_callbacks.bumper, event, SlotMonitor::BumperEventSlots);
     }
 
     if ((new_state.bumper ^ last_state.bumper) & CoreSensors::Flags::RightBumper) {
@@ -120,7 +131,7 @@ void EventManager::update(const CoreSensors::Data &new_state, const std::vector<
       } else {
         event.state = BumperEvent::Released;
       }
-      sig_bumper_event.emit(event);
+      raise(sig_bumper_event, event_callbacks.bumper, event, SlotMonitor::BumperEventSlots);
     }
   }
 
@@ -141,7 +152,7 @@ void EventManager::update(const CoreSensors::Data &new_state, const std::vector<
         event.state = CliffEvent::Floor;
       }
       event.bottom = cliff_data[event.sensor];
-      sig_cliff_event.emit(event);
+      raise(sig_cliff_event, event_callbacks.cliff, event, SlotMonitor::CliffEventSlots);
     }
 
     if ((new_state.cliff ^ last_state.cliff) & CoreSensors::Flags::CenterCliff) {
@@ -152,7 +163,7 @@ void EventManager::update(const CoreSensors::Data &new_state, const std::vector<
         event.state = CliffEvent::Floor;
       }
       event.bottom = cliff_data[event.sensor];
-      sig_cliff_event.emit(event);
+      raise(sig_cliff_event, event_callbacks.cliff, event, SlotMonitor::CliffEventSlots);
     }
 
     if ((new_state.cliff ^ last_state.cliff) & CoreSensors::Flags::RightCliff) {
@@ -163,7 +174,7 @@ void EventManager::update(const CoreSensors::Data &new_state, const std::vector<
         event.state = CliffEvent::Floor;
       }
       event.bottom = cliff_data[event.sensor];
-      sig_cliff_event.emit(event);
+      raise(sig_cliff_event, event_callbacks.cliff, event, SlotMonitor::CliffEventSlots);
     }
   }
 
@@ -183,7 +194,7 @@ void EventManager::update(const CoreSensors::Data &new_state, const std::vector<
       } else {
         event.state = WheelEvent::Raised;
       }
-      sig_wheel_event.emit(event);
+      raise(sig_wheel_event, event_callbacks.wheel, event, SlotMonitor::WheelEventSlots);
     }
 
     if ((new_state.wheel_drop ^ last_state.wheel_drop) & CoreSensors::Flags::RightWheel) {
@@ -193,7 +204,7 @@ void EventManager::update(const CoreSensors::Data &new_state, const std::vector<
       } else {
         event.state = WheelEvent::Raised;
       }
-      sig_wheel_event.emit(event);
+      raise(sig_wheel_event, event_callbacks.wheel, event, SlotMonitor::WheelEventSlots);
     }
   }
 
@@ -224,7 +235,7 @@ void EventManager::update(const CoreSensors::Data &new_state, const std::vector<
             event.event = PowerEvent::PluggedToDockbase;
           break;
       }
-      sig_power_event.emit(event);
+      raise(sig_power_event, event_callbacks.power, event, SlotMonitor::PowerEventSlots);
     }
   }
 
@@ -247,7 +258,7 @@ void EventManager::update(const CoreSensors::Data &new_state, const std::vector<
         default:
           break;
       }
-      sig_power_event.emit(event);
+      raise(sig_power_event, event_callbacks.power, event, SlotMonitor::PowerEventSlots);
     }
   }
 
@@ -269,7 +280,7 @@ void EventManager::update(const uint16_t &new_digital_input)
     event.values[2] = new_digital_input&0x0004;
     event.values[3] = new_digital_input&0x0008;
 
-    sig_input_event.emit(event);
+    raise(sig_input_event, event_callbacks.input, event, SlotMonitor::InputEventSlots);
 
     last_digital_input = new_digital_input;
   }
@@ -289,10 +300,23 @@ void EventManager::update(bool is_plugged, bool is_alive)
     RobotEvent event;
     event.state = robot_state;
 
-    sig_robot_event.emit(event);
+    emit(sig_robot_event, event_callbacks.robot, event, SlotMonitor::RobotEventSlots);
 
     last_robot_state = robot_state;
   }
 }
 
+/**
+ * Signal the events raised since the last flush as one batch, if there were any.
+ * Called once the whole frame is decoded.
+ * @param frame_info The frame they came in.
+ */
+void EventManager::flush(const FrameInfo &frame_info)
+{
+  if (batch.empty()) { return; }
+  batch.info = frame_info;
+  emit(sig_event_batch, event_callbacks.batch, batch, SlotMonitor::EventBatchSlots);
+  batch.clear();
+}
+
 } // namespace kobuki
@@ -0,0 +1,302 @@
+/**
+ * @file /kobuki_driver/src/driver/field_watcher.cpp
+ *
+ * @brief Implementation of the field watcher.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include "../../include/kobuki_driver/field_watcher.hpp"
+#include "../../include/kobuki_driver/packet_handler/payload_headers.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+const double battery_resolution = 0.1;  // [V] per raw unit
+const double current_resolution = 0.01; // [A] per raw unit
+}
+
+/*****************************************************************************
+** Implementation [Subscribers]
+*****************************************************************************/
+
+FieldWatcher::FieldWatcher() :
+  claimed(0),
+  active(0)
+{
+  for (unsigned int i = 0; i < max_subscriptions; ++i) {
+    slots[i].generation.store(0, std::memory_order_relaxed);
+    slots[i].field.store(BatteryVoltage, std::memory_order_relaxed);
+    slots[i].condition.store(ChangedBy, std::memory_order_relaxed);
+    slots[i].threshold.store(0, std::memory_order_relaxed);
+    slots[i].seen_generation = 0;
+    slots[i].reference = 0;
+    slots[i].pending = false;
+    slots[i].missed = 0;
+  }
+}
+
+/**
+ * @brief Start watching a field.
+ *
+ * The first frame carrying the field after subscribing sets the reference
+ * value, so a subscription reports changes from then on, not the current
+ * state (read that with the getters).
+ *
+ * @param field : the field to watch.
+ * @param condition : what to wait for.
+ * @param threshold : in the field's units (see Field), the minimum change for ChangedBy.
+ * @return int : subscription id to wait() on, -1 if all max_subscriptions are taken.
+ */
+int FieldWatcher::subscribe(const Field &field, const Condition &condition, const double &threshold)
+{
+  if ( field < 0 || field >= NumberOfFields ) { return -1; }
+  int id = -1;
+  uint32_t taken = claimed.load(std::memory_order_relaxed);
+  while ( id < 0 ) {
+    unsigned int i = 0;
+    while ( i < max_subscriptions && (taken & (1u << i)) != 0 ) { ++i; }
+    if ( i == max_subscriptions ) { return -1; }
+    if ( claimed.compare_exchange_weak(taken, taken | (1u << i), std::memory_order_acquire) ) {
+      id = static_cast<int>(i);
+    }
+  }
+  Slot &slot = slots[id];
+  int raw_threshold = raw(field, threshold);
+  if ( condition == ChangedBy ) {
+    raw_threshold = std::abs(raw_threshold);
+    if ( raw_threshold < 1 ) { raw_threshold = 1; }
+  }
+  {
+    // under the lock, so an event the decode stage found for the slot's last
+    // subscription is either cleared here or dropped by notify()
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    slot.generation.fetch_add(1, std::memory_order_relaxed); // odd, the decode stage leaves it alone
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.field.store(field, std::memory_order_relaxed);
+    slot.condition.store(condition, std::memory_order_relaxed);
+    slot.threshold.store(raw_threshold, std::memory_order_relaxed);
+    slot.pending = false;
+    slot.missed = 0;
+    slot.generation.fetch_add(1, std::memory_order_release);
+  }
+  active.fetch_or(1u << id, std::memory_order_release);
+  return id;
+}
+
+/**
+ * @brief Stop watching, waking anyone still waiting on the subscription.
+ */
+void FieldWatcher::unsubscribe(const int &id)
+{
+  if ( !valid(id) ) { return; }
+  uint32_t bit = 1u << id;
+  if ( (active.fetch_and(~bit, std::memory_order_acq_rel) & bit) == 0 ) { return; }
+  Slot &slot = slots[id];
+  {
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    slot.pending = false;
+  }
+  slot.condition_met.notify_all();
+  claimed.fetch_and(~bit, std::memory_order_release);
+}
+
+/**
+ * @brief Block until the subscription's condition is met.
+ *
+ * Returns straight away with an event met since the last call, if there is
+ * one.
+ *
+ * @param id : from subscribe().
+ * @param timeout : give up after this many seconds.
+ * @param event : filled with the event if the condition was met.
+ * @return bool : false if it timed out or the subscription was cancelled.
+ */
+bool FieldWatcher::wait(const int &id, const double &timeout, Event &event)
+{
+  if ( !valid(id) ) { return false; }
+  Slot &slot = slots[id];
+  uint32_t bit = 1u << id;
+  std::unique_lock<std::mutex> lock(slot.mutex);
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+      + std::chrono::nanoseconds(static_cast<long long>(timeout * 1.0e9));
+  while ( !slot.pending ) {
+    if ( (active.load(std::memory_order_acquire) & bit) == 0 ) { return false; }
+    if ( slot.condition_met.wait_until(lock, deadline) == std::cv_status::timeout && !slot.pending ) {
+      return false;
+    }
+  }
+  event = slot.event;
+  slot.pending = false;
+  return true;
+}
+
+/**
+ * @brief Collect an event met since the last call, without blocking.
+ *
+ * @return bool : false if there was none.
+ */
+bool FieldWatcher::poll(const int &id, Event &event)
+{
+  if ( !valid(id) ) { return false; }
+  Slot &slot = slots[id];
+  std::lock_guard<std::mutex> lock(slot.mutex);
+  if ( !slot.pending ) { return false; }
+  event = slot.event;
+  slot.pending = false;
+  return true;
+}
+
+/**
+ * @brief Events replaced by a newer one before the subscriber collected them.
+ */
+unsigned long FieldWatcher::missed(const int &id) const
+{
+  if ( !valid(id) ) { return 0; }
+  const Slot &slot = slots[id];
+  std::lock_guard<std::mutex> lock(slot.mutex);
+  return slot.missed;
+}
+
+/**
+ * @brief Convert a raw value of the field to its units (see Field).
+ */
+double FieldWatcher::value(const Field &field, const int &raw)
+{
+  switch ( field ) {
+    case BatteryVoltage : return raw * battery_resolution;
+    case LeftMotorCurrent :
+    case RightMotorCurrent : return raw * current_resolution;
+    default : return raw;
+  }
+}
+
+int FieldWatcher::raw(const Field &field, const double &value)
+{
+  switch ( field ) {
+    case BatteryVoltage : return static_cast<int>(std::floor(value / battery_resolution + 0.5));
+    case LeftMotorCurrent :
+    case RightMotorCurrent : return static_cast<int>(std::floor(value / current_resolution + 0.5));
+    default : return static_cast<int>(std::floor(value + 0.5));
+  }
+}
+
+bool FieldWatcher::present(const Field &field, const uint32_t &payloads)
+{
+  switch ( field ) {
+    case BatteryVoltage :
+    case ChargerState : return (payloads & (1u << Header::CoreSensors)) != 0;
+    case LeftMotorCurrent :
+    case RightMotorCurrent : return (payloads & (1u << Header::Current)) != 0;
+    default : return (payloads & (1u << Header::GpInput)) != 0;
+  }
+}
+
+/*****************************************************************************
+** Implementation [Decode Stage]
+*****************************************************************************/
+
+/**
+ * @brief Check the subscriptions against a freshly decoded frame.
+ *
+ * Only fields whose sub-payload came in this frame are checked.
+ *
+ * @param info : the frame's info, passed on with the events.
+ * @param payloads : bitmask of the sub-payloads in the frame (see Frame::payloads).
+ */
+void FieldWatcher::update(const FrameInfo &info, const uint32_t &payloads, const CoreSensors::Data &core_sensors,
+                          const Current::Data &current, const GpInput::Data &gp_input)
+{
+  uint32_t mask = active.load(std::memory_order_acquire);
+  if ( mask == 0 ) { return; }
+
+  int values[NumberOfFields];
+  values[BatteryVoltage] = core_sensors.battery;
+  values[ChargerState] = core_sensors.charger;
+  for (unsigned int i = 0; i < 4; ++i) { values[AnalogInput0 + i] = gp_input.analog_input[i]; }
+  values[LeftMotorCurrent] = current.current[0];
+  values[RightMotorCurrent] = current.current[1];
+
+  for (unsigned int i = 0; mask != 0; ++i, mask >>= 1) {
+    if ( (mask & 1u) == 0 ) { continue; }
+    Slot &slot = slots[i];
+    // read the subscription like a seqlock, skipping it if subscribe() is rewriting it
+    unsigned int generation = slot.generation.load(std::memory_order_acquire);
+    if ( (generation & 1u) != 0 ) { continue; }
+    Field field = static_cast<Field>(slot.field.load(std::memory_order_relaxed));
+    Condition condition = static_cast<Condition>(slot.condition.load(std::memory_order_relaxed));
+    int threshold = slot.threshold.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if ( slot.generation.load(std::memory_order_relaxed) != generation ) { continue; }
+    if ( !present(field, payloads) ) { continue; }
+    int value = values[field];
+    if ( generation != slot.seen_generation ) { // new subscription, this frame sets the reference
+      slot.seen_generation = generation;
+      slot.reference = value;
+      continue;
+    }
+    int previous = slot.reference;
+    bool met = false;
+    switch ( condition ) {
+      case ChangedBy :
+        met = std::abs(value - previous) >= threshold;
+        if ( met ) { slot.reference = value; }
+        break;
+      case RisesAbove :
+        met = ( previous <= threshold && value > threshold );
+        slot.reference = value;
+        break;
+      case FallsBelow :
+        met = ( previous >= threshold && value < threshold );
+        slot.reference = value;
+        break;
+      case Crosses :
+        met = ( (previous <= threshold && value > threshold) || (previous >= threshold && value < threshold) );
+        slot.reference = value;
+        break;
+      default :
+        break;
+    }
+    if ( met ) {
+      notify(slot, generation, field, value, previous, info);
+    }
+  }
+}
+
+/*
+ * Hand an event to the subscriber, unless the slot has been subscribed to
+ * again since the decode stage read it.
+ */
+void FieldWatcher::notify(Slot &slot, const unsigned int &generation, const Field &field, const int &value,
+                          const int &previous, const FrameInfo &info)
+{
+  {
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    if ( slot.generation.load(std::memory_order_relaxed) != generation ) { return; }
+    if ( slot.pending ) { ++slot.missed; }
+    slot.pending = true;
+    slot.event.field = field;
+    slot.event.value = FieldWatcher::value(field, value);
+    slot.event.previous = FieldWatcher::value(field, previous);
+    slot.event.info = info;
+  }
+  slot.condition_met.notify_all();
+}
+
+} // namespace kobuki
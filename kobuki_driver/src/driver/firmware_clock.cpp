@@ -0,0 +1,169 @@
+/**
+ * @file /kobuki_driver/src/driver/firmware_clock.cpp
+ *
+ * @brief Firmware to host clock synchronisation.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <algorithm>
+#include "../../include/kobuki_driver/modules/firmware_clock.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+const int64_t nanoseconds_per_millisecond = 1000000LL;
+const int64_t time_stamp_range = 65536; // [ms], the firmware counter wraps at this
+const MonotonicTime resync_threshold = 1000000000LL; // [ns], model errors larger than this force a restart
+}
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+/**
+ * @param block_size : number of frames over which a minimum offset is taken (50 ~ 1s).
+ * @param max_blocks : number of block minima used for the drift fit (30 ~ 30s).
+ */
+FirmwareClock::FirmwareClock(const unsigned int &block_size, const unsigned int &max_blocks) :
+  block_size(std::max(block_size, 1u)),
+  max_blocks(std::max(max_blocks, 2u)),
+  blocks(std::max(max_blocks, 2u))
+{
+  reset();
+}
+
+/**
+ * Forget everything; call this when the firmware may have restarted (e.g.
+ * on reconnection).
+ */
+void FirmwareClock::reset() {
+  initialised = false;
+  last_time_stamp = 0;
+  last_receive_time = 0;
+  firmware_time = 0;
+  block_minimum.firmware_time = 0;
+  block_minimum.offset = 0;
+  block_count = 0;
+  oldest_block = 0;
+  number_of_blocks = 0;
+  fit_reference = 0;
+  fit_offset = 0.0;
+  fit_drift = 0.0;
+}
+
+/**
+ * @brief Feed the estimator with a new frame.
+ *
+ * @param time_stamp : raw firmware time stamp from the core sensors [ms].
+ * @param receive_time : host time at which the frame arrived.
+ * @return MonotonicTime : estimated host time at which the firmware stamped the frame.
+ */
+MonotonicTime FirmwareClock::update(const uint16_t &time_stamp, const MonotonicTime &receive_time) {
+  if ( !initialised ) {
+    firmware_time = time_stamp;
+    initialised = true;
+  } else {
+    int64_t delta = static_cast<uint16_t>(time_stamp - last_time_stamp);
+    // Long gaps (e.g. usb stalls) hide whole wraps of the counter, recover them from the host clock.
+    int64_t host_delta = (receive_time - last_receive_time) / nanoseconds_per_millisecond;
+    if ( host_delta > time_stamp_range / 2 ) {
+      delta += time_stamp_range * ((host_delta - delta + time_stamp_range / 2) / time_stamp_range);
+    }
+    firmware_time += delta;
+  }
+  last_time_stamp = time_stamp;
+  last_receive_time = receive_time;
+
+  Sample sample;
+  sample.firmware_time = firmware_time;
+  sample.offset = receive_time - firmware_time * nanoseconds_per_millisecond;
+
+  // Firmware restarts and host clock steps make the model useless, start again.
+  if ( number_of_blocks > 0 || block_count > 0 ) {
+    MonotonicTime error = receive_time - hostTime(firmware_time);
+    if ( error > resync_threshold || error < -resync_threshold ) {
+      reset();
+      return update(time_stamp, receive_time);
+    }
+  }
+
+  if ( block_count == 0 || sample.offset < block_minimum.offset ) {
+    block_minimum = sample;
+  }
+  if ( ++block_count >= block_size ) {
+    if ( number_of_blocks < max_blocks ) {
+      blocks[(oldest_block + number_of_blocks) % max_blocks] = block_minimum;
+      ++number_of_blocks;
+    } else {
+      blocks[oldest_block] = block_minimum;
+      oldest_block = (oldest_block + 1) % max_blocks;
+    }
+    block_count = 0;
+    fit();
+  }
+  // a frame can never be stamped after it was received
+  return std::min(hostTime(firmware_time), receive_time);
+}
+
+/**
+ * @brief Map an (unwrapped) firmware time onto host monotonic time.
+ *
+ * @param firmware_time : unwrapped firmware time [ms].
+ * @return MonotonicTime : the estimated host time.
+ */
+MonotonicTime FirmwareClock::hostTime(const int64_t &firmware_time) const {
+  MonotonicTime base = firmware_time * nanoseconds_per_millisecond;
+  if ( number_of_blocks == 0 ) {
+    return base + block_minimum.offset;
+  }
+  return base + static_cast<MonotonicTime>(fit_offset + fit_drift * static_cast<double>(firmware_time - fit_reference));
+}
+
+/**
+ * Least squares line through the block minima. Everything is computed
+ * relative to the newest block to keep the doubles well conditioned.
+ */
+void FirmwareClock::fit() {
+  const Sample &newest = blocks[(oldest_block + number_of_blocks - 1) % max_blocks];
+  fit_reference = newest.firmware_time;
+  if ( number_of_blocks < 2 ) {
+    fit_offset = static_cast<double>(newest.offset);
+    fit_drift = 0.0;
+    return;
+  }
+  double sum_x = 0.0, sum_y = 0.0, sum_xx = 0.0, sum_xy = 0.0;
+  for ( unsigned int i = 0; i < number_of_blocks; ++i ) {
+    const Sample &block = blocks[(oldest_block + i) % max_blocks];
+    double x = static_cast<double>(block.firmware_time - newest.firmware_time);
+    double y = static_cast<double>(block.offset - newest.offset);
+    sum_x += x;
+    sum_y += y;
+    sum_xx += x * x;
+    sum_xy += x * y;
+  }
+  double n = static_cast<double>(number_of_blocks);
+  double denominator = n * sum_xx - sum_x * sum_x;
+  if ( denominator <= 0.0 ) {
+    fit_offset = static_cast<double>(newest.offset);
+    fit_drift = 0.0;
+    return;
+  }
+  fit_drift = (n * sum_xy - sum_x * sum_y) / denominator;
+  fit_offset = static_cast<double>(newest.offset) + (sum_y - fit_drift * sum_x) / n;
+}
+
+} // namespace kobuki
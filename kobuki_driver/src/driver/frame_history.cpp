@@ -0,0 +1,273 @@
+/**
+ * @file /kobuki_driver/src/driver/frame_history.cpp
+ *
+ * @brief Implementation of the frame history.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cmath>
+#include <ecl/math.hpp>
+#include <ecl/geometry/angle.hpp>
+#include "../../include/kobuki_driver/frame_history.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+const double encoder_range = 65536.0; // [ticks]
+const int heading_range = 36000; // [hundredths of a degree]
+
+/*
+ * Interpolate along the shorter way round a wrapping quantity.
+ */
+double interpolateWrapped(const double &from, const double &to, const double &fraction, const double &range) {
+  double difference = std::fmod(to - from, range);
+  if ( difference > range / 2 ) { difference -= range; }
+  if ( difference < -range / 2 ) { difference += range; }
+  double value = std::fmod(from + fraction * difference, range);
+  return ( value < 0.0 ) ? value + range : value;
+}
+}
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+/**
+ * @param capacity : number of frames to keep, rounded up to a power of two (512 ~ 10s), 0 to keep none.
+ */
+FrameHistory::FrameHistory(const unsigned int &capacity) :
+  number_of_slots(0),
+  mask(0),
+  slots(NULL),
+  times(NULL),
+  added(0)
+{
+  resize(capacity);
+}
+
+FrameHistory::~FrameHistory() {
+  delete[] slots;
+  delete[] times;
+}
+
+/**
+ * @brief Change the capacity, dropping what is kept (not while frames are being added or queried).
+ *
+ * @param capacity : number of frames to keep, rounded up to a power of two, 0 to keep none.
+ */
+void FrameHistory::resize(const unsigned int &capacity) {
+  delete[] slots;
+  delete[] times;
+  slots = NULL;
+  times = NULL;
+  number_of_slots = 0;
+  mask = 0;
+  added.store(0, std::memory_order_relaxed);
+  if ( capacity == 0 ) {
+    return;
+  }
+  unsigned int size = 2;
+  while ( size < capacity ) { size <<= 1; }
+  slots = new Seqlock<Entry>[size];
+  times = new std::atomic<MonotonicTime>[size];
+  for ( unsigned int i = 0; i < size; ++i ) {
+    times[i].store(0, std::memory_order_relaxed);
+  }
+  number_of_slots = size;
+  mask = size - 1;
+}
+
+/**
+ * @brief Keep a newly published frame (only one thread may add).
+ *
+ * Frames are expected in time order, as the driver publishes them.
+ */
+void FrameHistory::add(const Frame &frame) {
+  if ( number_of_slots == 0 ) {
+    return;
+  }
+  uint64_t index = added.load(std::memory_order_relaxed);
+  Entry entry;
+  entry.index = index;
+  entry.frame = frame;
+  slots[index & mask].store(entry);
+  times[index & mask].store(timeOf(frame), std::memory_order_release);
+  added.store(index + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Number of frames currently kept.
+ */
+unsigned int FrameHistory::size() const {
+  uint64_t first, end;
+  span(first, end);
+  return static_cast<unsigned int>(end - first);
+}
+
+/**
+ * @brief Encoders and heading at the given time, interpolated between the frames either side.
+ *
+ * @param time : host monotonic time, within the span of the history (there is no extrapolation).
+ * @param sample : filled with the interpolated values.
+ * @return bool : false if the time is outside the history.
+ */
+bool FrameHistory::at(const MonotonicTime &time, Sample &sample) const {
+  uint64_t first, end;
+  span(first, end);
+  if ( first == end || time < key(first) || time > key(end - 1) ) {
+    return false;
+  }
+  uint64_t after = upperBound(time, first, end);
+  Frame before_frame, after_frame;
+  if ( !load(after - 1, before_frame) ) {
+    return false;
+  }
+  double fraction = 0.0;
+  if ( after == end ) {
+    after_frame = before_frame; // exactly on the newest frame
+  } else {
+    if ( !load(after, after_frame) ) {
+      return false;
+    }
+    MonotonicTime interval = timeOf(after_frame) - timeOf(before_frame);
+    if ( interval > 0 ) {
+      fraction = static_cast<double>(time - timeOf(before_frame)) / static_cast<double>(interval);
+    }
+  }
+  sample.time = time;
+  sample.left_encoder = interpolateWrapped(before_frame.core_sensors.left_encoder, after_frame.core_sensors.left_encoder,
+                                           fraction, encoder_range);
+  sample.right_encoder = interpolateWrapped(before_frame.core_sensors.right_encoder, after_frame.core_sensors.right_encoder,
+                                            fraction, encoder_range);
+  double heading = interpolateWrapped(before_frame.inertia.angle, after_frame.inertia.angle, fraction, heading_range);
+  sample.heading = ecl::wrap_angle(heading / 100.0 * ecl::pi / 180.0);
+  return true;
+}
+
+/**
+ * @brief The frame closest in time to the given time.
+ *
+ * @param time : host monotonic time.
+ * @param frame : filled with the closest frame.
+ * @return bool : false if the history is empty.
+ */
+bool FrameHistory::nearest(const MonotonicTime &time, Frame &frame) const {
+  uint64_t first, end;
+  span(first, end);
+  if ( first == end ) {
+    return false;
+  }
+  uint64_t after = lowerBound(time, first, end);
+  uint64_t index;
+  if ( after == first ) {
+    index = first;
+  } else if ( after == end ) {
+    index = end - 1;
+  } else {
+    index = ( key(after) - time < time - key(after - 1) ) ? after : after - 1;
+  }
+  return load(index, frame);
+}
+
+/**
+ * @brief All frames in the time interval [begin, end], oldest first.
+ *
+ * Reserve the vector up front to keep this from allocating.
+ *
+ * @param begin : host monotonic time.
+ * @param end : host monotonic time.
+ * @param frames : cleared and filled with the frames.
+ * @return unsigned int : number of frames found.
+ */
+unsigned int FrameHistory::range(const MonotonicTime &begin, const MonotonicTime &end, std::vector<Frame> &frames) const {
+  frames.clear();
+  uint64_t first, last;
+  span(first, last);
+  uint64_t from = lowerBound(begin, first, last);
+  uint64_t to = upperBound(end, first, last);
+  Frame frame;
+  for ( uint64_t index = from; index < to; ++index ) {
+    if ( load(index, frame) ) {
+      frames.push_back(frame);
+    }
+  }
+  return static_cast<unsigned int>(frames.size());
+}
+
+/**
+ * @brief The time a frame is filed under: its host time, or its receive time if it had no time stamp.
+ */
+MonotonicTime FrameHistory::timeOf(const Frame &frame) {
+  return ( frame.info.host_time != 0 ) ? frame.info.host_time : frame.info.receive_time;
+}
+
+/*
+ * Positions [first, end) of the frames that can be read. The oldest slot is
+ * left out as it is the next one to be overwritten.
+ */
+void FrameHistory::span(uint64_t &first, uint64_t &end) const {
+  end = added.load(std::memory_order_acquire);
+  if ( number_of_slots == 0 ) {
+    first = end; // nothing kept
+    return;
+  }
+  first = ( end >= number_of_slots ) ? end - number_of_slots + 1 : 0;
+}
+
+/*
+ * First position in [first, end) with a time at or after the given time.
+ */
+uint64_t FrameHistory::lowerBound(const MonotonicTime &time, uint64_t first, uint64_t end) const {
+  while ( first < end ) {
+    uint64_t middle = first + (end - first) / 2;
+    if ( key(middle) < time ) {
+      first = middle + 1;
+    } else {
+      end = middle;
+    }
+  }
+  return first;
+}
+
+/*
+ * First position in [first, end) with a time after the given time.
+ */
+uint64_t FrameHistory::upperBound(const MonotonicTime &time, uint64_t first, uint64_t end) const {
+  while ( first < end ) {
+    uint64_t middle = first + (end - first) / 2;
+    if ( key(middle) <= time ) {
+      first = middle + 1;
+    } else {
+      end = middle;
+    }
+  }
+  return first;
+}
+
+/*
+ * The frame at a position, false if it has been overwritten since.
+ */
+bool FrameHistory::load(const uint64_t &index, Frame &frame) const {
+  Entry entry = slots[index & mask].load();
+  if ( entry.index != index ) {
+    return false;
+  }
+  frame = entry.frame;
+  return true;
+}
+
+} // namespace kobuki
@@ -0,0 +1,50 @@
+/**
+ * @file /kobuki_driver/src/driver/frame_info.cpp
+ *
+ * @brief Host monotonic clock implementation.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <ecl/config.hpp>
+#include "../../include/kobuki_driver/frame_info.hpp"
+
+#ifdef ECL_IS_WIN32
+  #include <windows.h>
+#else
+  #include <time.h>
+#endif
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+MonotonicTime monotonicNow() {
+#ifdef ECL_IS_WIN32
+  static LARGE_INTEGER frequency = { 0 };
+  if ( frequency.QuadPart == 0 ) {
+    QueryPerformanceFrequency(&frequency);
+  }
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return static_cast<MonotonicTime>(counter.QuadPart / frequency.QuadPart) * 1000000000LL
+       + static_cast<MonotonicTime>(counter.QuadPart % frequency.QuadPart) * 1000000000LL / frequency.QuadPart;
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<MonotonicTime>(now.tv_sec) * 1000000000LL + static_cast<MonotonicTime>(now.tv_nsec);
+#endif
+}
+
+} // namespace kobuki
@@ -0,0 +1,154 @@
+/**
+ * @file /kobuki_driver/src/driver/frame_loss_monitor.cpp
+ *
+ * @brief Implementation of the frame loss monitor.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <sstream>
+#include "../../include/kobuki_driver/frame_loss_monitor.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+const MonotonicTime nanoseconds_per_second = 1000000000LL;
+const int64_t maximum_plausible_gap = 65536; // [ms], longer steps are a restarted clock rather than lost frames
+}
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+void FrameLossMonitor::reset() {
+  previous_firmware_time = -1;
+  frames_received.store(0, std::memory_order_relaxed);
+  frames_lost.store(0, std::memory_order_relaxed);
+  maximum_gap.store(0, std::memory_order_relaxed);
+  for ( unsigned int i = 0; i < window; ++i ) {
+    seconds[i].second.store(-1, std::memory_order_relaxed);
+    seconds[i].received.store(0, std::memory_order_relaxed);
+    seconds[i].lost.store(0, std::memory_order_relaxed);
+  }
+}
+
+/**
+ * @brief Account for a newly decoded frame (decode stage only).
+ *
+ * Call resync() beforehand if the connection was lost since the previous
+ * frame - the firmware may have restarted and its time with it.
+ *
+ * @param firmware_time : unwrapped firmware time of the frame [ms], see FirmwareClock.
+ * @param host_time : host time of the frame, for the per minute rates.
+ * @return unsigned int : stream periods since the previous frame, 1 unless frames were lost.
+ */
+unsigned int FrameLossMonitor::update(const int64_t &firmware_time, const MonotonicTime &host_time) {
+  unsigned int periods = 1;
+  if ( previous_firmware_time >= 0 ) {
+    int64_t gap = firmware_time - previous_firmware_time;
+    if ( gap > 0 && gap < maximum_plausible_gap ) {
+      if ( gap > maximum_gap.load(std::memory_order_relaxed) ) {
+        maximum_gap.store(gap, std::memory_order_relaxed);
+      }
+      int64_t steps = (gap + stream_period / 2) / stream_period;
+      if ( steps > 1 ) {
+        periods = static_cast<unsigned int>(steps);
+      }
+    }
+  }
+  previous_firmware_time = firmware_time;
+
+  unsigned long missing = periods - 1;
+  frames_received.fetch_add(1, std::memory_order_relaxed);
+  frames_lost.fetch_add(missing, std::memory_order_relaxed);
+
+  int64_t second = host_time / nanoseconds_per_second;
+  Second &bucket = seconds[second % window];
+  if ( bucket.second.load(std::memory_order_relaxed) != second ) {
+    bucket.received.store(0, std::memory_order_relaxed);
+    bucket.lost.store(0, std::memory_order_relaxed);
+    bucket.second.store(second, std::memory_order_release);
+  }
+  bucket.received.fetch_add(1, std::memory_order_relaxed);
+  bucket.lost.fetch_add(missing, std::memory_order_relaxed);
+  return periods;
+}
+
+/**
+ * @brief Frames decoded and lost over the last minute, summed in one pass.
+ *
+ * The minute is the current second and the window - 1 before it.
+ */
+void FrameLossMonitor::lastMinute(const MonotonicTime &now, unsigned long &received, unsigned long &lost) const {
+  int64_t first_second = now / nanoseconds_per_second - (window - 1);
+  received = 0;
+  lost = 0;
+  for ( unsigned int i = 0; i < window; ++i ) {
+    if ( seconds[i].second.load(std::memory_order_acquire) >= first_second ) {
+      received += seconds[i].received.load(std::memory_order_relaxed);
+      lost += seconds[i].lost.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+/**
+ * @brief Frames decoded over the last minute.
+ *
+ * @param now : current host time, e.g. monotonicNow().
+ */
+unsigned long FrameLossMonitor::receivedLastMinute(const MonotonicTime &now) const {
+  unsigned long received, lost;
+  lastMinute(now, received, lost);
+  return received;
+}
+
+/**
+ * @brief Frames lost over the last minute.
+ *
+ * @param now : current host time, e.g. monotonicNow().
+ */
+unsigned long FrameLossMonitor::lostLastMinute(const MonotonicTime &now) const {
+  unsigned long received, lost;
+  lastMinute(now, received, lost);
+  return lost;
+}
+
+/**
+ * @brief Fraction of the frames the firmware sent over the last minute that never got decoded.
+ *
+ * @param now : current host time, e.g. monotonicNow().
+ */
+double FrameLossMonitor::lossRate(const MonotonicTime &now) const {
+  unsigned long received, lost;
+  lastMinute(now, received, lost);
+  return lossRate(received, lost);
+}
+
+double FrameLossMonitor::lossRate(const unsigned long &received, const unsigned long &lost) {
+  return ( received + lost == 0 ) ? 0.0 : static_cast<double>(lost) / static_cast<double>(received + lost);
+}
+
+std::string FrameLossMonitor::toString(const MonotonicTime &now) const {
+  unsigned long received_last_minute, lost_last_minute;
+  lastMinute(now, received_last_minute, lost_last_minute); // one pass, so the figures agree with each other
+  std::ostringstream ostream;
+  ostream << "received " << received() << ", lost " << lost() << ", max gap " << maximumGap() << "ms";
+  ostream << ", last minute: lost " << lost_last_minute << "/" << received_last_minute + lost_last_minute;
+  ostream << " (" << lossRate(received_last_minute, lost_last_minute) * 100.0 << "%)";
+  return ostream.str();
+}
+
+} // namespace kobuki
@@ -10,17 +10,19 @@
  ** Includes
  *****************************************************************************/
 
+#include <algorithm>
 #include <cmath>
 #include <ecl/math.hpp>
 #include <ecl/geometry/angle.hpp>
-#include <ecl/time/sleep.hpp>
 #include <ecl/converters.hpp>
 #include <ecl/sigslots.hpp>
 #include <ecl/geometry/angle.hpp>
 #include <ecl/time/timestamp.hpp>
 #include <stdexcept>
+#include <chrono>
 #include "../../include/kobuki_driver/kobuki.hpp"
 #include "../../include/kobuki_driver/packet_handler/payload_headers.hpp"
+#include "../../include/kobuki_driver/scheduling.hpp"
 
 /*****************************************************************************
  ** Namespaces
@@ -44,19 +46,54 @@ bool PacketFinder::checkSum()
   return cs ? false : true;
 }
 
+/**
+ * @brief Copy out the bytes of the packet just found.
+ *
+ * @param bytes : destination.
+ * @param capacity : size of the destination.
+ * @return unsigned int : number of bytes copied.
+ */
+unsigned int PacketFinder::copyBuffer(unsigned char *bytes, const unsigned int &capacity) const
+{
+  unsigned int size = buffer.size();
+  if ( size > capacity ) { size = capacity; }
+  for (unsigned int i = 0; i < size; i++)
+  {
+    bytes[i] = buffer[i];
+  }
+  return size;
+}
+
 /*****************************************************************************
  ** Implementation [Initialisation]
  *****************************************************************************/
 
 Kobuki::Kobuki() :
     shutdown_requested(false)
+    , reconnect_requested(false)
+    , io_running(false)
     , is_enabled(false)
+    , heading_offset(0.0/0.0)
     , is_connected(false)
+    , odometry_firmware_time(-1)
+    , raw_buffer(RawFrame::max_size)
+    , data_buffer(RawFrame::max_size)
     , is_alive(false)
     , version_info_reminder(0)
     , controller_info_reminder(0)
-    , heading_offset(0.0/0.0)
+    , resync_pending(true)
+    , frames_dropped(0)
+    , locked_frame()
+    , data_access_holder(std::thread::id())
+    , decoded_frames(0)
+    , published_sequence(0)
+    , transmit_requested(false)
+    , transmit_shutdown_requested(false)
+    , last_frame_time(0)
+    , last_measured_frame_time(0)
+    , sub_payload_buffer(32)
     , velocity_commands_debug(4, 0)
+    , raw_sigslots(true)
 {
 }
 
@@ -66,21 +103,37 @@ Kobuki::Kobuki() :
 Kobuki::~Kobuki()
 {
   disable();
-  shutdown_requested = true; // thread's spin() will catch this and terminate
+  shutdown(); // wakes spin() up and waits for it to terminate
   thread.join();
+  decode_thread.join(); // spin() interrupts the decode stage on its way out, which in turn interrupts the publish stage
+  publish_thread.join();
+  {
+    std::lock_guard<std::mutex> lock(transmit_mutex);
+    transmit_shutdown_requested = true; // transmit() flushes anything left (e.g. the stop command) and terminates
+  }
+  transmit_condition.notify_one();
+  transmit_thread.join();
+  callback_pool.stop();
   sig_debug.emit("Device: kobuki driver terminated.");
 }
 
-void Kobuki::init(Parameters &parameters) throw (ecl::StandardException)
+void Kobuki::init(Parameters &parameters)
 {
 
   if (!parameters.validate())
   {
-    throw ecl::StandardException(LOC, ecl::ConfigurationError, "Kobuki's parameter settings did not validate.");
+    throw ecl::StandardException(LOC, ecl::ConfigurationError, "Kobuki's parameter settings did not validate [" + parameters.error_msg + "].");
   }
   this->parameters = parameters;
   std::string sigslots_namespace = parameters.sigslots_namespace;
-  event_manager.init(sigslots_namespace);
+  slot_monitor.init(sigslots_namespace, parameters.slot_budget);
+  event_manager.init(sigslots_namespace, &slot_monitor, &loop_profiler, parameters.enable_single_events);
+  if ( parameters.enable_profiler ) {
+    loop_profiler.enable();
+  }
+  raw_sigslots.store(parameters.enable_raw_sigslots, std::memory_order_relaxed);
+  frame_history.resize(parameters.history_size);
+  state_extrapolator.configure(parameters.extrapolation_model, parameters.extrapolation_horizon);
 
   // connect signals
   sig_version_info.connect(sigslots_namespace + std::string("/version_info"));
@@ -97,6 +150,13 @@ void Kobuki::init(Parameters &parameters) throw (ecl::StandardException)
   sig_error.connect(sigslots_namespace + std::string("/ros_error"));
   sig_named.connect(sigslots_namespace + std::string("/ros_named"));
 
+  if ( !parameters.shared_memory_name.empty() ) {
+    std::string error;
+    if ( !shared_frames.open(parameters.shared_memory_name, parameters.shared_memory_frames, error) ) {
+      sig_warn.emit("could not publish frames to shared memory " + parameters.shared_memory_name + " [" + error + "].");
+    }
+  }
+
   try {
     serial.open(parameters.device_port, ecl::BaudRate_115200, ecl::DataBits_8, ecl::StopBits_1, ecl::NoParity);  // this will throw exceptions - NotFoundError, OpenError
     is_connected = true;
@@ -136,6 +196,20 @@ void Kobuki::init(Parameters &parameters) throw (ecl::StandardException)
   sendCommand(Command::GetControllerGain());
   //sig_controller_info.emit(); //emit default gain
 
+  if ( parameters.lock_memory ) {
+    std::string error;
+    if ( lockProcessMemory(error) ) {
+      sig_info.emit("locked the process memory.");
+    } else {
+      sig_warn.emit("could not lock the process memory, page faults may stall the driver [" + error + "].");
+    }
+  }
+  callback_pool.start(parameters.callback_threads);
+  transmit_thread.start(&Kobuki::transmit, *this);
+  if ( parameters.enable_staged_pipeline ) {
+    publish_thread.start(&Kobuki::spinPublish, *this);
+    decode_thread.start(&Kobuki::spinDecode, *this);
+  }
   thread.start(&Kobuki::spin, *this);
 }
 
@@ -149,12 +223,21 @@ void Kobuki::init(Parameters &parameters) throw (ecl::StandardException)
  * reading thread (aye, convoluted - apologies for the multiple robot and multiple
  * developer adhoc hacking over 4-5 years for hasty demos on pre-kobuki robots.
  * This has generated such wonderful spaghetti ;).
+ * With the staged pipeline, the slots run in the publish stage's thread instead,
+ * but the same holds.
  *
- * If instead you just want to poll kobuki, then you should lock and unlock
- * the data access around any getXXX calls.
+ * If instead you just want to poll kobuki, the getters are safe to call from
+ * any thread - each frame is published as a whole (see Seqlock) and every
+ * getXXX call returns data from a single frame without taking a lock. Only
+ * successive calls may straddle two frames. Either use getFrame(), or lock
+ * and unlock the data access around the getXXX calls: this pins the latest
+ * frame for the calling thread until it unlocks. The driver never waits on
+ * this lock, so holding it only holds up other threads that lock it.
  */
 void Kobuki::lockDataAccess() {
   data_mutex.lock();
+  locked_frame = published_frame.load();
+  data_access_holder.store(std::this_thread::get_id(), std::memory_order_relaxed);
 }
 
 /**
@@ -162,23 +245,45 @@ void Kobuki::lockDataAccess() {
  * @sa lockDataAccess()
  */
 void Kobuki::unlockDataAccess() {
+  data_access_holder.store(std::thread::id(), std::memory_order_relaxed);
   data_mutex.unlock();
 }
 
+/**
+ * The frame the getters read from: the one pinned by lockDataAccess() if the
+ * calling thread holds it, otherwise the latest published.
+ */
+Frame Kobuki::snapshot() const {
+  if ( data_access_holder.load(std::memory_order_relaxed) == std::this_thread::get_id() ) {
+    return locked_frame;
+  }
+  return published_frame.load();
+}
+
 /**
  * @brief Performs a scan looking for incoming data packets.
  *
  * Sits on the device waiting for incoming and then parses it, and signals
- * that an update has occured.
+ * that an update has occured. With the staged pipeline this is only the io
+ * stage - the frames it finds are handed to spinDecode() and spinPublish().
  *
  * Or, if in simulation, just loopsback the motor devices.
  */
 
 void Kobuki::spin()
 {
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex);
+    io_interrupter.registerCurrentThread();
+    io_running = true;
+  }
   ecl::TimeStamp last_signal_time;
   ecl::Duration timeout(0.1);
   unsigned char buf[256];
+  MonotonicTime read_time = 0; // when the last serial read returned
+  MonotonicTime frame_start_time = 0; // when the read that delivered the first byte of the current frame returned
+
+  configureThread("io", parameters.io_stage_cpu);
 
   /*********************
    ** Simulation Params
@@ -189,6 +294,13 @@ void Kobuki::spin()
     /*********************
      ** Checking Connection
      **********************/
+    if ( reconnect_requested.exchange(false) && serial.open() ) {
+      serial.close();
+      is_connected = false;
+      is_alive = false;
+      event_manager.update(is_connected, is_alive);
+      sig_info.emit("device closed for reconnection.");
+    }
     if ( !serial.open() ) {
       try {
         // this will throw exceptions - NotFoundError is the important one, handle it
@@ -199,6 +311,7 @@ void Kobuki::spin()
         event_manager.update(is_connected, is_alive);
         version_info_reminder = 10;
         controller_info_reminder = 10;
+        resync_pending = true;
       }
       catch (const ecl::StandardException &e)
       {
@@ -211,7 +324,11 @@ void Kobuki::spin()
           // This is bad - some unknown error we're not handling! But at least throw and show what error we came across.
           throw ecl::StandardException(LOC, e);
         }
-        ecl::Sleep(5)(); // five seconds
+        {
+          // five seconds, unless shutdown() or reconnect() cut it short
+          std::unique_lock<std::mutex> lock(wake_mutex);
+          wake_condition.wait_for(lock, std::chrono::seconds(5), [this] { return shutdown_requested || reconnect_requested; });
+        }
         is_connected = false;
         is_alive = false;
         continue;
@@ -221,7 +338,18 @@ void Kobuki::spin()
     /*********************
      ** Read Incoming
      **********************/
-    int n = serial.read((char*)buf, packet_finder.numberOfDataToRead());
+    int n;
+    {
+      Profiler::Scope scope(&loop_profiler, Profiler::Read);
+      ThreadInterrupter::BlockingCall interruptible(io_interrupter); // shutdown() and reconnect() signal only in here
+      n = serial.read((char*)buf, packet_finder.numberOfDataToRead());
+    }
+    read_time = monotonicNow();
+    if (n < 0)
+    {
+      if (shutdown_requested || reconnect_requested) { continue; } // interrupted on purpose
+      n = 0; // a read error, deal with it as with a timeout
+    }
     if (n == 0)
     {
       if (is_alive && ((ecl::TimeStamp() - last_signal_time) > timeout))
@@ -229,140 +357,69 @@ void Kobuki::spin()
         is_alive = false;
         version_info_reminder = 10;
         controller_info_reminder = 10;
+        resync_pending = true; // the firmware may be rebooting
         sig_debug.emit("Timed out while waiting for incoming bytes.");
       }
       event_manager.update(is_connected, is_alive);
       continue;
     }
-    else
+    else if ( raw_sigslots.load(std::memory_order_relaxed) )
     {
+      Profiler::Scope scope(&loop_profiler, Profiler::DebugLog);
       std::ostringstream ostream;
       ostream << "kobuki_node : serial_read(" << n << ")"
         << ", packet_finder.numberOfDataToRead(" << packet_finder.numberOfDataToRead() << ")";
       //sig_debug.emit(ostream.str());
       sig_named.emit(log("debug", "serial", ostream.str()));
-      // might be useful to send this to a topic if there is subscribers
     }
 
-    if (packet_finder.update(buf, n)) // this clears packet finder's buffer and transfers important bytes into it
+    bool found_packet;
     {
-      PacketFinder::BufferType local_buffer;
-      packet_finder.getBuffer(local_buffer); // get a reference to packet finder's buffer.
-      sig_raw_data_stream.emit(local_buffer);
-
-      packet_finder.getPayload(data_buffer);// get a reference to packet finder's buffer.
+      Profiler::Scope scope(&loop_profiler, Profiler::Framing);
+      found_packet = packet_finder.update(buf, n); // this clears packet finder's buffer and transfers important bytes into it
+    }
+    // The packet finder reads byte by byte while hunting for the stx, so the
+    // last read that leaves it still hunting is the one that delivered the
+    // first byte of the next frame.
+    if (packet_finder.state == PacketFinderBase::waitingForStx)
+    {
+      frame_start_time = read_time;
+    }
 
-      lockDataAccess();
-      while (data_buffer.size() > 0)
-      {
-        //std::cout << "header_id: " << (unsigned int)data_buffer[0] << " | ";
-        //std::cout << "length: " << (unsigned int)data_buffer[1] << " | ";
-        //std::cout << "remains: " << data_buffer.size() << " | ";
-        //std::cout << "local_buffer: " << local_buffer.size() << " | ";
-        //std::cout << std::endl;
-        switch (data_buffer[0])
-        {
-          // these come with the streamed feedback
-          case Header::CoreSensors:
-            if( !core_sensors.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
-            event_manager.update(core_sensors.data, cliff.data.bottom);
-            break;
-          case Header::DockInfraRed:
-            if( !dock_ir.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
-            break;
-          case Header::Inertia:
-            if( !inertia.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
-
-            // Issue #274: use first imu reading as zero heading; update when reseting odometry
-            if (std::isnan(heading_offset) == true)
-              heading_offset = (static_cast<double>(inertia.data.angle) / 100.0) * ecl::pi / 180.0;
-            break;
-          case Header::Cliff:
-            if( !cliff.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
-            break;
-          case Header::Current:
-            if( !current.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
-            break;
-          case Header::GpInput:
-            if( !gp_input.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
-            event_manager.update(gp_input.data.digital_input);
-            break;
-          case Header::ThreeAxisGyro:
-            if( !three_axis_gyro.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
-            break;
-          // the rest are only included on request
-          case Header::Hardware:
-            if( !hardware.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
-            //sig_version_info.emit(VersionInfo(firmware.data.version, hardware.data.version));
-            break;
-          case Header::Firmware:
-            if( !firmware.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
-            try
-            {
-              // Check firmware/driver compatibility; major version must be the same
-              int version_match = firmware.check_major_version();
-              if (version_match < 0) {
-                sig_error.emit("Robot firmware is outdated and needs to be upgraded. Consult how-to on: " \
-                               "http://kobuki.yujinrobot.com/home-en/documentation/howtos/upgrading-firmware");
-                sig_error.emit("Robot firmware version is " + VersionInfo::toString(firmware.data.version)
-                             + "; latest version is " + firmware.current_version());
-                shutdown_requested = true;
-              }
-              else if (version_match > 0) {
-                sig_error.emit("Driver version isn't not compatible with robot firmware. Please upgrade driver");
-                shutdown_requested = true;
-              }
-              else
-              {
-                // And minor version don't need to, but just make a suggestion
-                version_match = firmware.check_minor_version();
-                if (version_match < 0) {
-                  sig_warn.emit("Robot firmware is outdated; we suggest you to upgrade it " \
-                                "to benefit from the latest features. Consult how-to on: "  \
-                                "http://kobuki.yujinrobot.com/home-en/documentation/howtos/upgrading-firmware");
-                  sig_warn.emit("Robot firmware version is " + VersionInfo::toString(firmware.data.version)
-                              + "; latest version is " + firmware.current_version());
-                }
-                else if (version_match > 0) {
-                  // Driver version is outdated; maybe we should also suggest to upgrade it, but this is not a typical case
-                }
-              }
-            }
-            catch (std::out_of_range& e)
-            {
-              // Wrong version hardcoded on firmware; lowest value is 10000
-              sig_error.emit(std::string("Invalid firmware version number: ").append(e.what()));
-              shutdown_requested = true;
-            }
-            break;
-          case Header::UniqueDeviceID:
-            if( !unique_device_id.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
-            sig_version_info.emit( VersionInfo( firmware.data.version, hardware.data.version
-                , unique_device_id.data.udid0, unique_device_id.data.udid1, unique_device_id.data.udid2 ));
-            sig_info.emit("Version info - Hardware: " + VersionInfo::toString(hardware.data.version)
-                                     + ". Firmware: " + VersionInfo::toString(firmware.data.version));
-            version_info_reminder = 0;
-            break;
-          case Header::ControllerInfo:
-            if( !controller_info.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
-            sig_controller_info.emit();
-            controller_info_reminder = 0;
-            break;
-          default: // in the case of unknown or mal-formed sub-payload
-            fixPayload(data_buffer);
-            break;
-        }
+    if (found_packet)
+    {
+      RawFrame *raw_frame = raw_frames.claim();
+      if ( raw_frame != NULL ) {
+        raw_frame->receive_time = frame_start_time;
+        raw_frame->resync = resync_pending;
+        raw_frame->size = packet_finder.copyBuffer(raw_frame->bytes, RawFrame::max_size);
+        raw_frames.publish();
+        resync_pending = false;
+      } else {
+        frames_dropped.fetch_add(1, std::memory_order_relaxed); // decode stage is falling behind
       }
-      //std::cout << "---" << std::endl;
-      unlockDataAccess();
 
       is_alive = true;
       event_manager.update(is_connected, is_alive);
       last_signal_time.stamp();
-      sig_stream_data.emit();
-      sendBaseControlCommand(); // send the command packet to mainboard;
-      if( version_info_reminder/*--*/ > 0 ) sendCommand(Command::GetVersionInfo());
-      if( controller_info_reminder/*--*/ > 0 ) sendCommand(Command::GetControllerGain());
+
+      if ( !parameters.enable_staged_pipeline ) {
+        // run the remaining stages right here, in the order the driver always has
+        for ( RawFrame *raw = raw_frames.front(); raw != NULL; raw = raw_frames.front() ) {
+          decodeFrame(*raw);
+          raw_frames.release();
+        }
+        if ( parameters.base_control_timing != BaseControlAfterCallbacks ) {
+          sendCycleCommands(); // don't let the user's slots hold up the command packet
+        }
+        for ( Frame *frame = frames.front(); frame != NULL; frame = frames.front() ) {
+          publishFrame(*frame);
+          frames.release();
+        }
+        if ( parameters.base_control_timing == BaseControlAfterCallbacks ) {
+          sendCycleCommands(); // send the command packet to mainboard;
+        }
+      }
     }
     else
     {
@@ -374,9 +431,369 @@ void Kobuki::spin()
       }
     }
   }
+  raw_frames.interrupt(); // let the decode stage drain and follow us out
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex);
+    io_interrupter.unregisterCurrentThread();
+    io_running = false;
+  }
+  wake_condition.notify_all();
   sig_error.emit("Driver worker thread shutdown!");
 }
 
+/**
+ * @brief Terminate the worker thread.
+ *
+ * Wakes the worker thread out of a blocking serial read or the wait between
+ * reconnection attempts and returns once it has left spin(), usually well
+ * within a millisecond. Called from one of the driver's own slots, it only
+ * flags the request - the thread terminates once the slot returns.
+ */
+void Kobuki::shutdown()
+{
+  shutdown_requested = true;
+  if ( io_interrupter.isCurrentThread() ) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(wake_mutex);
+  wake_condition.notify_all();
+  while ( io_running ) {
+    if ( io_interrupter.available() ) {
+      // keep at it, a signal that lands just before the read starts is lost;
+      // outside the read (e.g. in the user's slots) this does nothing and
+      // the thread sees the flag once they return
+      io_interrupter.interrupt();
+      wake_condition.wait_for(lock, std::chrono::microseconds(100));
+    } else {
+      wake_condition.wait(lock); // the read has to run to its timeout
+    }
+  }
+}
+
+/**
+ * @brief Close and reopen the serial connection right away.
+ *
+ * Useful when the device is known to have come back (e.g. on a udev
+ * notification) - otherwise the driver only retries every five seconds.
+ * Does not wait for the reconnection to happen.
+ */
+void Kobuki::reconnect()
+{
+  reconnect_requested = true;
+  std::lock_guard<std::mutex> lock(wake_mutex);
+  io_interrupter.interrupt();
+  wake_condition.notify_all();
+}
+
+/**
+ * @brief Worker loop of the decode stage (staged pipeline only).
+ *
+ * Turns the raw frames found by spin() into frame snapshots for the publish
+ * stage. The base control command goes out from here as soon as a frame is
+ * decoded, so it never waits on the user's callbacks.
+ */
+void Kobuki::spinDecode()
+{
+  configureThread("decode", parameters.decode_stage_cpu);
+  RawFrame *raw_frame;
+  while ( (raw_frame = raw_frames.wait()) != NULL )
+  {
+    decodeFrame(*raw_frame);
+    raw_frames.release();
+    sendCycleCommands();
+  }
+  frames.interrupt();
+}
+
+/**
+ * @brief Worker loop of the publish stage (staged pipeline only).
+ *
+ * Hands the decoded frames to the getters and runs the user's slots.
+ */
+void Kobuki::spinPublish()
+{
+  configureThread("publish", parameters.publish_stage_cpu);
+  Frame *frame;
+  while ( (frame = frames.wait()) != NULL )
+  {
+    publishFrame(*frame);
+    frames.release();
+  }
+}
+
+/**
+ * @brief Decode stage: dispatch the sub-payloads of a frame.
+ *
+ * Updates the packet structures, raises the events and checks the field
+ * subscriptions, then queues a snapshot of the result for the publish stage.
+ *
+ * @param raw_frame : bytes of the frame as found by the packet finder.
+ */
+void Kobuki::decodeFrame(const RawFrame &raw_frame)
+{
+  Profiler::Scope decode_scope(&loop_profiler, Profiler::Decode);
+  if ( wanted(kobuki_callbacks.raw_data_stream) ) {
+    raw_buffer.clear();
+    for (unsigned int i = 0; i < raw_frame.size; ++i) {
+      raw_buffer.push_back(raw_frame.bytes[i]);
+    }
+    Profiler::Scope scope(&loop_profiler, Profiler::emitStage(SlotMonitor::RawDataStreamSlots));
+    MonotonicTime start_time = monotonicNow();
+    if ( raw_sigslots.load(std::memory_order_relaxed) ) { sig_raw_data_stream.emit(raw_buffer); }
+    kobuki_callbacks.raw_data_stream.emit(raw_buffer);
+    slot_monitor.record(SlotMonitor::RawDataStreamSlots, start_time);
+  }
+
+  if ( raw_frame.resync ) {
+    firmware_clock.reset();
+    frame_loss.resync();
+  }
+  last_frame_time.store(raw_frame.receive_time, std::memory_order_relaxed);
+  // strip the stx, length and checksum
+  data_buffer.clear();
+  for (unsigned int i = 3; i + 1 < raw_frame.size; ++i) {
+    data_buffer.push_back(raw_frame.bytes[i]);
+  }
+
+  FrameInfo frame_info;
+  frame_info.sequence = ++decoded_frames;
+  frame_info.receive_time = raw_frame.receive_time;
+  uint32_t payloads = 0;
+  while (data_buffer.size() > 0)
+  {
+    //std::cout << "header_id: " << (unsigned int)data_buffer[0] << " | ";
+    //std::cout << "length: " << (unsigned int)data_buffer[1] << " | ";
+    //std::cout << "remains: " << data_buffer.size() << " | ";
+    //std::cout << std::endl;
+    Profiler::Scope payload_scope(&loop_profiler, Profiler::payloadStage(data_buffer[0]));
+    switch (data_buffer[0])
+    {
+      // these come with the streamed feedback
+      case Header::CoreSensors:
+        if( !core_sensors.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
+        payloads |= 1u << Header::CoreSensors;
+        frame_info.host_time = firmware_clock.update(core_sensors.data.time_stamp, frame_info.receive_time);
+        frame_info.firmware_time = firmware_clock.firmwareTime();
+        frame_info.periods = frame_loss.update(frame_info.firmware_time, frame_info.host_time);
+        {
+          Profiler::Scope scope(&loop_profiler, Profiler::EventManagerUpdate);
+          event_manager.update(core_sensors.data, cliff.data.bottom);
+        }
+        break;
+      case Header::DockInfraRed:
+        if( !dock_ir.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
+        payloads |= 1u << Header::DockInfraRed;
+        break;
+      case Header::Inertia:
+        if( !inertia.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
+        payloads |= 1u << Header::Inertia;
+
+        // Issue #274: use first imu reading as zero heading; update when reseting odometry
+        {
+          double unset = heading_offset.load();
+          if (std::isnan(unset) == true) // only if resetOdometry() hasn't set it meanwhile
+            heading_offset.compare_exchange_strong(unset, (static_cast<double>(inertia.data.angle) / 100.0) * ecl::pi / 180.0);
+        }
+        break;
+      case Header::Cliff:
+        if( !cliff.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
+        payloads |= 1u << Header::Cliff;
+        break;
+      case Header::Current:
+        if( !current.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
+        payloads |= 1u << Header::Current;
+        break;
+      case Header::GpInput:
+        if( !gp_input.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
+        payloads |= 1u << Header::GpInput;
+        {
+          Profiler::Scope scope(&loop_profiler, Profiler::EventManagerUpdate);
+          event_manager.update(gp_input.data.digital_input);
+        }
+        break;
+      case Header::ThreeAxisGyro:
+        if( !three_axis_gyro.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
+        payloads |= 1u << Header::ThreeAxisGyro;
+        break;
+      // the rest are only included on request
+      case Header::Hardware:
+        if( !hardware.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
+        payloads |= 1u << Header::Hardware;
+        //sig_version_info.emit(VersionInfo(firmware.data.version, hardware.data.version));
+        break;
+      case Header::Firmware:
+        if( !firmware.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
+        payloads |= 1u << Header::Firmware;
+        try
+        {
+          // Check firmware/driver compatibility; major version must be the same
+          int version_match = firmware.check_major_version();
+          if (version_match < 0) {
+            sig_error.emit("Robot firmware is outdated and needs to be upgraded. Consult how-to on: " \
+                           "http://kobuki.yujinrobot.com/home-en/documentation/howtos/upgrading-firmware");
+            sig_error.emit("Robot firmware version is " + VersionInfo::toString(firmware.data.version)
+                         + "; latest version is " + firmware.current_version());
+            shutdown_requested = true;
+          }
+          else if (version_match > 0) {
+            sig_error.emit("Driver version isn't not compatible with robot firmware. Please upgrade driver");
+            shutdown_requested = true;
+          }
+          else
+          {
+            // And minor version don't need to, but just make a suggestion
+            version_match = firmware.check_minor_version();
+            if (version_match < 0) {
+              sig_warn.emit("Robot firmware is outdated; we suggest you to upgrade it " \
+                            "to benefit from the latest features. Consult how-to on: "  \
+                            "http://kobuki.yujinrobot.com/home-en/documentation/howtos/upgrading-firmware");
+              sig_warn.emit("Robot firmware version is " + VersionInfo::toString(firmware.data.version)
+                          + "; latest version is " + firmware.current_version());
+            }
+            else if (version_match > 0) {
+              // Driver version is outdated; maybe we should also suggest to upgrade it, but this is not a typical case
+            }
+          }
+        }
+        catch (std::out_of_range& e)
+        {
+          // Wrong version hardcoded on firmware; lowest value is 10000
+          sig_error.emit(std::string("Invalid firmware version number: ").append(e.what()));
+          shutdown_requested = true;
+        }
+        break;
+      case Header::UniqueDeviceID:
+        if( !unique_device_id.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
+        payloads |= 1u << Header::UniqueDeviceID; // version info is signalled by the publish stage
+        version_info_reminder = 0;
+        break;
+      case Header::ControllerInfo:
+        if( !controller_info.deserialise(data_buffer) ) { fixPayload(data_buffer); break; }
+        payloads |= 1u << Header::ControllerInfo; // signalled by the publish stage
+        controller_info_reminder = 0;
+        break;
+      default: // in the case of unknown or mal-formed sub-payload
+        fixPayload(data_buffer);
+        break;
+    }
+  }
+  //std::cout << "---" << std::endl;
+  event_manager.flush(frame_info);
+  {
+    Profiler::Scope scope(&loop_profiler, Profiler::FieldWatch);
+    field_watcher.update(frame_info, payloads, core_sensors.data, current.data, gp_input.data);
+  }
+
+  Frame *frame = frames.claim();
+  if ( frame == NULL ) {
+    frames_dropped.fetch_add(1, std::memory_order_relaxed); // publish stage is falling behind (slow user callbacks)
+    return;
+  }
+  frame->info = frame_info;
+  frame->payloads = payloads;
+  frame->core_sensors = core_sensors.data;
+  frame->inertia = inertia.data;
+  for (unsigned int i = 0; i < 3; ++i) { frame->cliff_bottom[i] = cliff.data.bottom[i]; }
+  for (unsigned int i = 0; i < 2; ++i) { frame->current[i] = current.data.current[i]; }
+  for (unsigned int i = 0; i < 3; ++i) { frame->dock_ir[i] = dock_ir.data.docking[i]; }
+  frame->digital_input = gp_input.data.digital_input;
+  for (unsigned int i = 0; i < 4; ++i) { frame->analog_input[i] = gp_input.data.analog_input[i]; }
+  frame->three_axis_gyro = three_axis_gyro.data;
+  frame->controller_info = controller_info.data;
+  frame->hardware_version = hardware.data.version;
+  frame->firmware_version = firmware.data.version;
+  frame->udid[0] = unique_device_id.data.udid0;
+  frame->udid[1] = unique_device_id.data.udid1;
+  frame->udid[2] = unique_device_id.data.udid2;
+  frames.publish();
+}
+
+/**
+ * @brief Publish stage: make a decoded frame visible and signal it.
+ *
+ * @param frame : snapshot produced by the decode stage.
+ */
+void Kobuki::publishFrame(const Frame &frame)
+{
+  Profiler::Scope publish_scope(&loop_profiler, Profiler::Publish);
+  {
+    Profiler::Scope scope(&loop_profiler, Profiler::SnapshotStore);
+    published_frame.store(frame);
+  }
+  frame_history.add(frame);
+  if ( frame.contains(Header::CoreSensors) ) {
+    double wheel_left_angle, wheel_right_angle;
+    diff_drive.getWheelAngles(frame.core_sensors.left_encoder, frame.core_sensors.right_encoder, wheel_left_angle, wheel_right_angle);
+    state_extrapolator.update(frame, wheel_left_angle, wheel_right_angle);
+  }
+  shared_frames.write(frame);
+  {
+    std::lock_guard<std::mutex> lock(frame_wait_mutex);
+    published_sequence.store(frame.info.sequence, std::memory_order_release);
+  }
+  frame_wait_condition.notify_all();
+
+  MonotonicTime start_time;
+  if ( frame.contains(Header::UniqueDeviceID) ) {
+    Profiler::Scope scope(&loop_profiler, Profiler::emitStage(SlotMonitor::VersionInfoSlots));
+    VersionInfo version_info = versionInfo();
+    start_time = monotonicNow();
+    sig_version_info.emit(version_info);
+    kobuki_callbacks.version_info.emit(version_info);
+    slot_monitor.record(SlotMonitor::VersionInfoSlots, start_time);
+    sig_info.emit("Version info - Hardware: " + VersionInfo::toString(frame.hardware_version)
+                             + ". Firmware: " + VersionInfo::toString(frame.firmware_version));
+  }
+  if ( frame.contains(Header::ControllerInfo) ) {
+    Profiler::Scope scope(&loop_profiler, Profiler::emitStage(SlotMonitor::ControllerInfoSlots));
+    start_time = monotonicNow();
+    sig_controller_info.emit();
+    kobuki_callbacks.controller_info.emit();
+    slot_monitor.record(SlotMonitor::ControllerInfoSlots, start_time);
+  }
+  Profiler::Scope scope(&loop_profiler, Profiler::emitStage(SlotMonitor::StreamDataSlots));
+  start_time = monotonicNow();
+  sig_stream_data.emit();
+  kobuki_callbacks.stream_data.emit();
+  slot_monitor.record(SlotMonitor::StreamDataSlots, start_time);
+}
+
+/**
+ * @brief Apply the scheduling parameters to the calling driver thread.
+ *
+ * Each request that is refused (usually for lack of privileges) is reported
+ * and otherwise ignored - the thread carries on with what it has, which is
+ * reported at the end.
+ *
+ * @param name : the thread's role, for the report.
+ * @param cpu : pin to this cpu, or -1 to go with the affinity mask.
+ */
+void Kobuki::configureThread(const std::string &name, const int &cpu)
+{
+  std::string error;
+  loop_profiler.nameCurrentThread(name);
+  if ( prefaultStack(parameters.prefault_stack_size) < parameters.prefault_stack_size ) {
+    sig_warn.emit("only part of the " + name + " thread's stack could be prefaulted, it is smaller than prefault_stack_size.");
+  }
+  if ( parameters.scheduling_policy != DefaultScheduling ) {
+    if ( !setCurrentThreadScheduling(parameters.scheduling_policy, parameters.scheduling_priority, error) ) {
+      sig_warn.emit("could not raise the " + name + " thread to real time scheduling, falling back to the default [" + error + "].");
+    }
+  }
+  if ( cpu >= 0 ) {
+    if ( !pinCurrentThread(cpu, error) ) {
+      sig_warn.emit("could not pin the " + name + " thread to its cpu [" + error + "].");
+    }
+  } else if ( parameters.cpu_affinity_mask != 0 ) {
+    if ( !setCurrentThreadAffinity(parameters.cpu_affinity_mask, error) ) {
+      sig_warn.emit("could not restrict the " + name + " thread to the cpu affinity mask [" + error + "].");
+    }
+  }
+  if ( parameters.scheduling_policy != DefaultScheduling || cpu >= 0 || parameters.cpu_affinity_mask != 0 ) {
+    sig_info.emit(name + " thread is running with " + describeCurrentThreadScheduling() + ".");
+  }
+}
+
 void Kobuki::fixPayload(ecl::PushAndPop<unsigned char> & byteStream)
 {
   if (byteStream.size() < 3 ) { /* minimum size of sub-payload is 3; header_id, length, data */
@@ -412,6 +829,46 @@ void Kobuki::fixPayload(ecl::PushAndPop<unsigned char> & byteStream)
 }
 
 
+/*****************************************************************************
+ ** Implementation [Blocking Accessors]
+ *****************************************************************************/
+
+/**
+ * @brief Wait for a frame newer than the one last seen.
+ *
+ * An alternative to polling (lock, get, unlock, sleep) or to connecting a
+ * slot: the call sleeps until the driver publishes a frame with a sequence
+ * number beyond last_sequence and returns a copy of it. Pass the sequence of
+ * the returned frame (frame.info.sequence) to the next call. If frames arrive
+ * faster than the caller comes back, it gets the newest one; the sequence
+ * numbers show how many were skipped.
+ *
+ * The snapshot is self consistent, there is no need to lock the data access.
+ *
+ * @param last_sequence : sequence number of the last frame seen, 0 for any frame.
+ * @param timeout : give up after this many seconds.
+ * @param frame : filled with the snapshot if a new frame arrived.
+ * @return bool : false if it timed out.
+ */
+bool Kobuki::waitForFrame(const uint64_t &last_sequence, const double &timeout, Frame &frame)
+{
+  {
+    std::unique_lock<std::mutex> lock(frame_wait_mutex);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+        + std::chrono::nanoseconds(static_cast<long long>(timeout * 1.0e9));
+    while ( published_sequence.load(std::memory_order_acquire) <= last_sequence ) {
+      if ( frame_wait_condition.wait_until(lock, deadline) == std::cv_status::timeout ) {
+        if ( published_sequence.load(std::memory_order_acquire) <= last_sequence ) {
+          return false;
+        }
+        break;
+      }
+    }
+  }
+  frame = published_frame.load();
+  return true;
+}
+
 /*****************************************************************************
  ** Implementation [Human Friendly Accessors]
  *****************************************************************************/
@@ -420,26 +877,77 @@ ecl::Angle<double> Kobuki::getHeading() const
 {
   ecl::Angle<double> heading;
   // raw data angles are in hundredths of a degree, convert to radians.
-  heading = (static_cast<double>(inertia.data.angle) / 100.0) * ecl::pi / 180.0;
-  return ecl::wrap_angle(heading - heading_offset);
+  heading = (static_cast<double>(snapshot().inertia.angle) / 100.0) * ecl::pi / 180.0;
+  return ecl::wrap_angle(heading - heading_offset.load());
 }
 
 double Kobuki::getAngularVelocity() const
 {
   // raw data angles are in hundredths of a degree, convert to radians.
-  return (static_cast<double>(inertia.data.angle_rate) / 100.0) * ecl::pi / 180.0;
+  return (static_cast<double>(snapshot().inertia.angle_rate) / 100.0) * ecl::pi / 180.0;
+}
+
+VersionInfo Kobuki::versionInfo() const
+{
+  Frame frame = snapshot();
+  return VersionInfo(frame.firmware_version, frame.hardware_version, frame.udid[0], frame.udid[1], frame.udid[2]);
+}
+
+Battery Kobuki::batteryStatus() const
+{
+  Frame frame = snapshot();
+  return Battery(frame.core_sensors.battery, frame.core_sensors.charger);
 }
 
 /*****************************************************************************
  ** Implementation [Raw Data Accessors]
  *****************************************************************************/
 
+DockIR::Data Kobuki::getDockIRData() const
+{
+  Frame frame = snapshot();
+  DockIR::Data data;
+  for (unsigned int i = 0; i < 3; ++i) { data.docking[i] = frame.dock_ir[i]; }
+  return data;
+}
+
+Cliff::Data Kobuki::getCliffData() const
+{
+  Frame frame = snapshot();
+  Cliff::Data data;
+  for (unsigned int i = 0; i < 3; ++i) { data.bottom[i] = frame.cliff_bottom[i]; }
+  return data;
+}
+
+Current::Data Kobuki::getCurrentData() const
+{
+  Frame frame = snapshot();
+  Current::Data data;
+  for (unsigned int i = 0; i < 2; ++i) { data.current[i] = frame.current[i]; }
+  return data;
+}
+
+GpInput::Data Kobuki::getGpInputData() const
+{
+  Frame frame = snapshot();
+  GpInput::Data data;
+  data.digital_input = frame.digital_input;
+  for (unsigned int i = 0; i < 4; ++i) { data.analog_input[i] = frame.analog_input[i]; }
+  return data;
+}
+
+/*****************************************************************************
+ ** Implementation [Odometry]
+ *****************************************************************************/
+
 void Kobuki::resetOdometry()
 {
   diff_drive.reset();
+  state_extrapolator.reset();
+  odometry_firmware_time = -1;
 
   // Issue #274: use current imu reading as zero heading to emulate reseting gyro
-  heading_offset = (static_cast<double>(inertia.data.angle) / 100.0) * ecl::pi / 180.0;
+  heading_offset.store((static_cast<double>(snapshot().inertia.angle) / 100.0) * ecl::pi / 180.0);
 }
 
 void Kobuki::getWheelJointStates(double &wheel_left_angle, double &wheel_left_angle_rate, double &wheel_right_angle,
@@ -461,8 +969,42 @@ void Kobuki::getWheelJointStates(double &wheel_left_angle, double &wheel_left_an
  */
 void Kobuki::updateOdometry(ecl::LegacyPose2D<double> &pose_update, ecl::linear_algebra::Vector3d &pose_update_rates)
 {
-  diff_drive.update(core_sensors.data.time_stamp, core_sensors.data.left_encoder, core_sensors.data.right_encoder,
-                      pose_update, pose_update_rates);
+  FrameInfo frame_info;
+  updateOdometry(pose_update, pose_update_rates, frame_info);
+}
+
+/**
+ * @brief Calculate an odometry update along with the timing of the frame it came from.
+ *
+ * Use the frame info's receive time (rather than the time the slot happens
+ * to run) to stamp the update when fusing with other sensors.
+ *
+ * Here the frame info's periods count the stream periods covered by the
+ * update, i.e. since the frame used for the previous update. More than one
+ * means frames were lost (or skipped by the caller) and the pose update
+ * integrates the motion over all of them in one step - consumers that
+ * assume a fixed 20ms step should scale or reject it.
+ *
+ * @param pose_update : return the pose updates in this variable.
+ * @param pose_update_rates : return the pose update rates in this variable.
+ * @param frame_info : return the host timing of the frame used for the update in this variable.
+ */
+void Kobuki::updateOdometry(ecl::LegacyPose2D<double> &pose_update, ecl::linear_algebra::Vector3d &pose_update_rates,
+                            FrameInfo &frame_info)
+{
+  Frame frame = snapshot();
+  const FrameInfo &info = frame.info;
+  int64_t elapsed = info.firmware_time - odometry_firmware_time;
+  unsigned int periods = 1; // first update, or the firmware clock restarted
+  if ( odometry_firmware_time >= 0 && elapsed > 0 ) {
+    periods = static_cast<unsigned int>(std::max<int64_t>(
+        (elapsed + FrameLossMonitor::stream_period / 2) / FrameLossMonitor::stream_period, 1));
+  }
+  odometry_firmware_time = info.firmware_time;
+  diff_drive.update(frame.core_sensors.time_stamp, frame.core_sensors.left_encoder,
+                    frame.core_sensors.right_encoder, pose_update, pose_update_rates);
+  frame_info = info;
+  frame_info.periods = periods;
 }
 
 /*****************************************************************************
@@ -528,31 +1070,55 @@ void Kobuki::setBaseControl(const double &linear_velocity, const double &angular
 
 void Kobuki::sendBaseControlCommand()
 {
-  std::vector<double> velocity_commands_received;
+  Profiler::Scope base_control_scope(&loop_profiler, Profiler::BaseControl);
+  std::lock_guard<std::mutex> lock(base_control_mutex); // held through the emit, slots read velocity_commands_debug
+  VelocityCommand command = diff_drive.velocityCommand();
   if( acceleration_limiter.isEnabled() ) {
-    velocity_commands_received=acceleration_limiter.limit(diff_drive.pointVelocity());
-  } else {
-    velocity_commands_received=diff_drive.pointVelocity();
+    command = acceleration_limiter.limit(command);
   }
-  diff_drive.velocityCommands(velocity_commands_received);
-  std::vector<short> velocity_commands = diff_drive.velocityCommands();
-  //std::cout << "speed: " << velocity_commands[0] << ", radius: " << velocity_commands[1] << std::endl;
-  sendCommand(Command::SetVelocityControl(velocity_commands[0], velocity_commands[1]));
+  diff_drive.velocityCommands(command.linear, command.angular);
+  short speed, radius;
+  diff_drive.getVelocityCommands(speed, radius);
+  //std::cout << "speed: " << speed << ", radius: " << radius << std::endl;
+  sendCommand(Command::SetVelocityControl(speed, radius));
 
   //experimental; send raw control command and received command velocity
-  velocity_commands_debug=velocity_commands;
-  velocity_commands_debug.push_back((short)(velocity_commands_received[0]*1000.0));
-  velocity_commands_debug.push_back((short)(velocity_commands_received[1]*1000.0));
-  sig_raw_control_command.emit(velocity_commands_debug);
+  if ( !wanted(kobuki_callbacks.raw_control_command) ) { return; }
+  velocity_commands_debug[0] = speed;
+  velocity_commands_debug[1] = radius;
+  velocity_commands_debug[2] = (short)(command.linear*1000.0);
+  velocity_commands_debug[3] = (short)(command.angular*1000.0);
+  Profiler::Scope scope(&loop_profiler, Profiler::emitStage(SlotMonitor::RawControlCommandSlots));
+  MonotonicTime start_time = monotonicNow();
+  if ( raw_sigslots.load(std::memory_order_relaxed) ) { sig_raw_control_command.emit(velocity_commands_debug); }
+  kobuki_callbacks.raw_control_command.emit(velocity_commands_debug);
+  slot_monitor.record(SlotMonitor::RawControlCommandSlots, start_time);
+}
+
+/**
+ * @brief Queue the commands that go out with every incoming frame and write them.
+ */
+void Kobuki::sendCycleCommands()
+{
+  if ( parameters.base_control_timing != BaseControlFixedRate ) {
+    sendBaseControlCommand(); // otherwise the transmit thread does it on its own timer
+  }
+  if( version_info_reminder/*--*/ > 0 ) sendCommand(Command::GetVersionInfo());
+  if( controller_info_reminder/*--*/ > 0 ) sendCommand(Command::GetControllerGain());
+  requestTransmit(); // everything queued this cycle goes down in a single frame
 }
 
 /**
- * @brief Send the prepared command to the serial port.
+ * @brief Queue the prepared command for the next outgoing frame.
+ *
+ * We have no control over how the user is calling this - they may be calling
+ * from different threads (this is so for kobuki_node) - so the commands go
+ * through a lock free queue. This never blocks on the serial port; the
+ * transmit thread does the writing.
  *
- * Need to be a bit careful here, because we have no control over how the user
- * is calling this - they may be calling from different threads (this is so for
- * kobuki_node), so we mutex protect it here rather than relying on the user
- * to do so above.
+ * Commands are not written immediately; the protocol allows several sub-payloads
+ * per frame, so everything queued during a cycle is packed together and written
+ * once per incoming data frame.
  *
  * @param command : prepared command template (see Command's static member functions).
  */
@@ -566,24 +1132,138 @@ void Kobuki::sendCommand(Command command)
     //std::cout << is_enabled << ", " << is_alive << ", " << is_connected << std::endl;
     return;
   }
-  command_mutex.lock();
-  kobuki_command.resetBuffer(command_buffer);
+  if ( !command_queue.push(command) ) {
+    sig_warn.emit("transmit backlog is full (is the robot still reading?), dropping command.");
+  }
+}
+
+/**
+ * @brief Wake the transmit thread to write out everything queued so far.
+ */
+void Kobuki::requestTransmit()
+{
+  {
+    std::lock_guard<std::mutex> lock(transmit_mutex);
+    transmit_requested = true;
+  }
+  transmit_condition.notify_one();
+}
+
+/**
+ * @brief Worker loop of the transmit thread.
+ *
+ * Sleeps until the reading thread finishes a cycle (or a command needs to go out
+ * immediately) and then writes all queued commands. Keeping the writes here
+ * means a slow usb write never holds up the reading thread nor the user.
+ *
+ * With fixed rate base control, this also wakes up every base_control_period
+ * to prepare and send the velocity command itself.
+ */
+void Kobuki::transmit()
+{
+  configureThread("transmit", -1);
+  const bool fixed_rate = ( parameters.base_control_timing == BaseControlFixedRate );
+  const std::chrono::nanoseconds period(static_cast<long long>(parameters.base_control_period * 1.0e9));
+  std::chrono::steady_clock::time_point next_tick = std::chrono::steady_clock::now() + period;
+  bool terminate = false;
+  while (!terminate)
+  {
+    bool tick = false;
+    {
+      std::unique_lock<std::mutex> lock(transmit_mutex);
+      while ( !transmit_requested && !transmit_shutdown_requested && !tick ) {
+        if ( fixed_rate ) {
+          tick = ( transmit_condition.wait_until(lock, next_tick) == std::cv_status::timeout );
+        } else {
+          transmit_condition.wait(lock);
+        }
+      }
+      transmit_requested = false;
+      terminate = transmit_shutdown_requested;
+    }
+    if ( tick ) {
+      next_tick += period;
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      if ( next_tick < now ) {
+        next_tick = now + period; // we were held up, don't try to catch up with a burst
+      }
+      if ( is_alive && is_connected ) {
+        sendBaseControlCommand();
+      }
+    }
+    writeCommands();
+  }
+}
 
-  if (!command.serialise(command_buffer))
+/**
+ * @brief Send all queued commands to the serial port.
+ *
+ * Packs as many sub-payloads into each frame as the single byte length field
+ * allows (usually everything fits in one) and hands all the frames to the
+ * serial port with a single write. Only the transmit thread calls this.
+ */
+void Kobuki::writeCommands()
+{
+  Profiler::Scope transmit_scope(&loop_profiler, Profiler::Transmit);
+  outgoing_bytes.clear();
+  kobuki_command.resetBuffer(command_buffer);
+  bool base_control_pending = false;
+  while ( command_queue.pop(pending_command) )
   {
-    sig_error.emit("command serialise failed.");
+    if ( pending_command.data.command == Command::BaseControl ) {
+      base_control_pending = true;
+    }
+    sub_payload_buffer.clear();
+    if (!pending_command.serialise(sub_payload_buffer))
+    {
+      sig_error.emit("command serialise failed.");
+      continue;
+    }
+    if ( command_buffer.size() - 3 + sub_payload_buffer.size() > Command::max_payload_length ) {
+      finaliseCommandFrame();
+      kobuki_command.resetBuffer(command_buffer);
+    }
+    for (unsigned int j = 0; j < sub_payload_buffer.size(); ++j) {
+      command_buffer.push_back(sub_payload_buffer[j]);
+    }
+  }
+  if ( command_buffer.size() > 3 ) {
+    finaliseCommandFrame();
+  }
+  //check_device();
+  if ( !outgoing_bytes.empty() && is_connected ) {
+    {
+      Profiler::Scope scope(&loop_profiler, Profiler::TransmitWrite);
+      serial.write((const char*)&outgoing_bytes[0], outgoing_bytes.size());
+    }
+    MonotonicTime frame_time = last_frame_time.load(std::memory_order_relaxed);
+    if ( base_control_pending && frame_time != last_measured_frame_time ) {
+      base_control_latency.add(monotonicNow() - frame_time);
+      last_measured_frame_time = frame_time;
+    }
   }
+}
+
+/**
+ * @brief Fill in the length and checksum of the command frame and queue its bytes for writing.
+ */
+void Kobuki::finaliseCommandFrame()
+{
   command_buffer[2] = command_buffer.size() - 3;
   unsigned char checksum = 0;
   for (unsigned int i = 2; i < command_buffer.size(); i++)
     checksum ^= (command_buffer[i]);
 
   command_buffer.push_back(checksum);
-  //check_device();
-  serial.write((const char*)&command_buffer[0], command_buffer.size());
-
-  sig_raw_data_command.emit(command_buffer);
-  command_mutex.unlock();
+  for (unsigned int i = 0; i < command_buffer.size(); i++) {
+    outgoing_bytes.push_back(command_buffer[i]);
+  }
+  if ( !wanted(kobuki_callbacks.raw_data_command) ) { return; }
+  Profiler::Scope scope(&loop_profiler, Profiler::emitStage(SlotMonitor::RawDataCommandSlots));
+  MonotonicTime start_time = monotonicNow();
+  if ( raw_sigslots.load(std::memory_order_relaxed) ) { sig_raw_data_command.emit(command_buffer); }
+  kobuki_callbacks.raw_data_command.emit(command_buffer);
+  slot_monitor.record(SlotMonitor::RawDataCommandSlots, start_time);
 }
 
 bool Kobuki::enable()
@@ -596,6 +1276,7 @@ bool Kobuki::disable()
 {
   setBaseControl(0.0f, 0.0f);
   sendBaseControlCommand();
+  requestTransmit(); // don't wait for the next cycle, the worker thread may be on its way out
   is_enabled = false;
   return true;
 }
@@ -628,6 +1309,8 @@ void Kobuki::printSigSlotConnections() const {
   ecl::SigSlotsManager<const InputEvent&>::printStatistics();
   std::cout << "====== Robot Event =======" << std::endl;
   ecl::SigSlotsManager<const RobotEvent&>::printStatistics();
+  std::cout << "====== Event Batch =======" << std::endl;
+  ecl::SigSlotsManager<const EventBatch&>::printStatistics();
   std::cout << "====== VersionInfo =======" << std::endl;
   ecl::SigSlotsManager<const VersionInfo&>::printStatistics();
   std::cout << "===== Command Buffer =====" << std::endl;
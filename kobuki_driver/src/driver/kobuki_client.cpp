@@ -0,0 +1,491 @@
+/**
+ * @file /kobuki_driver/src/driver/kobuki_client.cpp
+ *
+ * @brief Implementation of the kobuki server's client.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ecl/config.hpp>
+#include <ecl/math.hpp>
+#include "../../include/kobuki_driver/kobuki_client.hpp"
+#include "../../include/kobuki_driver/frame_loss_monitor.hpp"
+
+#ifdef ECL_IS_POSIX
+  #include <fcntl.h>
+  #include <poll.h>
+  #include <sys/socket.h>
+  #include <sys/un.h>
+  #include <unistd.h>
+#endif
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+const int welcome_timeout = 2000; // [ms]
+
+protocol::OutputsData pack(const DigitalOutput &digital_output) {
+  protocol::OutputsData outputs;
+  outputs.values = outputs.mask = 0;
+  for ( unsigned int i = 0; i < 4; ++i ) {
+    if ( digital_output.values[i] ) { outputs.values |= (1 << i); }
+    if ( digital_output.mask[i] ) { outputs.mask |= (1 << i); }
+  }
+  return outputs;
+}
+}
+
+/*****************************************************************************
+** Implementation [Connection]
+*****************************************************************************/
+
+KobukiClient::KobukiClient() :
+  connection(-1),
+  connected(false),
+  flags(0),
+  published_sequence(0),
+  heading_offset(0.0),
+  odometry_firmware_time(-1)
+{}
+
+KobukiClient::~KobukiClient() {
+  disconnect();
+}
+
+/**
+ * @brief Connect to a server and start receiving its frames.
+ *
+ * @param socket_path : the server's socket, e.g. "/tmp/kobuki.sock".
+ * @param error : the reason if it failed.
+ * @param priority : of this client's velocities, the highest priority wins [0].
+ * @param name : for the server's benefit [""].
+ * @return bool : whether the server accepted the client.
+ */
+bool KobukiClient::connect(const std::string &socket_path, std::string &error,
+                           const unsigned char &priority, const std::string &name) {
+  disconnect();
+#ifdef ECL_IS_POSIX
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if ( socket_path.empty() || socket_path.size() >= sizeof(address.sun_path) ) {
+    error = "invalid socket path [" + socket_path + "]";
+    return false;
+  }
+  std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+  connection = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if ( connection < 0 ) {
+    error = std::string("socket failed [") + std::strerror(errno) + "]";
+    return false;
+  }
+  fcntl(connection, F_SETFD, FD_CLOEXEC);
+  if ( ::connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ) {
+    error = std::string("could not connect to " + socket_path + " [") + std::strerror(errno) + "], is the server running?";
+    close(connection);
+    connection = -1;
+    return false;
+  }
+
+  protocol::HelloData hello;
+  std::memset(&hello, 0, sizeof(hello));
+  hello.version = protocol::version;
+  hello.frame_size = sizeof(Frame);
+  hello.priority = priority;
+  std::strncpy(hello.name, name.c_str(), sizeof(hello.name) - 1);
+  stream.clear();
+  if ( !send(protocol::Hello, &hello, sizeof(hello)) ) {
+    error = std::string("could not say hello [") + std::strerror(errno) + "]";
+    close(connection);
+    connection = -1;
+    return false;
+  }
+
+  // wait for the welcome, anything after it is left in the stream for receive()
+  error = "the server did not answer";
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+      + std::chrono::milliseconds(welcome_timeout);
+  bool welcomed = false;
+  while ( !welcomed ) {
+    int remaining = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count());
+    pollfd descriptor;
+    descriptor.fd = connection;
+    descriptor.events = POLLIN;
+    if ( remaining <= 0 || poll(&descriptor, 1, remaining) <= 0 ) {
+      break;
+    }
+    ssize_t received = recv(connection, stream.space(), stream.spaceLeft(), 0);
+    if ( received <= 0 ) {
+      error = "the server hung up";
+      break;
+    }
+    stream.commit(static_cast<std::size_t>(received));
+    protocol::MessageHeader header;
+    const unsigned char *body;
+    if ( stream.next(header, body) ) {
+      if ( header.type == protocol::Welcome ) {
+        welcomed = true;
+      } else if ( header.type == protocol::Refused ) {
+        error = "the server refused the connection [" + std::string(reinterpret_cast<const char*>(body), header.length) + "]";
+        break;
+      } else {
+        error = "the server answered with nonsense";
+        break;
+      }
+    }
+  }
+  if ( !welcomed ) {
+    close(connection);
+    connection = -1;
+    return false;
+  }
+  connected = true;
+  thread.start(&KobukiClient::receive, *this);
+  return true;
+#else
+  error = "the kobuki client needs posix";
+  return false;
+#endif
+}
+
+/**
+ * @brief Hang up, the server stops the base if this client had it.
+ */
+void KobukiClient::disconnect() {
+#ifdef ECL_IS_POSIX
+  if ( connection < 0 ) {
+    return;
+  }
+  shutdown(connection, SHUT_RDWR); // knocks receive() out of recv()
+  thread.join();
+  close(connection);
+  connection = -1;
+#endif
+  connected = false;
+  frame_wait_condition.notify_all();
+}
+
+/*
+ * Receiving thread.
+ */
+void KobukiClient::receive() {
+#ifdef ECL_IS_POSIX
+  while ( process() ) {
+    ssize_t received = recv(connection, stream.space(), stream.spaceLeft(), 0);
+    if ( received < 0 && errno == EINTR ) {
+      continue;
+    }
+    if ( received <= 0 ) {
+      break;
+    }
+    stream.commit(static_cast<std::size_t>(received));
+  }
+#endif
+  {
+    std::lock_guard<std::mutex> lock(frame_wait_mutex);
+    connected = false;
+  }
+  frame_wait_condition.notify_all();
+}
+
+/*
+ * Publish the frames that have arrived, false if the server has had enough of us.
+ */
+bool KobukiClient::process() {
+  protocol::MessageHeader header;
+  const unsigned char *body;
+  while ( stream.next(header, body) ) {
+    if ( header.type == protocol::Refused ) {
+      return false;
+    }
+    if ( header.type != protocol::FrameData || !protocol::decodeFrame(body, header.length, received_frame) ) {
+      continue; // not for us
+    }
+    published_frame.store(received_frame);
+    flags.store(header.flags, std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> lock(frame_wait_mutex);
+      published_sequence.store(received_frame.info.sequence, std::memory_order_release);
+    }
+    frame_wait_condition.notify_all();
+  }
+  return !stream.corrupt();
+}
+
+/*
+ * Send a message, false if the server is gone.
+ */
+bool KobukiClient::send(const protocol::MessageType &type, const void *body, const unsigned int &length) {
+#ifdef ECL_IS_POSIX
+  unsigned char buffer[sizeof(protocol::MessageHeader) + protocol::max_body_size];
+  unsigned int size = protocol::encode(type, body, length, buffer);
+  std::lock_guard<std::mutex> lock(send_mutex);
+  if ( connection < 0 ) {
+    return false;
+  }
+  unsigned int sent = 0;
+  while ( sent < size ) {
+  #ifdef MSG_NOSIGNAL
+    ssize_t result = ::send(connection, buffer + sent, size - sent, MSG_NOSIGNAL);
+  #else
+    ssize_t result = ::send(connection, buffer + sent, size - sent, 0);
+  #endif
+    if ( result < 0 ) {
+      if ( errno == EINTR ) {
+        continue;
+      }
+      return false;
+    }
+    sent += static_cast<unsigned int>(result);
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+/*****************************************************************************
+** Implementation [Getters]
+*****************************************************************************/
+
+/**
+ * @brief Block until the server sends a frame newer than the given one.
+ *
+ * @param last_sequence : the last frame seen (its info's sequence), 0 for any frame.
+ * @param timeout : give up after this [s].
+ * @param frame : filled with the new frame.
+ * @return bool : false if it timed out or the server went away.
+ */
+bool KobukiClient::waitForFrame(const uint64_t &last_sequence, const double &timeout, Frame &frame)
+{
+  {
+    std::unique_lock<std::mutex> lock(frame_wait_mutex);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+        + std::chrono::nanoseconds(static_cast<long long>(timeout * 1.0e9));
+    while ( published_sequence.load(std::memory_order_acquire) <= last_sequence ) {
+      if ( !connected ) {
+        return false;
+      }
+      if ( frame_wait_condition.wait_until(lock, deadline) == std::cv_status::timeout ) {
+        if ( published_sequence.load(std::memory_order_acquire) <= last_sequence ) {
+          return false;
+        }
+        break;
+      }
+    }
+  }
+  frame = published_frame.load();
+  return true;
+}
+
+ecl::Angle<double> KobukiClient::getHeading() const
+{
+  ecl::Angle<double> heading;
+  // raw data angles are in hundredths of a degree, convert to radians.
+  heading = (static_cast<double>(published_frame.load().inertia.angle) / 100.0) * ecl::pi / 180.0;
+  return ecl::wrap_angle(heading - heading_offset);
+}
+
+double KobukiClient::getAngularVelocity() const
+{
+  // raw data angles are in hundredths of a degree, convert to radians.
+  return (static_cast<double>(published_frame.load().inertia.angle_rate) / 100.0) * ecl::pi / 180.0;
+}
+
+VersionInfo KobukiClient::versionInfo() const
+{
+  Frame frame = published_frame.load();
+  return VersionInfo(frame.firmware_version, frame.hardware_version, frame.udid[0], frame.udid[1], frame.udid[2]);
+}
+
+Battery KobukiClient::batteryStatus() const
+{
+  Frame frame = published_frame.load();
+  return Battery(frame.core_sensors.battery, frame.core_sensors.charger);
+}
+
+DockIR::Data KobukiClient::getDockIRData() const
+{
+  Frame frame = published_frame.load();
+  DockIR::Data data;
+  for (unsigned int i = 0; i < 3; ++i) { data.docking[i] = frame.dock_ir[i]; }
+  return data;
+}
+
+Cliff::Data KobukiClient::getCliffData() const
+{
+  Frame frame = published_frame.load();
+  Cliff::Data data;
+  for (unsigned int i = 0; i < 3; ++i) { data.bottom[i] = frame.cliff_bottom[i]; }
+  return data;
+}
+
+Current::Data KobukiClient::getCurrentData() const
+{
+  Frame frame = published_frame.load();
+  Current::Data data;
+  for (unsigned int i = 0; i < 2; ++i) { data.current[i] = frame.current[i]; }
+  return data;
+}
+
+GpInput::Data KobukiClient::getGpInputData() const
+{
+  Frame frame = published_frame.load();
+  GpInput::Data data;
+  data.digital_input = frame.digital_input;
+  for (unsigned int i = 0; i < 4; ++i) { data.analog_input[i] = frame.analog_input[i]; }
+  return data;
+}
+
+/*****************************************************************************
+** Implementation [Odometry]
+*****************************************************************************/
+
+void KobukiClient::resetOdometry()
+{
+  diff_drive.reset();
+  odometry_firmware_time = -1;
+  heading_offset = (static_cast<double>(published_frame.load().inertia.angle) / 100.0) * ecl::pi / 180.0;
+}
+
+void KobukiClient::getWheelJointStates(double &wheel_left_angle, double &wheel_left_angle_rate,
+                                       double &wheel_right_angle, double &wheel_right_angle_rate)
+{
+  diff_drive.getWheelJointStates(wheel_left_angle, wheel_left_angle_rate, wheel_right_angle, wheel_right_angle_rate);
+}
+
+/**
+ * @brief Calculate an odometry update from the latest frame, see Kobuki::updateOdometry().
+ */
+void KobukiClient::updateOdometry(ecl::LegacyPose2D<double> &pose_update,
+                                  ecl::linear_algebra::Vector3d &pose_update_rates)
+{
+  FrameInfo frame_info;
+  updateOdometry(pose_update, pose_update_rates, frame_info);
+}
+
+/**
+ * @brief Calculate an odometry update along with the timing of the frame it came from, see Kobuki::updateOdometry().
+ */
+void KobukiClient::updateOdometry(ecl::LegacyPose2D<double> &pose_update,
+                                  ecl::linear_algebra::Vector3d &pose_update_rates, FrameInfo &frame_info)
+{
+  Frame frame = published_frame.load();
+  const FrameInfo &info = frame.info;
+  int64_t elapsed = info.firmware_time - odometry_firmware_time;
+  unsigned int periods = 1;
+  if ( odometry_firmware_time >= 0 && elapsed > 0 ) {
+    periods = static_cast<unsigned int>(std::max<int64_t>(
+        (elapsed + FrameLossMonitor::stream_period / 2) / FrameLossMonitor::stream_period, 1));
+  }
+  odometry_firmware_time = info.firmware_time;
+  diff_drive.update(frame.core_sensors.time_stamp, frame.core_sensors.left_encoder,
+                    frame.core_sensors.right_encoder, pose_update, pose_update_rates);
+  frame_info = info;
+  frame_info.periods = periods;
+}
+
+/*****************************************************************************
+** Implementation [Commands]
+*****************************************************************************/
+
+bool KobukiClient::enable()
+{
+  return send(protocol::EnableMotors);
+}
+
+bool KobukiClient::disable()
+{
+  return send(protocol::DisableMotors);
+}
+
+/**
+ * @brief Bid for the base with a velocity, renew it at your control rate.
+ */
+void KobukiClient::setBaseControl(const double &linear_velocity, const double &angular_velocity)
+{
+  protocol::VelocityData velocity;
+  velocity.linear = linear_velocity;
+  velocity.angular = angular_velocity;
+  send(protocol::SetBaseControl, &velocity, sizeof(velocity));
+}
+
+/**
+ * @brief Stop bidding for the base, letting the next client have it (or stopping it).
+ */
+void KobukiClient::releaseBaseControl()
+{
+  send(protocol::ReleaseBaseControl);
+}
+
+void KobukiClient::setLed(const enum LedNumber &number, const enum LedColour &colour)
+{
+  protocol::LedData led;
+  led.number = static_cast<uint8_t>(number);
+  led.colour = static_cast<uint16_t>(colour);
+  send(protocol::SetLed, &led, sizeof(led));
+}
+
+void KobukiClient::setDigitalOutput(const DigitalOutput &digital_output)
+{
+  protocol::OutputsData outputs = pack(digital_output);
+  send(protocol::SetDigitalOutput, &outputs, sizeof(outputs));
+}
+
+void KobukiClient::setExternalPower(const DigitalOutput &digital_output)
+{
+  protocol::OutputsData outputs = pack(digital_output);
+  send(protocol::SetExternalPower, &outputs, sizeof(outputs));
+}
+
+void KobukiClient::playSoundSequence(const enum SoundSequences &number)
+{
+  protocol::SoundData sound;
+  sound.sequence = static_cast<uint8_t>(number);
+  send(protocol::PlaySoundSequence, &sound, sizeof(sound));
+}
+
+/**
+ * @brief Set the wheel controller's gains (the server checks the firmware supports it).
+ *
+ * @return bool : false if the server is gone.
+ */
+bool KobukiClient::setControllerGain(const unsigned char &type, const unsigned int &p_gain,
+                                     const unsigned int &i_gain, const unsigned int &d_gain)
+{
+  protocol::GainData gain;
+  gain.type = type;
+  gain.p_gain = p_gain;
+  gain.i_gain = i_gain;
+  gain.d_gain = d_gain;
+  return send(protocol::SetControllerGain, &gain, sizeof(gain));
+}
+
+/**
+ * @brief Ask for the wheel controller's gains, they arrive with a later frame (getControllerInfoData()).
+ *
+ * @return bool : false if the server is gone.
+ */
+bool KobukiClient::getControllerGain()
+{
+  return send(protocol::GetControllerGain);
+}
+
+} // namespace kobuki
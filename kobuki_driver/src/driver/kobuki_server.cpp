@@ -0,0 +1,507 @@
+/**
+ * @file /kobuki_driver/src/driver/kobuki_server.cpp
+ *
+ * @brief Implementation of the kobuki server.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cerrno>
+#include <cstring>
+#include <ecl/config.hpp>
+#include "../../include/kobuki_driver/kobuki_server.hpp"
+
+#ifdef ECL_IS_POSIX
+  #include <fcntl.h>
+  #include <poll.h>
+  #include <sys/socket.h>
+  #include <sys/un.h>
+  #include <unistd.h>
+#endif
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+const int poll_period = 20; // [ms] for lapsing velocity commands when no messages arrive
+const double frame_wait = 0.1; // [s] for noticing stop() when no frames arrive
+const unsigned int message_size = sizeof(protocol::MessageHeader) + protocol::max_body_size;
+
+#ifdef ECL_IS_POSIX
+  #ifdef MSG_NOSIGNAL
+    const int send_flags = MSG_DONTWAIT | MSG_NOSIGNAL; // a client gone away is an error, not a SIGPIPE
+  #else
+    const int send_flags = MSG_DONTWAIT;
+  #endif
+#endif
+}
+
+/*****************************************************************************
+** Connection
+*****************************************************************************/
+
+struct KobukiServer::Connection {
+  Connection(const int &fd) :
+    fd(fd),
+    greeted(false),
+    broken(false),
+    priority(0),
+    commanding(false),
+    command_time(0),
+    pending_begin(0),
+    pending_end(0)
+  {
+    velocity.linear = velocity.angular = 0.0;
+  }
+
+  int fd;
+  bool greeted; // the client said hello and was welcomed
+  bool broken;  // a send failed, serve() closes it
+  std::string name;
+  uint8_t priority;
+  protocol::VelocityData velocity;
+  bool commanding; // the client wants the base
+  MonotonicTime command_time; // of its last velocity
+  protocol::MessageStream stream;
+  unsigned char pending[message_size]; // the unsent end of a message the socket had no room for
+  std::size_t pending_begin, pending_end;
+};
+
+/*****************************************************************************
+** Implementation [Lifecycle]
+*****************************************************************************/
+
+KobukiServer::KobukiServer(Kobuki &kobuki) :
+  kobuki(kobuki),
+  command_timeout(0),
+  listener(-1),
+  running(false),
+  shutdown_requested(false),
+  frames_dropped(0),
+  base_controller(NULL)
+{
+  wake_pipe[0] = wake_pipe[1] = -1;
+}
+
+KobukiServer::~KobukiServer() {
+  stop();
+}
+
+/**
+ * @brief Listen for clients and start serving them.
+ *
+ * A socket file left behind by a server that is no longer running is
+ * replaced; one with a server still behind it is left alone and an error
+ * returned.
+ *
+ * @param socket_path : file system path of the socket, e.g. "/tmp/kobuki.sock".
+ * @param error : the reason if it failed.
+ * @param command_timeout : a client's velocity lapses if not renewed within this [s].
+ * @return bool : whether the server is running.
+ */
+bool KobukiServer::start(const std::string &socket_path, std::string &error, const double &command_timeout) {
+  if ( running ) {
+    error = "the server is already running";
+    return false;
+  }
+#ifdef ECL_IS_POSIX
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if ( socket_path.empty() || socket_path.size() >= sizeof(address.sun_path) ) {
+    error = "invalid socket path [" + socket_path + "]";
+    return false;
+  }
+  std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+  int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+  if ( probe >= 0 ) {
+    bool in_use = ( connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 );
+    close(probe);
+    if ( in_use ) {
+      error = "another server is already listening on " + socket_path;
+      return false;
+    }
+  }
+  unlink(socket_path.c_str());
+
+  listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if ( listener < 0 ) {
+    error = std::string("socket failed [") + std::strerror(errno) + "]";
+    return false;
+  }
+  if ( bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 16) != 0 ) {
+    error = std::string("could not listen on " + socket_path + " [") + std::strerror(errno) + "]";
+    close(listener);
+    listener = -1;
+    return false;
+  }
+  if ( pipe(wake_pipe) != 0 ) {
+    error = std::string("pipe failed [") + std::strerror(errno) + "]";
+    close(listener);
+    listener = -1;
+    unlink(socket_path.c_str());
+    return false;
+  }
+  this->socket_path = socket_path;
+  this->command_timeout = static_cast<MonotonicTime>(command_timeout * 1.0e9);
+  shutdown_requested = false;
+  running = true;
+  broadcast_thread.start(&KobukiServer::broadcast, *this);
+  serve_thread.start(&KobukiServer::serve, *this);
+  return true;
+#else
+  error = "the kobuki server needs posix";
+  return false;
+#endif
+}
+
+/**
+ * @brief Disconnect the clients and stop listening, stopping the base if a client had it.
+ */
+void KobukiServer::stop() {
+  if ( !running ) {
+    return;
+  }
+#ifdef ECL_IS_POSIX
+  shutdown_requested = true;
+  char wake = 0;
+  if ( write(wake_pipe[1], &wake, 1) < 0 ) {} // serve() notices on its next poll period anyway
+  serve_thread.join();
+  broadcast_thread.join();
+  {
+    std::lock_guard<std::mutex> lock(connections_mutex);
+    while ( !connections.empty() ) {
+      disconnect(connections.size() - 1);
+    }
+  }
+  close(listener);
+  close(wake_pipe[0]);
+  close(wake_pipe[1]);
+  listener = wake_pipe[0] = wake_pipe[1] = -1;
+  unlink(socket_path.c_str());
+#endif
+  running = false;
+}
+
+/**
+ * @brief Number of clients connected.
+ */
+unsigned int KobukiServer::clients() const {
+  std::lock_guard<std::mutex> lock(connections_mutex);
+  return static_cast<unsigned int>(connections.size());
+}
+
+#ifdef ECL_IS_POSIX
+
+/*****************************************************************************
+** Implementation [Threads]
+*****************************************************************************/
+
+/*
+ * Accepts clients, receives and carries out their commands and lapses stale
+ * velocities. The connections are only ever added and removed here.
+ */
+void KobukiServer::serve() {
+  std::vector<pollfd> descriptors;
+  while ( !shutdown_requested ) {
+    descriptors.clear();
+    pollfd descriptor;
+    descriptor.events = POLLIN;
+    descriptor.revents = 0;
+    descriptor.fd = wake_pipe[0];
+    descriptors.push_back(descriptor);
+    descriptor.fd = listener;
+    descriptors.push_back(descriptor);
+    {
+      std::lock_guard<std::mutex> lock(connections_mutex);
+      for ( std::size_t i = 0; i < connections.size(); ++i ) {
+        descriptor.fd = connections[i]->fd;
+        descriptors.push_back(descriptor);
+      }
+    }
+    if ( poll(&descriptors[0], descriptors.size(), poll_period) < 0 && errno != EINTR ) {
+      break;
+    }
+    if ( descriptors[0].revents != 0 ) {
+      break; // stop()
+    }
+    std::lock_guard<std::mutex> lock(connections_mutex);
+    // backwards, so disconnecting does not move the ones still to be looked at
+    for ( std::size_t i = descriptors.size() - 2; i > 0; --i ) {
+      Connection &connection = *connections[i - 1];
+      if ( descriptors[i + 1].revents != 0 && !receive(connection) ) {
+        connection.broken = true;
+      }
+      if ( connection.broken ) {
+        disconnect(i - 1);
+      }
+    }
+    if ( descriptors[1].revents & POLLIN ) {
+      accept();
+    }
+    arbitrate(monotonicNow());
+  }
+}
+
+/*
+ * Sends each frame the driver publishes to every client.
+ */
+void KobukiServer::broadcast() {
+  Frame frame;
+  uint64_t last_sequence = 0;
+  unsigned char buffer[message_size];
+  while ( !shutdown_requested ) {
+    if ( !kobuki.waitForFrame(last_sequence, frame_wait, frame) ) {
+      continue;
+    }
+    last_sequence = frame.info.sequence;
+    uint8_t flags = 0;
+    if ( kobuki.isAlive() ) { flags |= protocol::RobotAlive; }
+    if ( kobuki.isEnabled() ) { flags |= protocol::MotorsEnabled; }
+    unsigned int size = protocol::encodeFrame(frame, flags, buffer);
+
+    std::lock_guard<std::mutex> lock(connections_mutex);
+    for ( std::size_t i = 0; i < connections.size(); ++i ) {
+      Connection &connection = *connections[i];
+      if ( !connection.greeted || connection.broken ) {
+        continue;
+      }
+      buffer[offsetof(protocol::MessageHeader, flags)] =
+          ( &connection == base_controller ) ? (flags | protocol::InControl) : flags;
+      if ( !send(connection, buffer, size) ) {
+        frames_dropped.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+/*****************************************************************************
+** Implementation [Connections]
+*****************************************************************************/
+
+void KobukiServer::accept() {
+  int fd = ::accept(listener, NULL, NULL);
+  if ( fd < 0 ) {
+    return;
+  }
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  connections.push_back(new Connection(fd));
+}
+
+/*
+ * Read what has arrived and act on every whole message, false if the
+ * connection should be closed.
+ */
+bool KobukiServer::receive(Connection &connection) {
+  ssize_t received = recv(connection.fd, connection.stream.space(), connection.stream.spaceLeft(), MSG_DONTWAIT);
+  if ( received == 0 ) {
+    return false; // the client hung up
+  }
+  if ( received < 0 ) {
+    return ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR );
+  }
+  connection.stream.commit(static_cast<std::size_t>(received));
+  protocol::MessageHeader header;
+  const unsigned char *body;
+  while ( connection.stream.next(header, body) ) {
+    if ( !handle(connection, header, body) ) {
+      return false;
+    }
+  }
+  return !connection.stream.corrupt();
+}
+
+/*
+ * Act on a message, false if the connection should be closed.
+ */
+bool KobukiServer::handle(Connection &connection, const protocol::MessageHeader &header, const unsigned char *body) {
+  unsigned char buffer[message_size];
+  if ( !connection.greeted ) {
+    protocol::HelloData hello;
+    if ( header.type != protocol::Hello || header.length != sizeof(hello) ) {
+      return false;
+    }
+    std::memcpy(&hello, body, sizeof(hello));
+    if ( hello.version != protocol::version || hello.frame_size != sizeof(Frame) ) {
+      const char reason[] = "the client was built against a different version of the kobuki driver";
+      send(connection, buffer, protocol::encode(protocol::Refused, reason, sizeof(reason) - 1, buffer));
+      return false;
+    }
+    hello.name[sizeof(hello.name) - 1] = '\0';
+    connection.name = hello.name;
+    connection.priority = hello.priority;
+    protocol::WelcomeData welcome;
+    welcome.version = protocol::version;
+    welcome.frame_size = sizeof(Frame);
+    connection.greeted = true;
+    return send(connection, buffer, protocol::encode(protocol::Welcome, welcome, buffer));
+  }
+
+  switch ( header.type ) {
+    case protocol::SetBaseControl: {
+      if ( header.length != sizeof(protocol::VelocityData) ) { return false; }
+      std::memcpy(&connection.velocity, body, sizeof(protocol::VelocityData));
+      connection.commanding = true;
+      connection.command_time = monotonicNow();
+      arbitrate(connection.command_time);
+      break;
+    }
+    case protocol::ReleaseBaseControl: {
+      connection.commanding = false;
+      arbitrate(monotonicNow());
+      break;
+    }
+    case protocol::SetLed: {
+      protocol::LedData led;
+      if ( header.length != sizeof(led) ) { return false; }
+      std::memcpy(&led, body, sizeof(led));
+      kobuki.setLed(static_cast<LedNumber>(led.number), static_cast<LedColour>(led.colour));
+      break;
+    }
+    case protocol::SetDigitalOutput:
+    case protocol::SetExternalPower: {
+      protocol::OutputsData outputs;
+      if ( header.length != sizeof(outputs) ) { return false; }
+      std::memcpy(&outputs, body, sizeof(outputs));
+      DigitalOutput digital_output;
+      for ( unsigned int i = 0; i < 4; ++i ) {
+        digital_output.values[i] = ( outputs.values & (1 << i) ) != 0;
+        digital_output.mask[i] = ( outputs.mask & (1 << i) ) != 0;
+      }
+      if ( header.type == protocol::SetDigitalOutput ) {
+        kobuki.setDigitalOutput(digital_output);
+      } else {
+        kobuki.setExternalPower(digital_output);
+      }
+      break;
+    }
+    case protocol::PlaySoundSequence: {
+      protocol::SoundData sound;
+      if ( header.length != sizeof(sound) ) { return false; }
+      std::memcpy(&sound, body, sizeof(sound));
+      kobuki.playSoundSequence(static_cast<SoundSequences>(sound.sequence));
+      break;
+    }
+    case protocol::SetControllerGain: {
+      protocol::GainData gain;
+      if ( header.length != sizeof(gain) ) { return false; }
+      std::memcpy(&gain, body, sizeof(gain));
+      kobuki.setControllerGain(gain.type, gain.p_gain, gain.i_gain, gain.d_gain);
+      break;
+    }
+    case protocol::GetControllerGain: {
+      kobuki.getControllerGain();
+      break;
+    }
+    case protocol::EnableMotors: {
+      kobuki.enable();
+      break;
+    }
+    case protocol::DisableMotors: {
+      kobuki.disable();
+      break;
+    }
+    default: {
+      return false; // not one of ours
+    }
+  }
+  return true;
+}
+
+/*
+ * Send a whole message or nothing, false if it was dropped. A message the
+ * socket only had room for part of is finished before the next is started.
+ */
+bool KobukiServer::send(Connection &connection, const unsigned char *bytes, const unsigned int &size) {
+  if ( connection.pending_begin < connection.pending_end ) {
+    ssize_t sent = ::send(connection.fd, connection.pending + connection.pending_begin,
+                          connection.pending_end - connection.pending_begin, send_flags);
+    if ( sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) {
+      connection.broken = true;
+      return false;
+    }
+    if ( sent > 0 ) {
+      connection.pending_begin += static_cast<std::size_t>(sent);
+    }
+    if ( connection.pending_begin < connection.pending_end ) {
+      return false;
+    }
+  }
+  ssize_t sent = ::send(connection.fd, bytes, size, send_flags);
+  if ( sent < 0 ) {
+    if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) {
+      connection.broken = true;
+    }
+    return false;
+  }
+  if ( static_cast<unsigned int>(sent) < size ) {
+    std::memcpy(connection.pending, bytes + sent, size - sent);
+    connection.pending_begin = 0;
+    connection.pending_end = size - sent;
+  }
+  return true;
+}
+
+/*
+ * Close a connection, handing the base on if the client had it.
+ */
+void KobukiServer::disconnect(const std::size_t &index) {
+  Connection *connection = connections[index];
+  connections.erase(connections.begin() + index);
+  if ( connection == base_controller ) {
+    base_controller = NULL;
+    kobuki.setBaseControl(0.0, 0.0);
+    arbitrate(monotonicNow());
+  }
+  close(connection->fd);
+  delete connection;
+}
+
+/*****************************************************************************
+** Implementation [Arbitration]
+*****************************************************************************/
+
+/*
+ * Pass the winning velocity on to the driver, or stop the base if the last
+ * client to have it no longer wants it.
+ */
+void KobukiServer::arbitrate(const MonotonicTime &now) {
+  Connection *winner = NULL;
+  for ( std::size_t i = 0; i < connections.size(); ++i ) {
+    Connection *connection = connections[i];
+    if ( !connection->commanding || connection->broken ) {
+      continue;
+    }
+    if ( now - connection->command_time > command_timeout ) {
+      connection->commanding = false; // lapsed
+      continue;
+    }
+    if ( winner == NULL || connection->priority > winner->priority ||
+         ( connection->priority == winner->priority && connection->command_time > winner->command_time ) ) {
+      winner = connection;
+    }
+  }
+  if ( winner != NULL ) {
+    kobuki.setBaseControl(winner->velocity.linear, winner->velocity.angular);
+  } else if ( base_controller != NULL ) {
+    kobuki.setBaseControl(0.0, 0.0);
+  }
+  base_controller = winner;
+}
+
+#endif /* ECL_IS_POSIX */
+
+} // namespace kobuki
@@ -0,0 +1,102 @@
+/**
+ * @file /kobuki_driver/src/driver/latency_histogram.cpp
+ *
+ * @brief Implementation of the latency histogram.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <sstream>
+#include "../../include/kobuki_driver/latency_histogram.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+/**
+ * @brief Record a sample, from any thread.
+ *
+ * @param latency : the latency [ns].
+ */
+void LatencyHistogram::add(const MonotonicTime &latency) {
+  MonotonicTime microseconds = latency / 1000;
+  unsigned int i = 0;
+  while ( microseconds > 0 && i < number_of_buckets - 1 ) {
+    microseconds >>= 1;
+    ++i;
+  }
+  buckets[i].fetch_add(1, std::memory_order_relaxed);
+  sample_count.fetch_add(1, std::memory_order_relaxed);
+  total_latency.fetch_add(latency, std::memory_order_relaxed);
+  MonotonicTime maximum = maximum_latency.load(std::memory_order_relaxed);
+  while ( latency > maximum && !maximum_latency.compare_exchange_weak(maximum, latency, std::memory_order_relaxed) ) {}
+}
+
+void LatencyHistogram::reset() {
+  for ( unsigned int i = 0; i < number_of_buckets; ++i ) {
+    buckets[i].store(0, std::memory_order_relaxed);
+  }
+  sample_count.store(0, std::memory_order_relaxed);
+  total_latency.store(0, std::memory_order_relaxed);
+  maximum_latency.store(0, std::memory_order_relaxed);
+}
+
+MonotonicTime LatencyHistogram::mean() const {
+  unsigned long n = count();
+  return ( n == 0 ) ? 0 : total_latency.load(std::memory_order_relaxed) / static_cast<MonotonicTime>(n);
+}
+
+/**
+ * @brief Upper bound on the given fraction of the samples.
+ *
+ * @param fraction : e.g. 0.99 for the 99th percentile.
+ * @return MonotonicTime : the upper bound of the bucket it falls in [ns], capped at the maximum.
+ */
+MonotonicTime LatencyHistogram::percentile(const double &fraction) const {
+  unsigned long n = count();
+  if ( n == 0 ) {
+    return 0;
+  }
+  unsigned long target = static_cast<unsigned long>(fraction * static_cast<double>(n) + 0.5);
+  unsigned long accumulated = 0;
+  for ( unsigned int i = 0; i < number_of_buckets; ++i ) {
+    accumulated += bucket(i);
+    if ( accumulated >= target ) {
+      MonotonicTime bound = bucketUpperBound(i);
+      return ( bound < maximum() ) ? bound : maximum();
+    }
+  }
+  return maximum();
+}
+
+/**
+ * @brief Exclusive upper bound of a bucket [ns] (the last one is open ended).
+ */
+MonotonicTime LatencyHistogram::bucketUpperBound(const unsigned int &i) {
+  return static_cast<MonotonicTime>(1000) << i;
+}
+
+/**
+ * @brief One line summary, e.g. for logging.
+ */
+std::string LatencyHistogram::toString() const {
+  std::ostringstream ostream;
+  ostream << "n " << count()
+          << ", mean " << mean() / 1000 << "us"
+          << ", p99 " << percentile(0.99) / 1000 << "us"
+          << ", max " << maximum() / 1000 << "us";
+  return ostream.str();
+}
+
+} // namespace kobuki
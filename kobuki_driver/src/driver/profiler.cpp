@@ -0,0 +1,381 @@
+/**
+ * @file /kobuki_driver/src/driver/profiler.cpp
+ *
+ * @brief Implementation of the hot loop profiler.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include "../../include/kobuki_driver/profiler.hpp"
+#include "../../include/kobuki_driver/packet_handler/payload_headers.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Thread Records
+*****************************************************************************/
+
+struct Profiler::ThreadRecord {
+  enum State { Free = 0, Claimed, Ready };
+
+  struct Accumulator {
+    std::atomic<unsigned long> count;
+    std::atomic<MonotonicTime> self_time;
+    std::atomic<MonotonicTime> total_time;
+    std::atomic<MonotonicTime> maximum_time;
+  };
+
+  // one per distinct path of nested stages seen on the thread
+  struct Node {
+    Stage stage;
+    int parent; // -1 for the outermost stages
+    Accumulator accumulator;
+    short children[NumberOfStages]; // only touched by the owning thread, -1 until the child first runs
+  };
+
+  std::atomic<int> state;
+  std::atomic<bool> named;
+  std::thread::id id;
+  char name[32];
+  std::atomic<unsigned int> node_count; // nodes below this are set up and may be read
+  Node nodes[max_paths];
+  // only touched by the owning thread
+  short roots[NumberOfStages];
+  int node_stack[max_depth];
+  MonotonicTime child_time[max_depth];
+  unsigned int depth;
+  char padding[64]; // keep the next thread's record off this one's cache lines
+};
+
+namespace {
+std::atomic<uint64_t> instances(0);
+// the record of the profiler this thread used last, saves the search
+thread_local uint64_t cached_instance = 0;
+thread_local void *cached_record = NULL;
+}
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+Profiler::Profiler() :
+  instance(++instances),
+  is_enabled(false),
+  threads(new ThreadRecord[max_threads])
+{
+  for ( unsigned int i = 0; i < max_threads; ++i ) {
+    threads[i].state.store(ThreadRecord::Free, std::memory_order_relaxed);
+    threads[i].named.store(false, std::memory_order_relaxed);
+    threads[i].node_count.store(0, std::memory_order_relaxed);
+    for ( unsigned int j = 0; j < NumberOfStages; ++j ) {
+      threads[i].roots[j] = -1;
+    }
+    threads[i].depth = 0;
+  }
+}
+
+Profiler::~Profiler() {
+  delete[] threads;
+}
+
+/**
+ * @brief Zero the accumulated times (threads keep their records and names).
+ */
+void Profiler::reset() {
+  for ( unsigned int i = 0; i < max_threads; ++i ) {
+    unsigned int nodes = threads[i].node_count.load(std::memory_order_acquire);
+    for ( unsigned int j = 0; j < nodes; ++j ) {
+      ThreadRecord::Accumulator &accumulator = threads[i].nodes[j].accumulator;
+      accumulator.count.store(0, std::memory_order_relaxed);
+      accumulator.self_time.store(0, std::memory_order_relaxed);
+      accumulator.total_time.store(0, std::memory_order_relaxed);
+      accumulator.maximum_time.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+/**
+ * @brief Name the calling thread's tower in the dumps (the first name given sticks).
+ *
+ * Threads that are never named show up as thread<n>.
+ */
+void Profiler::nameCurrentThread(const std::string &name) {
+  ThreadRecord *thread = currentThread();
+  if ( thread == NULL || thread->named.load(std::memory_order_relaxed) ) {
+    return;
+  }
+  std::strncpy(thread->name, name.c_str(), sizeof(thread->name) - 1);
+  thread->name[sizeof(thread->name) - 1] = '\0';
+  thread->named.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief The calling thread's record, claiming one if it has none yet.
+ *
+ * @return ThreadRecord* : NULL if all records are taken.
+ */
+Profiler::ThreadRecord* Profiler::currentThread() {
+  if ( cached_instance == instance ) {
+    return static_cast<ThreadRecord*>(cached_record);
+  }
+  std::thread::id id = std::this_thread::get_id();
+  ThreadRecord *record = NULL;
+  for ( unsigned int i = 0; i < max_threads && record == NULL; ++i ) {
+    if ( threads[i].state.load(std::memory_order_acquire) == ThreadRecord::Ready && threads[i].id == id ) {
+      record = &threads[i];
+    }
+  }
+  for ( unsigned int i = 0; i < max_threads && record == NULL; ++i ) {
+    int expected = ThreadRecord::Free;
+    if ( threads[i].state.compare_exchange_strong(expected, ThreadRecord::Claimed, std::memory_order_acq_rel) ) {
+      threads[i].id = id;
+      std::ostringstream ostream;
+      ostream << "thread" << i;
+      std::strncpy(threads[i].name, ostream.str().c_str(), sizeof(threads[i].name) - 1);
+      threads[i].name[sizeof(threads[i].name) - 1] = '\0';
+      threads[i].state.store(ThreadRecord::Ready, std::memory_order_release);
+      record = &threads[i];
+    }
+  }
+  cached_instance = instance;
+  cached_record = record;
+  return record;
+}
+
+/*
+ * Enter a stage: find (or add) the node for it under the stage the thread
+ * is in now.
+ */
+Profiler::ThreadRecord* Profiler::push(const Stage &stage) {
+  ThreadRecord *thread = currentThread();
+  if ( thread == NULL || thread->depth >= max_depth ) {
+    return NULL;
+  }
+  int parent = ( thread->depth == 0 ) ? -1 : thread->node_stack[thread->depth - 1];
+  short &child = ( parent < 0 ) ? thread->roots[stage] : thread->nodes[parent].children[stage];
+  if ( child < 0 ) {
+    unsigned int n = thread->node_count.load(std::memory_order_relaxed);
+    if ( n == max_paths ) {
+      return NULL;
+    }
+    ThreadRecord::Node &node = thread->nodes[n];
+    node.stage = stage;
+    node.parent = parent;
+    node.accumulator.count.store(0, std::memory_order_relaxed);
+    node.accumulator.self_time.store(0, std::memory_order_relaxed);
+    node.accumulator.total_time.store(0, std::memory_order_relaxed);
+    node.accumulator.maximum_time.store(0, std::memory_order_relaxed);
+    for ( unsigned int i = 0; i < NumberOfStages; ++i ) {
+      node.children[i] = -1;
+    }
+    thread->node_count.store(n + 1, std::memory_order_release);
+    child = static_cast<short>(n);
+  }
+  thread->node_stack[thread->depth] = child;
+  thread->child_time[thread->depth++] = 0;
+  return thread;
+}
+
+void Profiler::pop(ThreadRecord &thread, const MonotonicTime &start_time) {
+  MonotonicTime duration = monotonicNow() - start_time;
+  --thread.depth;
+  MonotonicTime self_time = duration - thread.child_time[thread.depth];
+  if ( thread.depth > 0 ) {
+    thread.child_time[thread.depth - 1] += duration;
+  }
+  // only this thread writes its record, no need for read-modify-write atomics
+  ThreadRecord::Accumulator &accumulator = thread.nodes[thread.node_stack[thread.depth]].accumulator;
+  accumulator.count.store(accumulator.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  accumulator.self_time.store(accumulator.self_time.load(std::memory_order_relaxed) + self_time, std::memory_order_relaxed);
+  accumulator.total_time.store(accumulator.total_time.load(std::memory_order_relaxed) + duration, std::memory_order_relaxed);
+  if ( duration > accumulator.maximum_time.load(std::memory_order_relaxed) ) {
+    accumulator.maximum_time.store(duration, std::memory_order_relaxed);
+  }
+}
+
+/*****************************************************************************
+** Implementation [Statistics]
+*****************************************************************************/
+
+/**
+ * @brief Times a stage ran, summed over all threads and the places it ran in.
+ */
+unsigned long Profiler::count(const Stage &stage) const {
+  unsigned long sum = 0;
+  for ( unsigned int i = 0; i < max_threads; ++i ) {
+    unsigned int nodes = threads[i].node_count.load(std::memory_order_acquire);
+    for ( unsigned int j = 0; j < nodes; ++j ) {
+      if ( threads[i].nodes[j].stage == stage ) { sum += threads[i].nodes[j].accumulator.count.load(std::memory_order_relaxed); }
+    }
+  }
+  return sum;
+}
+
+/**
+ * @brief Time spent in a stage itself, excluding the stages nested in it [ns].
+ */
+MonotonicTime Profiler::selfTime(const Stage &stage) const {
+  MonotonicTime sum = 0;
+  for ( unsigned int i = 0; i < max_threads; ++i ) {
+    unsigned int nodes = threads[i].node_count.load(std::memory_order_acquire);
+    for ( unsigned int j = 0; j < nodes; ++j ) {
+      if ( threads[i].nodes[j].stage == stage ) { sum += threads[i].nodes[j].accumulator.self_time.load(std::memory_order_relaxed); }
+    }
+  }
+  return sum;
+}
+
+/**
+ * @brief Time spent in a stage, including the stages nested in it [ns].
+ */
+MonotonicTime Profiler::totalTime(const Stage &stage) const {
+  MonotonicTime sum = 0;
+  for ( unsigned int i = 0; i < max_threads; ++i ) {
+    unsigned int nodes = threads[i].node_count.load(std::memory_order_acquire);
+    for ( unsigned int j = 0; j < nodes; ++j ) {
+      if ( threads[i].nodes[j].stage == stage ) { sum += threads[i].nodes[j].accumulator.total_time.load(std::memory_order_relaxed); }
+    }
+  }
+  return sum;
+}
+
+/**
+ * @brief Longest single run of a stage [ns].
+ */
+MonotonicTime Profiler::maximumTime(const Stage &stage) const {
+  MonotonicTime maximum = 0;
+  for ( unsigned int i = 0; i < max_threads; ++i ) {
+    unsigned int nodes = threads[i].node_count.load(std::memory_order_acquire);
+    for ( unsigned int j = 0; j < nodes; ++j ) {
+      if ( threads[i].nodes[j].stage != stage ) { continue; }
+      MonotonicTime time = threads[i].nodes[j].accumulator.maximum_time.load(std::memory_order_relaxed);
+      if ( time > maximum ) { maximum = time; }
+    }
+  }
+  return maximum;
+}
+
+/**
+ * @brief The profile in folded stack format, self times in microseconds.
+ *
+ * One line per thread and path of nested stages, e.g.
+ * "io;decode;gp_input;event_manager;emit_input_event 12", as read by
+ * flamegraph.pl, speedscope and friends.
+ */
+std::string Profiler::folded() const {
+  std::ostringstream ostream;
+  for ( unsigned int i = 0; i < max_threads; ++i ) {
+    const ThreadRecord &thread = threads[i];
+    if ( thread.state.load(std::memory_order_acquire) != ThreadRecord::Ready ) {
+      continue;
+    }
+    unsigned int nodes = thread.node_count.load(std::memory_order_acquire);
+    for ( unsigned int j = 0; j < nodes; ++j ) {
+      if ( thread.nodes[j].accumulator.count.load(std::memory_order_relaxed) == 0 ) {
+        continue;
+      }
+      MonotonicTime self_time = thread.nodes[j].accumulator.self_time.load(std::memory_order_relaxed);
+      ostream << thread.name << ";" << path(thread, j) << " " << ( self_time > 0 ? self_time / 1000 : 0 ) << "\n";
+    }
+  }
+  return ostream.str();
+}
+
+/**
+ * @brief One line per stage that ran, with its count and timing summed over the places it ran in.
+ */
+std::string Profiler::toString() const {
+  std::ostringstream ostream;
+  ostream << std::fixed << std::setprecision(1);
+  for ( unsigned int i = 0; i < NumberOfStages; ++i ) {
+    Stage stage = static_cast<Stage>(i);
+    unsigned long n = count(stage);
+    if ( n == 0 ) {
+      continue;
+    }
+    ostream << name(stage) << " : count " << n
+            << ", mean " << static_cast<double>(totalTime(stage)) / static_cast<double>(n) * 1.0e-3 << "us"
+            << ", self " << static_cast<double>(selfTime(stage)) / static_cast<double>(n) * 1.0e-3 << "us"
+            << ", max " << static_cast<double>(maximumTime(stage)) * 1.0e-3 << "us" << std::endl;
+  }
+  return ostream.str();
+}
+
+std::string Profiler::path(const ThreadRecord &thread, const int &node) {
+  const ThreadRecord::Node &here = thread.nodes[node];
+  if ( here.parent < 0 ) {
+    return name(here.stage);
+  }
+  return path(thread, here.parent) + ";" + name(here.stage);
+}
+
+/*****************************************************************************
+** Implementation [Stages]
+*****************************************************************************/
+
+std::string Profiler::name(const Stage &stage) {
+  if ( stage >= FirstEmit && stage < NumberOfStages ) {
+    return std::string("emit_") + SlotMonitor::name(static_cast<SlotMonitor::Channel>(stage - FirstEmit));
+  }
+  switch ( stage ) {
+    case Read : return "read";
+    case Framing : return "framing";
+    case DebugLog : return "debug_log";
+    case Decode : return "decode";
+    case DecodeCoreSensors : return "core_sensors";
+    case DecodeDockIR : return "dock_ir";
+    case DecodeInertia : return "inertia";
+    case DecodeCliff : return "cliff";
+    case DecodeCurrent : return "current";
+    case DecodeHardware : return "hardware";
+    case DecodeFirmware : return "firmware";
+    case DecodeThreeAxisGyro : return "three_axis_gyro";
+    case DecodeGpInput : return "gp_input";
+    case DecodeUniqueDeviceID : return "unique_device_id";
+    case DecodeControllerInfo : return "controller_info";
+    case DecodeUnknown : return "unknown_payload";
+    case EventManagerUpdate : return "event_manager";
+    case FieldWatch : return "field_watch";
+    case Publish : return "publish";
+    case SnapshotStore : return "snapshot_store";
+    case BaseControl : return "base_control";
+    case Transmit : return "transmit";
+    case TransmitWrite : return "write";
+    default : return "unknown";
+  }
+}
+
+/**
+ * @brief The decode stage of a sub-payload.
+ */
+Profiler::Stage Profiler::payloadStage(const unsigned char &header_id) {
+  switch ( header_id ) {
+    case Header::CoreSensors : return DecodeCoreSensors;
+    case Header::DockInfraRed : return DecodeDockIR;
+    case Header::Inertia : return DecodeInertia;
+    case Header::Cliff : return DecodeCliff;
+    case Header::Current : return DecodeCurrent;
+    case Header::Hardware : return DecodeHardware;
+    case Header::Firmware : return DecodeFirmware;
+    case Header::ThreeAxisGyro : return DecodeThreeAxisGyro;
+    case Header::GpInput : return DecodeGpInput;
+    case Header::UniqueDeviceID : return DecodeUniqueDeviceID;
+    case Header::ControllerInfo : return DecodeControllerInfo;
+    default : return DecodeUnknown;
+  }
+}
+
+} // namespace kobuki
@@ -0,0 +1,224 @@
+/**
+ * @file /kobuki_driver/src/driver/scheduling.cpp
+ *
+ * @brief Thread placement helpers.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <sstream>
+#include <ecl/config.hpp>
+#include "../../include/kobuki_driver/scheduling.hpp"
+
+#ifdef ECL_IS_POSIX
+  #include <pthread.h>
+  #include <sched.h>
+  #include <sys/mman.h>
+  #include <sys/resource.h>
+  #include <alloca.h>
+  #include <stdint.h>
+  #include <cstring>
+  #include <cerrno>
+  #ifdef __linux__
+    #define KOBUKI_HAS_AFFINITY
+  #endif
+#endif
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+const unsigned int stack_margin = 64 * 1024;          // left untouched for the frames the thread still needs
+const unsigned int fallback_stack_size = 2 * 1024 * 1024; // if the limit cannot be read or is unlimited
+}
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+bool pinCurrentThread(const int &cpu, std::string &error) {
+#ifdef KOBUKI_HAS_AFFINITY
+  if ( cpu < 0 || cpu >= CPU_SETSIZE ) {
+    error = "no such cpu";
+    return false;
+  }
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+  if ( result != 0 ) {
+    error = std::strerror(result);
+    return false;
+  }
+  return true;
+#else
+  error = "cpu affinity is not supported on this platform";
+  return false;
+#endif
+}
+
+bool setCurrentThreadAffinity(const unsigned long long &mask, std::string &error) {
+#ifdef KOBUKI_HAS_AFFINITY
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for ( int cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; ++cpu ) {
+    if ( mask & (1ULL << cpu) ) { CPU_SET(cpu, &cpus); }
+  }
+  if ( CPU_COUNT(&cpus) == 0 ) {
+    error = "empty cpu mask";
+    return false;
+  }
+  int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+  if ( result != 0 ) {
+    error = std::strerror(result);
+    return false;
+  }
+  return true;
+#else
+  error = "cpu affinity is not supported on this platform";
+  return false;
+#endif
+}
+
+bool setCurrentThreadScheduling(const SchedulingPolicy &policy, const int &priority, std::string &error) {
+#ifdef ECL_IS_POSIX
+  int posix_policy = SCHED_OTHER;
+  switch ( policy ) {
+    case FifoScheduling : { posix_policy = SCHED_FIFO; break; }
+    case RoundRobinScheduling : { posix_policy = SCHED_RR; break; }
+    default : break;
+  }
+  struct sched_param parameters;
+  std::memset(&parameters, 0, sizeof(parameters));
+  if ( posix_policy != SCHED_OTHER ) {
+    int minimum = sched_get_priority_min(posix_policy);
+    int maximum = sched_get_priority_max(posix_policy);
+    parameters.sched_priority = priority < minimum ? minimum : ( priority > maximum ? maximum : priority );
+  }
+  int result = pthread_setschedparam(pthread_self(), posix_policy, &parameters);
+  if ( result != 0 ) {
+    error = std::strerror(result);
+    if ( result == EPERM ) {
+      error += " (needs root, CAP_SYS_NICE or an rtprio limit)";
+    }
+    return false;
+  }
+  return true;
+#else
+  if ( policy == DefaultScheduling ) {
+    return true;
+  }
+  error = "real time scheduling is not supported on this platform";
+  return false;
+#endif
+}
+
+bool lockProcessMemory(std::string &error) {
+#ifdef ECL_IS_POSIX
+  if ( mlockall(MCL_CURRENT | MCL_FUTURE) != 0 ) {
+    error = std::strerror(errno);
+    if ( errno == EPERM || errno == ENOMEM ) {
+      error += " (needs root, CAP_IPC_LOCK or a sufficient memlock limit)";
+    }
+    return false;
+  }
+  return true;
+#else
+  error = "memory locking is not supported on this platform";
+  return false;
+#endif
+}
+
+unsigned int maximumPrefaultStackSize() {
+#ifdef ECL_IS_POSIX
+  unsigned long long limit = fallback_stack_size;
+  struct rlimit stack_limit;
+  if ( getrlimit(RLIMIT_STACK, &stack_limit) == 0 && stack_limit.rlim_cur != RLIM_INFINITY ) {
+    limit = stack_limit.rlim_cur;
+  }
+  if ( limit <= stack_margin ) { return 0; }
+  limit -= stack_margin;
+  return ( limit > 0xFFFFFFFFULL ) ? 0xFFFFFFFFU : static_cast<unsigned int>(limit);
+#else
+  return 0;
+#endif
+}
+
+unsigned int prefaultStack(const unsigned int &size) {
+#ifdef ECL_IS_POSIX
+  if ( size == 0 ) {
+    return 0;
+  }
+  unsigned int available = maximumPrefaultStackSize();
+#ifdef __linux__
+  // what is left below this frame of the stack the thread really has
+  pthread_attr_t attributes;
+  if ( pthread_getattr_np(pthread_self(), &attributes) == 0 ) {
+    void *stack_address = NULL;
+    size_t stack_size = 0;
+    if ( pthread_attr_getstack(&attributes, &stack_address, &stack_size) == 0 && stack_address != NULL ) {
+      unsigned char marker = 0;
+      uintptr_t here = reinterpret_cast<uintptr_t>(&marker);
+      uintptr_t bottom = reinterpret_cast<uintptr_t>(stack_address);
+      uintptr_t left = ( here > bottom + stack_margin ) ? here - bottom - stack_margin : 0;
+      if ( left < available ) { available = static_cast<unsigned int>(left); }
+    }
+    pthread_attr_destroy(&attributes);
+  }
+#endif
+  unsigned int touched = ( size < available ) ? size : available;
+  if ( touched == 0 ) {
+    return 0;
+  }
+  volatile unsigned char *stack = static_cast<volatile unsigned char*>(alloca(touched));
+  for ( unsigned int i = 0; i < touched; i += 4096 ) {
+    stack[i] = 0;
+  }
+  stack[touched - 1] = 0;
+  return touched;
+#else
+  return 0;
+#endif
+}
+
+std::string describeCurrentThreadScheduling() {
+  std::ostringstream description;
+#ifdef ECL_IS_POSIX
+  int policy = SCHED_OTHER;
+  struct sched_param parameters;
+  std::memset(&parameters, 0, sizeof(parameters));
+  pthread_getschedparam(pthread_self(), &policy, &parameters);
+  switch ( policy ) {
+    case SCHED_FIFO : { description << "SCHED_FIFO priority " << parameters.sched_priority; break; }
+    case SCHED_RR : { description << "SCHED_RR priority " << parameters.sched_priority; break; }
+    default : { description << "SCHED_OTHER"; break; }
+  }
+#ifdef KOBUKI_HAS_AFFINITY
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  if ( pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus) == 0 ) {
+    description << ", cpus";
+    for ( int cpu = 0; cpu < CPU_SETSIZE; ++cpu ) {
+      if ( CPU_ISSET(cpu, &cpus) ) { description << " " << cpu; }
+    }
+  }
+#endif
+#else
+  description << "default scheduling";
+#endif
+  return description.str();
+}
+
+} // namespace kobuki
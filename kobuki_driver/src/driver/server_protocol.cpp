@@ -0,0 +1,214 @@
+/**
+ * @file /kobuki_driver/src/driver/server_protocol.cpp
+ *
+ * @brief Encoding and decoding of the kobuki server's messages.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cstring>
+#include "../../include/kobuki_driver/server_protocol.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+namespace protocol {
+
+/*****************************************************************************
+** Frame Layout
+*****************************************************************************/
+
+namespace {
+/*
+ * Where each sub-payload lives in a frame. Only those that arrived with the
+ * frame go over the wire, in this order.
+ */
+struct Section {
+  Header::PayloadType type;
+  std::size_t offset;
+  std::size_t size;
+};
+
+#define KOBUKI_SECTION(type, first, last) \
+  { Header::type, offsetof(Frame, first), offsetof(Frame, last) + sizeof(((Frame*)0)->last) - offsetof(Frame, first) }
+
+const Section sections[] = {
+  KOBUKI_SECTION(CoreSensors, core_sensors, core_sensors),
+  KOBUKI_SECTION(DockInfraRed, dock_ir, dock_ir),
+  KOBUKI_SECTION(Inertia, inertia, inertia),
+  KOBUKI_SECTION(Cliff, cliff_bottom, cliff_bottom),
+  KOBUKI_SECTION(Current, current, current),
+  KOBUKI_SECTION(Hardware, hardware_version, hardware_version),
+  KOBUKI_SECTION(Firmware, firmware_version, firmware_version),
+  KOBUKI_SECTION(ThreeAxisGyro, three_axis_gyro, three_axis_gyro), // trimmed to the samples it holds, see sectionSize()
+  KOBUKI_SECTION(GpInput, digital_input, analog_input),
+  KOBUKI_SECTION(UniqueDeviceID, udid, udid),
+  KOBUKI_SECTION(ControllerInfo, controller_info, controller_info)
+};
+const unsigned int number_of_sections = sizeof(sections) / sizeof(Section);
+
+#undef KOBUKI_SECTION
+
+const std::size_t gyro_header_size = offsetof(ThreeAxisGyro::Data, data);
+
+std::size_t sectionSize(const Section &section, const Frame &frame) {
+  if ( section.type == Header::ThreeAxisGyro ) {
+    std::size_t samples = frame.three_axis_gyro.followed_data_length;
+    if ( samples > MAX_DATA_SIZE ) { samples = MAX_DATA_SIZE; }
+    return gyro_header_size + samples * sizeof(frame.three_axis_gyro.data[0]);
+  }
+  return section.size;
+}
+}
+
+/*****************************************************************************
+** Implementation [Encoding]
+*****************************************************************************/
+
+/**
+ * @brief Encode a message.
+ *
+ * @param type : of the message.
+ * @param body : the body, may be NULL if the length is 0.
+ * @param length : bytes in the body, no more than max_body_size.
+ * @param buffer : at least sizeof(MessageHeader) + length bytes.
+ * @return unsigned int : bytes written.
+ */
+unsigned int encode(const MessageType &type, const void *body, const unsigned int &length, unsigned char *buffer) {
+  MessageHeader header;
+  header.type = static_cast<uint8_t>(type);
+  header.flags = 0;
+  header.length = static_cast<uint16_t>(length);
+  std::memcpy(buffer, &header, sizeof(MessageHeader));
+  if ( length > 0 ) {
+    std::memcpy(buffer + sizeof(MessageHeader), body, length);
+  }
+  return sizeof(MessageHeader) + length;
+}
+
+/**
+ * @brief Encode a frame: its info, the mask of sub-payloads and those sub-payloads only.
+ *
+ * A core sensors only frame (the usual 50Hz stream) comes to around 70 bytes,
+ * a fraction of sizeof(Frame).
+ *
+ * @param frame : the frame.
+ * @param flags : FrameFlags.
+ * @param buffer : at least sizeof(MessageHeader) + max_body_size bytes.
+ * @return unsigned int : bytes written.
+ */
+unsigned int encodeFrame(const Frame &frame, const uint8_t &flags, unsigned char *buffer) {
+  unsigned char *body = buffer + sizeof(MessageHeader);
+  std::size_t length = 0;
+  std::memcpy(body + length, &frame.info, sizeof(FrameInfo));
+  length += sizeof(FrameInfo);
+  std::memcpy(body + length, &frame.payloads, sizeof(frame.payloads));
+  length += sizeof(frame.payloads);
+  const unsigned char *fields = reinterpret_cast<const unsigned char*>(&frame);
+  for ( unsigned int i = 0; i < number_of_sections; ++i ) {
+    if ( frame.contains(sections[i].type) ) {
+      std::size_t size = sectionSize(sections[i], frame);
+      std::memcpy(body + length, fields + sections[i].offset, size);
+      length += size;
+    }
+  }
+  MessageHeader header;
+  header.type = FrameData;
+  header.flags = flags;
+  header.length = static_cast<uint16_t>(length);
+  std::memcpy(buffer, &header, sizeof(MessageHeader));
+  return static_cast<unsigned int>(sizeof(MessageHeader) + length);
+}
+
+/**
+ * @brief Decode a frame into the last one received.
+ *
+ * Like the driver's own frames, sub-payloads that did not come with this
+ * frame keep their previous values.
+ *
+ * @param body : the body of a FrameData message.
+ * @param length : its length.
+ * @param frame : the last frame received, updated in place.
+ * @return bool : false if the body is malformed (the frame may be partly updated).
+ */
+bool decodeFrame(const unsigned char *body, const unsigned int &length, Frame &frame) {
+  std::size_t position = sizeof(FrameInfo) + sizeof(frame.payloads);
+  if ( length < position ) {
+    return false;
+  }
+  std::memcpy(&frame.info, body, sizeof(FrameInfo));
+  std::memcpy(&frame.payloads, body + sizeof(FrameInfo), sizeof(frame.payloads));
+  unsigned char *fields = reinterpret_cast<unsigned char*>(&frame);
+  for ( unsigned int i = 0; i < number_of_sections; ++i ) {
+    if ( !frame.contains(sections[i].type) ) {
+      continue;
+    }
+    std::size_t size = sections[i].size;
+    if ( sections[i].type == Header::ThreeAxisGyro ) {
+      if ( length < position + gyro_header_size ) {
+        return false;
+      }
+      std::memcpy(fields + sections[i].offset, body + position, gyro_header_size);
+      size = sectionSize(sections[i], frame);
+    }
+    if ( length < position + size ) {
+      return false;
+    }
+    std::memcpy(fields + sections[i].offset, body + position, size);
+    position += size;
+  }
+  return position == length;
+}
+
+/*****************************************************************************
+** Implementation [MessageStream]
+*****************************************************************************/
+
+/**
+ * @brief Where to receive into, spaceLeft() bytes long.
+ *
+ * This moves any unread bytes to the front, so bodies returned by next()
+ * are no longer valid afterwards.
+ */
+unsigned char* MessageStream::space() {
+  if ( begin > 0 ) {
+    std::memmove(buffer, buffer + begin, end - begin);
+    end -= begin;
+    begin = 0;
+  }
+  return buffer + end;
+}
+
+/**
+ * @brief The next whole message, if there is one.
+ *
+ * @param header : filled with the message's header.
+ * @param body : pointed at the message's body, valid until space() is next called.
+ * @return bool : false if no whole message has arrived yet, or the stream is corrupt.
+ */
+bool MessageStream::next(MessageHeader &header, const unsigned char *&body) {
+  if ( is_corrupt || end - begin < sizeof(MessageHeader) ) {
+    return false;
+  }
+  std::memcpy(&header, buffer + begin, sizeof(MessageHeader));
+  if ( header.length > max_body_size ) {
+    is_corrupt = true;
+    return false;
+  }
+  if ( end - begin < sizeof(MessageHeader) + header.length ) {
+    return false;
+  }
+  body = buffer + begin + sizeof(MessageHeader);
+  begin += sizeof(MessageHeader) + header.length;
+  return true;
+}
+
+} // namespace protocol
+} // namespace kobuki
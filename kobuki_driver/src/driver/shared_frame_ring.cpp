@@ -0,0 +1,382 @@
+/**
+ * @file /kobuki_driver/src/driver/shared_frame_ring.cpp
+ *
+ * @brief Implementation of the shared memory frame ring.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <ecl/config.hpp>
+#include "../../include/kobuki_driver/shared_frame_ring.hpp"
+
+#ifdef ECL_IS_POSIX
+  #include <fcntl.h>
+  #include <signal.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Layout
+*****************************************************************************/
+
+namespace {
+const uint32_t ring_magic = 0x4b424b46; // "KBKF"
+const uint32_t ring_version = 1;
+const unsigned int frame_words = (sizeof(Frame) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+/*
+ * A frame in the ring. The sequence is 2n+1 while frame n is being written
+ * and 2n+2 once it is complete; the frame itself is kept in relaxed atomic
+ * words so that a reader overlapping the writer is well defined (it notices
+ * from the sequence and throws its copy away).
+ */
+struct Slot {
+  std::atomic<uint64_t> sequence;
+  std::atomic<uint64_t> words[frame_words];
+};
+}
+
+/**
+ * @brief Header of the shared memory, followed by the slots.
+ *
+ * Everything in it is address free, so it works the same mapped at different
+ * addresses in different processes.
+ */
+struct SharedFrameRing {
+  std::atomic<uint32_t> magic; // written last, readers wait for it
+  uint32_t version;
+  uint32_t frame_size;         // sizeof(Frame), guards against mismatched builds
+  uint32_t capacity;           // number of slots, a power of two
+  int32_t writer_pid;
+  std::atomic<uint32_t> writer_open;
+  char padding[64];
+  std::atomic<uint64_t> head;  // frames written so far
+  char padding_after[64];
+};
+
+namespace {
+Slot* slotAt(SharedFrameRing *ring, const uint64_t &sequence) {
+  return reinterpret_cast<Slot*>(reinterpret_cast<char*>(ring) + sizeof(SharedFrameRing))
+         + (sequence & (ring->capacity - 1));
+}
+
+const Slot* slotAt(const SharedFrameRing *ring, const uint64_t &sequence) {
+  return reinterpret_cast<const Slot*>(reinterpret_cast<const char*>(ring) + sizeof(SharedFrameRing))
+         + (sequence & (ring->capacity - 1));
+}
+
+size_t ringSize(const unsigned int &capacity) {
+  return sizeof(SharedFrameRing) + capacity * sizeof(Slot);
+}
+}
+
+/*****************************************************************************
+** Implementation [Writer]
+*****************************************************************************/
+
+SharedFrameWriter::SharedFrameWriter() :
+  ring(NULL),
+  size(0)
+{}
+
+SharedFrameWriter::~SharedFrameWriter() {
+  close();
+}
+
+/**
+ * @brief Create the shared memory and start publishing into it.
+ *
+ * A ring left behind by a writer that is no longer running is replaced; one
+ * whose writer is still running is left alone and an error returned.
+ *
+ * @param name : posix shared memory name, e.g. "/kobuki_frames".
+ * @param capacity : number of frames kept, rounded up to a power of two.
+ * @param error : the reason if it failed.
+ * @return bool : whether the ring is open.
+ */
+bool SharedFrameWriter::open(const std::string &name, const unsigned int &capacity, std::string &error) {
+  close();
+#ifdef ECL_IS_POSIX
+  unsigned int slots = 2;
+  while ( slots < capacity ) { slots <<= 1; }
+  size_t ring_size = ringSize(slots);
+
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  if ( fd < 0 && errno == EEXIST ) {
+    SharedFrameReader existing;
+    std::string ignored;
+    if ( existing.open(name, ignored) && existing.writerAlive() ) {
+      error = "another driver is already publishing to " + name;
+      return false;
+    }
+    shm_unlink(name.c_str());
+    fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  }
+  if ( fd < 0 ) {
+    error = std::string("shm_open failed [") + std::strerror(errno) + "]";
+    return false;
+  }
+  if ( ftruncate(fd, static_cast<off_t>(ring_size)) != 0 ) {
+    error = std::string("ftruncate failed [") + std::strerror(errno) + "]";
+    ::close(fd);
+    shm_unlink(name.c_str());
+    return false;
+  }
+  void *memory = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if ( memory == MAP_FAILED ) {
+    error = std::string("mmap failed [") + std::strerror(errno) + "]";
+    shm_unlink(name.c_str());
+    return false;
+  }
+  // the memory comes zeroed, which is a valid (empty) state for all the atomics
+  ring = static_cast<SharedFrameRing*>(memory);
+  ring->version = ring_version;
+  ring->frame_size = sizeof(Frame);
+  ring->capacity = slots;
+  ring->writer_pid = static_cast<int32_t>(getpid());
+  ring->writer_open.store(1, std::memory_order_relaxed);
+  ring->head.store(0, std::memory_order_relaxed);
+  ring->magic.store(ring_magic, std::memory_order_release);
+  this->name = name;
+  size = ring_size;
+  return true;
+#else
+  error = "shared memory rings need posix";
+  return false;
+#endif
+}
+
+/**
+ * @brief Stop publishing and remove the shared memory (readers keep their mapping until they close).
+ */
+void SharedFrameWriter::close() {
+#ifdef ECL_IS_POSIX
+  if ( ring != NULL ) {
+    ring->writer_open.store(0, std::memory_order_release);
+    munmap(ring, size);
+    shm_unlink(name.c_str());
+  }
+#endif
+  ring = NULL;
+  size = 0;
+}
+
+/**
+ * @brief Publish a frame (only one thread may write).
+ */
+void SharedFrameWriter::write(const Frame &frame) {
+  if ( ring == NULL ) {
+    return;
+  }
+  uint64_t words[frame_words];
+  words[frame_words - 1] = 0;
+  std::memcpy(words, &frame, sizeof(Frame));
+
+  uint64_t sequence = ring->head.load(std::memory_order_relaxed);
+  Slot *slot = slotAt(ring, sequence);
+  slot->sequence.store(2 * sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for ( unsigned int i = 0; i < frame_words; ++i ) {
+    slot->words[i].store(words[i], std::memory_order_relaxed);
+  }
+  slot->sequence.store(2 * sequence + 2, std::memory_order_release);
+  ring->head.store(sequence + 1, std::memory_order_release);
+}
+
+/*****************************************************************************
+** Implementation [Reader]
+*****************************************************************************/
+
+SharedFrameReader::SharedFrameReader() :
+  ring(NULL),
+  size(0),
+  next_sequence(0),
+  overrun_count(0),
+  frames_lost(0)
+{}
+
+SharedFrameReader::~SharedFrameReader() {
+  close();
+}
+
+/**
+ * @brief Attach to a ring published by a driver.
+ *
+ * Reading starts with the next frame the driver publishes.
+ *
+ * @param name : posix shared memory name, e.g. "/kobuki_frames".
+ * @param error : the reason if it failed.
+ * @return bool : whether the ring is open.
+ */
+bool SharedFrameReader::open(const std::string &name, std::string &error) {
+  close();
+#ifdef ECL_IS_POSIX
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if ( fd < 0 ) {
+    error = std::string("shm_open failed [") + std::strerror(errno) + "], is the driver publishing to " + name + "?";
+    return false;
+  }
+  struct stat status;
+  if ( fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < sizeof(SharedFrameRing) ) {
+    error = "the shared memory is not (yet) a frame ring";
+    ::close(fd);
+    return false;
+  }
+  size_t mapped_size = static_cast<size_t>(status.st_size);
+  void *memory = mmap(NULL, mapped_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if ( memory == MAP_FAILED ) {
+    error = std::string("mmap failed [") + std::strerror(errno) + "]";
+    return false;
+  }
+  const SharedFrameRing *mapped = static_cast<const SharedFrameRing*>(memory);
+  if ( mapped->magic.load(std::memory_order_acquire) != ring_magic ) {
+    error = "the shared memory is not (yet) a frame ring";
+  } else if ( mapped->version != ring_version || mapped->frame_size != sizeof(Frame) ) {
+    error = "the frame ring was written by an incompatible version of the driver";
+  } else if ( mapped_size < ringSize(mapped->capacity) ) {
+    error = "the frame ring is truncated";
+  } else {
+    ring = mapped;
+    size = mapped_size;
+    next_sequence = ring->head.load(std::memory_order_acquire);
+    overrun_count = 0;
+    frames_lost = 0;
+    return true;
+  }
+  munmap(memory, mapped_size);
+  return false;
+#else
+  error = "shared memory rings need posix";
+  return false;
+#endif
+}
+
+void SharedFrameReader::close() {
+#ifdef ECL_IS_POSIX
+  if ( ring != NULL ) {
+    munmap(const_cast<SharedFrameRing*>(ring), size);
+  }
+#endif
+  ring = NULL;
+  size = 0;
+}
+
+/**
+ * @brief The next frame in the stream.
+ *
+ * @param frame : filled with the frame, unless there is no new one.
+ * @return Result : whether a frame was read, and whether frames were lost before it.
+ */
+SharedFrameReader::Result SharedFrameReader::read(Frame &frame) {
+  if ( ring == NULL ) {
+    return NoNewFrame;
+  }
+  bool overrun = false;
+  for (;;) {
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    if ( next_sequence >= head ) {
+      return NoNewFrame;
+    }
+    // keep one slot clear of the one the writer fills next
+    uint64_t oldest = ( head > ring->capacity - 1 ) ? head - (ring->capacity - 1) : 0;
+    if ( next_sequence < oldest ) {
+      frames_lost += oldest - next_sequence;
+      next_sequence = oldest;
+      overrun = true;
+    }
+    if ( copy(next_sequence, frame) ) {
+      ++next_sequence;
+      if ( overrun ) {
+        ++overrun_count;
+        return Overrun;
+      }
+      return FrameRead;
+    }
+    overrun = true; // overwritten while copying, go round again
+  }
+}
+
+/**
+ * @brief The newest frame, skipping any not yet read (they do not count as lost).
+ *
+ * @param frame : filled with the frame, unless nothing has been published yet.
+ * @return bool : false if nothing has been published yet.
+ */
+bool SharedFrameReader::latest(Frame &frame) {
+  if ( ring == NULL ) {
+    return false;
+  }
+  for (;;) {
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    if ( head == 0 ) {
+      return false;
+    }
+    if ( copy(head - 1, frame) ) {
+      next_sequence = head;
+      return true;
+    }
+  }
+}
+
+uint64_t SharedFrameReader::available() const {
+  if ( ring == NULL ) {
+    return 0;
+  }
+  uint64_t head = ring->head.load(std::memory_order_acquire);
+  return ( head > next_sequence ) ? head - next_sequence : 0;
+}
+
+/**
+ * @brief Whether the driver that created the ring is still publishing.
+ */
+bool SharedFrameReader::writerAlive() const {
+  if ( ring == NULL || ring->writer_open.load(std::memory_order_acquire) == 0 ) {
+    return false;
+  }
+#ifdef ECL_IS_POSIX
+  return ( kill(static_cast<pid_t>(ring->writer_pid), 0) == 0 || errno == EPERM );
+#else
+  return true;
+#endif
+}
+
+/*
+ * Copy a frame out of its slot, false if the slot no longer (or not yet) holds it.
+ */
+bool SharedFrameReader::copy(const uint64_t &sequence, Frame &frame) const {
+  const Slot *slot = slotAt(ring, sequence);
+  uint64_t words[frame_words];
+  uint64_t before = slot->sequence.load(std::memory_order_acquire);
+  if ( before != 2 * sequence + 2 ) {
+    return false;
+  }
+  for ( unsigned int i = 0; i < frame_words; ++i ) {
+    words[i] = slot->words[i].load(std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if ( slot->sequence.load(std::memory_order_relaxed) != before ) {
+    return false;
+  }
+  std::memcpy(&frame, words, sizeof(Frame));
+  return true;
+}
+
+} // namespace kobuki
@@ -0,0 +1,124 @@
+/**
+ * @file /kobuki_driver/src/driver/slot_monitor.cpp
+ *
+ * @brief Implementation of the slot execution time monitor.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <sstream>
+#include <iomanip>
+#include "../../include/kobuki_driver/slot_monitor.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+const MonotonicTime warning_interval = 1000000000LL; // [ns]
+}
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+SlotMonitor::SlotMonitor() :
+  slot_budget(0)
+{
+  for ( unsigned int i = 0; i < NumberOfChannels; ++i ) {
+    overrun_counts[i].store(0, std::memory_order_relaxed);
+    last_warning_times[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+/**
+ * @param sigslots_namespace : where to send the overrun warnings.
+ * @param budget : allowed time per emit [s], zero or less disables the warnings.
+ */
+void SlotMonitor::init(const std::string &sigslots_namespace, const double &budget) {
+  this->sigslots_namespace = sigslots_namespace;
+  slot_budget = ( budget > 0.0 ) ? static_cast<MonotonicTime>(budget * 1.0e9) : 0;
+  sig_warn.connect(sigslots_namespace + std::string("/ros_warn"));
+}
+
+/**
+ * @brief Record an emit that has just returned.
+ *
+ * @param channel : the signal that was emitted.
+ * @param start_time : when the emit began.
+ */
+void SlotMonitor::record(const Channel &channel, const MonotonicTime &start_time) {
+  MonotonicTime now = monotonicNow();
+  MonotonicTime duration = now - start_time;
+  histograms[channel].add(duration);
+  if ( slot_budget == 0 || duration <= slot_budget ) {
+    return;
+  }
+  unsigned long count = overrun_counts[channel].fetch_add(1, std::memory_order_relaxed) + 1;
+  MonotonicTime last_warning_time = last_warning_times[channel].load(std::memory_order_relaxed);
+  if ( last_warning_time == 0 || now - last_warning_time >= warning_interval ) {
+    // only the thread that moves the time on warns, if several overrun at once
+    if ( !last_warning_times[channel].compare_exchange_strong(last_warning_time, now, std::memory_order_relaxed) ) {
+      return;
+    }
+    std::ostringstream ostream;
+    ostream << std::fixed << std::setprecision(2)
+            << "slots of " << sigslots_namespace << "/" << name(channel)
+            << " took " << static_cast<double>(duration) * 1.0e-6 << "ms"
+            << " (budget " << static_cast<double>(slot_budget) * 1.0e-6 << "ms, "
+            << count << " overruns so far), they are holding up the driver.";
+    sig_warn.emit(ostream.str());
+  }
+}
+
+/**
+ * @brief The sigslots topic of a channel (without the namespace).
+ */
+const char* SlotMonitor::name(const Channel &channel) {
+  switch ( channel ) {
+    case StreamDataSlots : return "stream_data";
+    case ControllerInfoSlots : return "controller_info";
+    case VersionInfoSlots : return "version_info";
+    case RawDataStreamSlots : return "raw_data_stream";
+    case RawDataCommandSlots : return "raw_data_command";
+    case RawControlCommandSlots : return "raw_control_command";
+    case ButtonEventSlots : return "button_event";
+    case BumperEventSlots : return "bumper_event";
+    case CliffEventSlots : return "cliff_event";
+    case WheelEventSlots : return "wheel_event";
+    case PowerEventSlots : return "power_event";
+    case InputEventSlots : return "input_event";
+    case RobotEventSlots : return "robot_event";
+    case EventBatchSlots : return "event_batch";
+    default : return "unknown";
+  }
+}
+
+/**
+ * @brief One line per signal that has been emitted, with its timing and overruns.
+ */
+std::string SlotMonitor::toString() const {
+  std::ostringstream ostream;
+  for ( unsigned int i = 0; i < NumberOfChannels; ++i ) {
+    Channel channel = static_cast<Channel>(i);
+    if ( histograms[i].count() == 0 ) {
+      continue;
+    }
+    ostream << name(channel) << " : " << histograms[i].toString()
+            << ", overruns " << overruns(channel) << std::endl;
+  }
+  return ostream.str();
+}
+
+} // namespace kobuki
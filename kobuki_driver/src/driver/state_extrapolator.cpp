@@ -0,0 +1,199 @@
+/**
+ * @file /kobuki_driver/src/driver/state_extrapolator.cpp
+ *
+ * @brief Implementation of the state extrapolator.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cmath>
+#include <ecl/math.hpp>
+#include <ecl/geometry/angle.hpp>
+#include "../../include/kobuki_driver/modules/state_extrapolator.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+const int64_t maximum_frame_gap = 1000; // [ms], longer gaps restart the rates rather than average over them
+const double centidegrees_to_rad = ecl::pi / 18000.0;
+}
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+/**
+ * @param wheel_bias : distance between the wheels [m].
+ * @param wheel_radius : [m]
+ * @param tick_to_rad : wheel rotation per encoder tick [rad].
+ */
+StateExtrapolator::StateExtrapolator(const double &wheel_bias, const double &wheel_radius, const double &tick_to_rad) :
+  wheel_bias(wheel_bias),
+  wheel_radius(wheel_radius),
+  tick_to_rad(tick_to_rad),
+  model(ConstantVelocityModel),
+  maximum_horizon(100000000LL),
+  reset_requested(false),
+  anchor(),
+  initialised(false),
+  last_firmware_time(0),
+  last_left_encoder(0),
+  last_right_encoder(0),
+  last_angle(0),
+  gyro_heading(0.0),
+  heading_offset(0.0)
+{}
+
+/**
+ * @brief Choose the model and how far ahead of the newest frame to predict (any thread).
+ *
+ * @param model : the motion model.
+ * @param maximum_horizon : predictions further from the newest frame than this are held there [s].
+ */
+void StateExtrapolator::configure(const ExtrapolationModel &model, const double &maximum_horizon) {
+  this->model.store(model, std::memory_order_relaxed);
+  this->maximum_horizon.store(static_cast<MonotonicTime>(maximum_horizon * 1.0e9), std::memory_order_relaxed);
+}
+
+/**
+ * @brief Anchor the state on a new frame (only one thread may update).
+ *
+ * Frames without the core sensors are ignored. The first frame, and the first
+ * after a reset, zero the pose.
+ *
+ * @param frame : the new frame.
+ * @param wheel_left_angle : the left wheel's angle at this frame, on DiffDrive's scale (see DiffDrive::getWheelAngles) [rad].
+ * @param wheel_right_angle : the right wheel's, likewise [rad].
+ */
+void StateExtrapolator::update(const Frame &frame, const double &wheel_left_angle, const double &wheel_right_angle) {
+  if ( !frame.contains(Header::CoreSensors) ) {
+    return;
+  }
+  const CoreSensors::Data &core = frame.core_sensors;
+  bool has_gyro = frame.contains(Header::Inertia);
+  int64_t elapsed = frame.info.firmware_time - last_firmware_time;
+
+  double left = 0.0, right = 0.0, turn = 0.0; // this frame's increments [rad]
+  if ( initialised ) {
+    left = tick_to_rad * static_cast<double>(static_cast<int16_t>(core.left_encoder - last_left_encoder));
+    right = tick_to_rad * static_cast<double>(static_cast<int16_t>(core.right_encoder - last_right_encoder));
+    if ( has_gyro ) {
+      int difference = frame.inertia.angle - last_angle;
+      if ( difference > 18000 ) { difference -= 36000; }
+      if ( difference < -18000 ) { difference += 36000; }
+      turn = static_cast<double>(difference) * centidegrees_to_rad;
+    } else {
+      turn = wheel_radius * (right - left) / wheel_bias;
+    }
+  } else {
+    gyro_heading = has_gyro ? static_cast<double>(frame.inertia.angle) * centidegrees_to_rad : 0.0;
+    heading_offset = gyro_heading;
+    anchor = Anchor();
+  }
+  gyro_heading += turn;
+
+  if ( reset_requested.exchange(false, std::memory_order_acq_rel) ) {
+    anchor = Anchor();
+    heading_offset = gyro_heading;
+  } else {
+    double distance = wheel_radius * (left + right) / 2.0;
+    double heading = anchor.heading + turn / 2.0;
+    anchor.x += distance * std::cos(heading);
+    anchor.y += distance * std::sin(heading);
+  }
+  anchor.heading = gyro_heading - heading_offset;
+  anchor.wheel_left_angle = wheel_left_angle;
+  anchor.wheel_right_angle = wheel_right_angle;
+
+  if ( initialised && elapsed > 0 && elapsed < maximum_frame_gap ) {
+    double dt = static_cast<double>(elapsed) * 1.0e-3;
+    double left_rate = left / dt, right_rate = right / dt, angular_velocity = turn / dt;
+    if ( anchor.valid ) {
+      anchor.wheel_left_acceleration = (left_rate - anchor.wheel_left_rate) / dt;
+      anchor.wheel_right_acceleration = (right_rate - anchor.wheel_right_rate) / dt;
+      anchor.angular_acceleration = (angular_velocity - anchor.angular_velocity) / dt;
+    }
+    anchor.wheel_left_rate = left_rate;
+    anchor.wheel_right_rate = right_rate;
+    anchor.angular_velocity = angular_velocity;
+  } else {
+    // no usable interval (first frame, firmware restart or a long gap), hold still until the next
+    anchor.wheel_left_rate = anchor.wheel_right_rate = anchor.angular_velocity = 0.0;
+    anchor.wheel_left_acceleration = anchor.wheel_right_acceleration = anchor.angular_acceleration = 0.0;
+  }
+  anchor.valid = true;
+  anchor.time = ( frame.info.host_time != 0 ) ? frame.info.host_time : frame.info.receive_time;
+  published_anchor.store(anchor);
+
+  initialised = true;
+  last_firmware_time = frame.info.firmware_time;
+  last_left_encoder = core.left_encoder;
+  last_right_encoder = core.right_encoder;
+  if ( has_gyro ) {
+    last_angle = frame.inertia.angle;
+  }
+}
+
+/**
+ * @brief Predict the state at the given time (any thread, lock free).
+ *
+ * @param time : host monotonic time, e.g. monotonicNow().
+ * @param state : filled with the prediction.
+ * @return bool : false if no frame has arrived yet.
+ */
+bool StateExtrapolator::predict(const MonotonicTime &time, State &state) const {
+  Anchor anchor = published_anchor.load();
+  if ( !anchor.valid ) {
+    return false;
+  }
+  MonotonicTime horizon = time - anchor.time;
+  MonotonicTime limit = maximum_horizon.load(std::memory_order_relaxed);
+  if ( horizon > limit ) { horizon = limit; }
+  if ( horizon < -limit ) { horizon = -limit; }
+  double dt = toSeconds(horizon);
+
+  double left_acceleration = 0.0, right_acceleration = 0.0, angular_acceleration = 0.0;
+  if ( model.load(std::memory_order_relaxed) == ConstantAccelerationModel ) {
+    left_acceleration = anchor.wheel_left_acceleration;
+    right_acceleration = anchor.wheel_right_acceleration;
+    angular_acceleration = anchor.angular_acceleration;
+  }
+  state.time = time;
+  state.horizon = toSeconds(time - anchor.time);
+  state.wheel_left_angle_rate = anchor.wheel_left_rate + left_acceleration * dt;
+  state.wheel_right_angle_rate = anchor.wheel_right_rate + right_acceleration * dt;
+  state.wheel_left_angle = anchor.wheel_left_angle + (anchor.wheel_left_rate + 0.5 * left_acceleration * dt) * dt;
+  state.wheel_right_angle = anchor.wheel_right_angle + (anchor.wheel_right_rate + 0.5 * right_acceleration * dt) * dt;
+  state.angular_velocity = anchor.angular_velocity + angular_acceleration * dt;
+  state.linear_velocity = wheel_radius * (state.wheel_left_angle_rate + state.wheel_right_angle_rate) / 2.0;
+
+  // move along an arc with the mean rates over the interval
+  double v = wheel_radius * ((anchor.wheel_left_rate + anchor.wheel_right_rate) / 2.0
+                             + 0.25 * (left_acceleration + right_acceleration) * dt);
+  double w = anchor.angular_velocity + 0.5 * angular_acceleration * dt;
+  double turn = w * dt;
+  if ( std::fabs(turn) < 1.0e-6 ) {
+    state.x = anchor.x + v * dt * std::cos(anchor.heading + turn / 2.0);
+    state.y = anchor.y + v * dt * std::sin(anchor.heading + turn / 2.0);
+  } else {
+    state.x = anchor.x + v / w * (std::sin(anchor.heading + turn) - std::sin(anchor.heading));
+    state.y = anchor.y - v / w * (std::cos(anchor.heading + turn) - std::cos(anchor.heading));
+  }
+  state.heading = ecl::wrap_angle(anchor.heading + turn);
+  return true;
+}
+
+} // namespace kobuki
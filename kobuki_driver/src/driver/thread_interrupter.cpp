@@ -0,0 +1,136 @@
+/**
+ * @file /kobuki_driver/src/driver/thread_interrupter.cpp
+ *
+ * @brief Implementation of the blocking call interrupter.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include "../../include/kobuki_driver/thread_interrupter.hpp"
+
+#ifdef ECL_IS_POSIX
+  #include <signal.h>
+  #include <cstring>
+#endif
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Signal Handling
+*****************************************************************************/
+
+namespace {
+
+#ifdef ECL_IS_POSIX
+int interruptSignal() { return SIGRTMIN + 3; }
+
+void interruptHandler(int) {} // only there to make the blocking call return with EINTR
+
+bool installHandler() {
+  struct sigaction current;
+  if ( sigaction(interruptSignal(), NULL, &current) != 0 ) {
+    return false;
+  }
+  if ( current.sa_handler == interruptHandler ) {
+    return true;
+  }
+  if ( (current.sa_flags & SA_SIGINFO) || current.sa_handler != SIG_DFL ) {
+    return false; // the application has its own use for it
+  }
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  action.sa_handler = interruptHandler;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = 0; // no SA_RESTART, we want the call to give up
+  return sigaction(interruptSignal(), &action, NULL) == 0;
+}
+#endif
+
+} // namespace
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+ThreadInterrupter::ThreadInterrupter() :
+  installed(false),
+  registered(false),
+  in_blocking_call(false)
+{
+#ifdef ECL_IS_POSIX
+  static std::once_flag once;
+  static bool handler_installed = false;
+  std::call_once(once, []() { handler_installed = installHandler(); });
+  installed = handler_installed;
+#endif
+}
+
+/**
+ * @brief Make the calling thread the one to interrupt.
+ */
+void ThreadInterrupter::registerCurrentThread() {
+#ifdef ECL_IS_POSIX
+  thread = pthread_self();
+#endif
+  registered.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Call before the registered thread exits, so it is never signalled after.
+ */
+void ThreadInterrupter::unregisterCurrentThread() {
+  registered.store(false, std::memory_order_release);
+}
+
+bool ThreadInterrupter::isCurrentThread() const {
+#ifdef ECL_IS_POSIX
+  return registered.load(std::memory_order_acquire) && pthread_equal(thread, pthread_self());
+#else
+  return false;
+#endif
+}
+
+/**
+ * @brief Make the registered thread's blocking call return early.
+ *
+ * Does nothing unless the thread is inside a BlockingCall; a thread about
+ * to enter one may miss it, so callers waiting on the thread repeat it.
+ *
+ * Must not race with unregisterCurrentThread() - callers hold a lock that
+ * the registered thread takes to unregister.
+ */
+void ThreadInterrupter::interrupt() {
+#ifdef ECL_IS_POSIX
+  if ( !installed || !registered.load(std::memory_order_acquire) || !in_blocking_call.load(std::memory_order_acquire) ) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(blocking_call_mutex);
+  if ( in_blocking_call.load(std::memory_order_relaxed) ) {
+    pthread_kill(thread, interruptSignal());
+  }
+#endif
+}
+
+void ThreadInterrupter::enterBlockingCall() {
+  in_blocking_call.store(true, std::memory_order_release);
+}
+
+/*
+ * Under the lock, so an interrupt() that saw the flag has sent its signal
+ * (and the thread has taken it) before the thread moves on.
+ */
+void ThreadInterrupter::leaveBlockingCall() {
+  std::lock_guard<std::mutex> lock(blocking_call_mutex);
+  in_blocking_call.store(false, std::memory_order_relaxed);
+}
+
+} // namespace kobuki
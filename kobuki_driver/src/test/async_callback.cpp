@@ -0,0 +1,194 @@
+/**
+ * @file /kobuki_driver/src/test/async_callback.cpp
+ *
+ * @brief Checks the callbacks run on the worker pool.
+ *
+ * Values reach a slow callback in order and within the queue's policy,
+ * callbacks of one subscriber never overlap, disconnecting waits for a
+ * running callback, and a callback can disconnect itself without
+ * deadlocking. Returns non zero if a check fails.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <kobuki_driver/async_callback.hpp>
+#include "test_check.hpp"
+
+/*****************************************************************************
+** Globals
+*****************************************************************************/
+
+namespace {
+using kobuki::test::check;
+
+/*
+ * A subscriber that can be held inside its callback.
+ */
+class Subscriber {
+public:
+  Subscriber() : held(false), inside(0), overlapped(false), async(NULL), stop_at(-1) {}
+
+  void value(int value) {
+    if ( ++inside > 1 ) { overlapped = true; }
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      values.push_back(value);
+      entered.notify_all();
+      while ( held ) { released.wait(lock); }
+    }
+    --inside;
+    if ( value == stop_at ) { async->disconnect(); }
+  }
+
+  void hold() { std::lock_guard<std::mutex> lock(mutex); held = true; }
+  void release() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      held = false;
+    }
+    released.notify_all();
+  }
+
+  /*
+   * Wait for the callback to have had this many values, false after a second.
+   */
+  bool waitFor(const unsigned int &count) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return entered.wait_for(lock, std::chrono::seconds(1), [&]() { return values.size() >= count; });
+  }
+
+  std::vector<int> received() { std::lock_guard<std::mutex> lock(mutex); return values; }
+
+  std::mutex mutex;
+  std::condition_variable entered, released;
+  bool held;
+  std::vector<int> values;
+  std::atomic<int> inside;
+  std::atomic<bool> overlapped;
+  kobuki::AsyncCallback<int> *async; // disconnected from within the callback at stop_at
+  int stop_at;
+};
+
+/*
+ * Settles the pool: long enough for queued callbacks to run.
+ */
+void settle() { std::this_thread::sleep_for(std::chrono::milliseconds(50)); }
+
+void fifo(kobuki::CallbackWorkerPool &pool) {
+  kobuki::CallbackRegistry<int> registry;
+  Subscriber subscriber;
+  kobuki::AsyncCallback<int> async(pool, kobuki::Fifo, 4);
+  check(async.connect(registry, &Subscriber::value, subscriber) && async.isConnected(), "connects while the pool runs");
+  subscriber.hold();
+  registry.emit(0);
+  subscriber.waitFor(1);
+  for (int i = 1; i <= 6; ++i) { registry.emit(i); } // the callback is busy with 0
+  check(async.pending() == 4 && async.overflows() == 2, "Fifo keeps up to its capacity and counts what it drops");
+  subscriber.release();
+  subscriber.waitFor(5);
+  settle();
+  std::vector<int> values = subscriber.received();
+  check(values.size() == 5 && values[1] == 1 && values[4] == 4, "and delivers what it kept in order");
+  check(!subscriber.overlapped, "one subscriber's callbacks never overlap");
+}
+
+void latestOnly(kobuki::CallbackWorkerPool &pool) {
+  kobuki::CallbackRegistry<int> registry;
+  Subscriber subscriber;
+  kobuki::AsyncCallback<int> async(pool, kobuki::LatestOnly);
+  async.connect(registry, &Subscriber::value, subscriber);
+  subscriber.hold();
+  registry.emit(0);
+  subscriber.waitFor(1);
+  for (int i = 1; i <= 6; ++i) { registry.emit(i); }
+  subscriber.release();
+  subscriber.waitFor(2);
+  settle();
+  std::vector<int> values = subscriber.received();
+  check(values.size() == 2 && values[1] == 6 && async.overflows() == 5, "LatestOnly delivers only the newest value");
+}
+
+void disconnecting(kobuki::CallbackWorkerPool &pool) {
+  kobuki::CallbackRegistry<int> registry;
+  Subscriber subscriber;
+  kobuki::AsyncCallback<int> async(pool, kobuki::Fifo, 8);
+  async.connect(registry, &Subscriber::value, subscriber);
+  subscriber.hold();
+  registry.emit(0);
+  subscriber.waitFor(1);
+  registry.emit(1);
+  std::atomic<bool> returned(false);
+  std::thread disconnecting([&]() { async.disconnect(); returned = true; });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  check(!returned, "disconnect() waits for the running callback");
+  subscriber.release();
+  disconnecting.join();
+  settle();
+  check(subscriber.received().size() == 1 && !async.isConnected() && registry.empty(),
+        "and drops what was still queued");
+  registry.emit(2);
+  settle();
+  check(subscriber.received().size() == 1, "nothing arrives once disconnected");
+}
+
+void selfDisconnecting(kobuki::CallbackWorkerPool &pool) {
+  kobuki::CallbackRegistry<int> registry;
+  Subscriber subscriber;
+  kobuki::AsyncCallback<int> async(pool, kobuki::Fifo, 16);
+  subscriber.async = &async;
+  subscriber.stop_at = 3;
+  async.connect(registry, &Subscriber::value, subscriber);
+  for (int i = 0; i < 10; ++i) { registry.emit(i); }
+  settle();
+  std::vector<int> values = subscriber.received();
+  check(values.size() == 4 && values.back() == 3 && !async.isConnected() && registry.empty(),
+        "a callback can disconnect itself, nothing follows the value it stopped at");
+  check(async.connect(registry, &Subscriber::value, subscriber), "and be connected again afterwards");
+  subscriber.stop_at = -1;
+  registry.emit(10);
+  check(subscriber.waitFor(5) && subscriber.received().back() == 10, "and then receives again");
+}
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  std::thread watchdog([]() { // a deadlock fails the check instead of hanging it
+    std::this_thread::sleep_for(std::chrono::seconds(30));
+    std::printf("[FAIL] still running after 30s, deadlocked\n");
+    std::fflush(stdout);
+    std::_Exit(1);
+  });
+  watchdog.detach();
+
+  kobuki::CallbackWorkerPool pool;
+  kobuki::CallbackRegistry<int> registry;
+  Subscriber subscriber;
+  kobuki::AsyncCallback<int> idle(pool);
+  check(!idle.connect(registry, &Subscriber::value, subscriber) && registry.empty(), "connecting fails while the pool has no threads");
+  pool.start(2);
+  check(pool.threads() == 2, "the pool starts its threads");
+
+  fifo(pool);
+  latestOnly(pool);
+  disconnecting(pool);
+  selfDisconnecting(pool);
+
+  pool.stop();
+  check(pool.threads() == 0, "and stops them");
+  return kobuki::test::summary();
+}
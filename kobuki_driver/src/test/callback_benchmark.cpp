@@ -0,0 +1,144 @@
+/**
+ * @file /kobuki_driver/src/test/callback_benchmark.cpp
+ *
+ * @brief Emit cost of the callback registries against sigslots.
+ *
+ * Times emits with a growing number of subscribers, and with several
+ * threads emitting on the same registry at once. The callbacks do next to
+ * nothing, so the figures are the dispatch overhead alone.
+ **/
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <ecl/sigslots.hpp>
+#include <kobuki_driver/callback_registry.hpp>
+
+/*****************************************************************************
+** Globals
+*****************************************************************************/
+
+namespace {
+const unsigned int subscriber_counts[] = { 0, 1, 2, 4, 8, 16, 32 };
+const unsigned int thread_counts[] = { 1, 2, 4, 8 };
+
+unsigned long calls = 0; // not atomic, only the single threaded runs check it
+
+void count() { ++calls; }
+
+class Listener {
+public:
+  void tick() {} // still an indirect call, the registry cannot inline it
+};
+
+double nanoseconds(const std::chrono::steady_clock::duration &duration) {
+  return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
+
+/*
+ * Single threaded emits, per emit [ns].
+ */
+double timeSigslots(const unsigned int &subscribers, const unsigned long &emits) {
+  ecl::Signal<> signal;
+  signal.connect("/callback_benchmark/tick");
+  std::vector<ecl::Slot<>*> slots;
+  for (unsigned int i = 0; i < subscribers; ++i) {
+    slots.push_back(new ecl::Slot<>(&count));
+    slots.back()->connect("/callback_benchmark/tick");
+  }
+  calls = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < emits; ++i) { signal.emit(); }
+  double elapsed = nanoseconds(std::chrono::steady_clock::now() - start);
+  if ( calls != subscribers * emits ) { std::printf("sigslots missed calls!\n"); }
+  for (unsigned int i = 0; i < slots.size(); ++i) { delete slots[i]; }
+  return elapsed / emits;
+}
+
+double timeRegistry(const unsigned int &subscribers, const unsigned long &emits) {
+  kobuki::CallbackRegistry<> registry;
+  for (unsigned int i = 0; i < subscribers; ++i) { registry.connect(&count); }
+  calls = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < emits; ++i) { registry.emit(); }
+  double elapsed = nanoseconds(std::chrono::steady_clock::now() - start);
+  if ( calls != subscribers * emits ) { std::printf("registry missed calls!\n"); }
+  return elapsed / emits;
+}
+
+/*
+ * Several threads emitting on one registry to member function subscribers
+ * that do nothing (counting would measure the contention on the counters).
+ * Per emit of one thread [ns], i.e. the latency each emitter sees.
+ */
+double timeRegistryThreaded(const unsigned int &subscribers, const unsigned int &threads, const unsigned long &emits) {
+  kobuki::CallbackRegistry<> registry;
+  std::vector<Listener> listeners(subscribers);
+  for (unsigned int i = 0; i < subscribers; ++i) { registry.connect(&Listener::tick, listeners[i]); }
+  std::atomic<unsigned int> ready(0);
+  std::atomic<bool> go(false);
+  std::vector<double> elapsed(threads);
+  std::vector<std::thread> emitters;
+  for (unsigned int t = 0; t < threads; ++t) {
+    emitters.push_back(std::thread([&, t]() {
+      ready.fetch_add(1);
+      while ( !go.load() ) {}
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (unsigned long i = 0; i < emits; ++i) { registry.emit(); }
+      elapsed[t] = nanoseconds(std::chrono::steady_clock::now() - start);
+    }));
+  }
+  while ( ready.load() < threads ) {}
+  go.store(true);
+  double total = 0.0;
+  for (unsigned int t = 0; t < threads; ++t) {
+    emitters[t].join();
+    total += elapsed[t];
+  }
+  return total / threads / emits;
+}
+
+} // namespace
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  unsigned long emits = 1000000;
+  if ( argc > 1 ) { emits = std::strtoul(argv[1], NULL, 10); }
+  if ( emits == 0 ) {
+    std::printf("Usage: %s [emits per measurement]\n", argv[0]);
+    return 1;
+  }
+
+  std::printf("Single thread, per emit [ns]\n");
+  std::printf("  %12s %12s %12s\n", "subscribers", "sigslots", "registry");
+  for (unsigned int s = 0; s < sizeof(subscriber_counts) / sizeof(subscriber_counts[0]); ++s) {
+    std::printf("  %12u %12.1f %12.1f\n", subscriber_counts[s],
+                timeSigslots(subscriber_counts[s], emits), timeRegistry(subscriber_counts[s], emits));
+  }
+
+  // The sigslots emit goes through the global manager's tables, so only the
+  // registry is run from several threads.
+  std::printf("\nRegistry, concurrent emitters, per emit of each thread [ns]\n");
+  std::printf("  %12s", "subscribers");
+  for (unsigned int t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); ++t) {
+    std::printf(" %9u thr", thread_counts[t]);
+  }
+  std::printf("\n");
+  for (unsigned int s = 0; s < sizeof(subscriber_counts) / sizeof(subscriber_counts[0]); ++s) {
+    std::printf("  %12u", subscriber_counts[s]);
+    for (unsigned int t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); ++t) {
+      std::printf(" %13.1f", timeRegistryThreaded(subscriber_counts[s], thread_counts[t], emits));
+    }
+    std::printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file /kobuki_driver/src/test/command_queue.cpp
+ *
+ * @brief Checks the policies of the command queue.
+ *
+ * Velocity commands replace each other and jump the queue, one shot commands
+ * come out in order and are rejected (and counted) when the fifo is full, and
+ * nothing is lost or reordered with several threads pushing at once.
+ * Returns non zero if a check fails.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <thread>
+#include <vector>
+#include <kobuki_driver/command_queue.hpp>
+#include "test_check.hpp"
+
+/*****************************************************************************
+** Globals
+*****************************************************************************/
+
+namespace {
+using kobuki::test::check;
+
+/*
+ * A one shot command, tagged with who pushed it and in what order.
+ */
+kobuki::Command tagged(const unsigned int &producer, const unsigned int &sequence) {
+  return kobuki::Command::SetControllerGain(0, producer, sequence, 0);
+}
+
+void baseControl() {
+  kobuki::CommandQueue queue(4);
+  kobuki::Command command;
+  queue.push(kobuki::Command::SetVelocityControl(100, 0));
+  queue.push(tagged(0, 0));
+  queue.push(kobuki::Command::SetVelocityControl(200, -300));
+  queue.push(kobuki::Command::SetVelocityControl(-250, 400));
+  check(queue.superseded() == 2, "newer velocity commands supersede the pending one");
+  check(queue.pop(command) && command.data.command == kobuki::Command::BaseControl
+        && command.data.speed == -250 && command.data.radius == 400,
+        "only the latest velocity command comes out, ahead of the one shots");
+  check(queue.pop(command) && command.data.command == kobuki::Command::SetController,
+        "then the one shot command");
+  check(!queue.pop(command), "then nothing");
+}
+
+void oneShots() {
+  kobuki::CommandQueue queue(4);
+  kobuki::Command command;
+  check(queue.capacity() == 4, "capacity is the requested power of two");
+  bool accepted = true;
+  for (unsigned int i = 0; i < 4; ++i) { accepted = queue.push(tagged(0, i)) && accepted; }
+  check(accepted, "a full fifo's worth is accepted");
+  check(!queue.push(tagged(0, 4)) && queue.overflows() == 1, "one more is rejected and counted");
+  bool in_order = true;
+  for (unsigned int i = 0; i < 4; ++i) {
+    in_order = queue.pop(command) && command.data.i_gain == i && in_order;
+  }
+  check(in_order, "one shots come out in the order they went in");
+  check(queue.push(tagged(0, 5)) && queue.pop(command) && command.data.i_gain == 5,
+        "the fifo is usable again once drained");
+}
+
+void producers() {
+  const unsigned int number_of_producers = 4;
+  const unsigned int commands_per_producer = 100000;
+  kobuki::CommandQueue queue(64);
+  std::vector<std::thread> threads;
+  for (unsigned int p = 0; p < number_of_producers; ++p) {
+    threads.push_back(std::thread([&queue, p]() {
+      for (unsigned int i = 0; i < commands_per_producer; ++i) {
+        while ( !queue.push(tagged(p, i)) ) { std::this_thread::yield(); } // full, let the consumer catch up
+      }
+    }));
+  }
+  std::vector<unsigned int> next(number_of_producers, 0);
+  unsigned long received = 0;
+  bool in_order = true;
+  kobuki::Command command;
+  while ( received < number_of_producers * commands_per_producer ) {
+    if ( !queue.pop(command) ) { continue; }
+    unsigned int producer = command.data.p_gain;
+    if ( producer >= number_of_producers || command.data.i_gain != next[producer] ) {
+      in_order = false;
+      break;
+    }
+    ++next[producer];
+    ++received;
+  }
+  for (unsigned int p = 0; p < threads.size(); ++p) { threads[p].join(); }
+  check(in_order, "with several producers, each one's commands arrive complete and in order");
+  check(!queue.pop(command), "and nothing extra arrives");
+}
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  baseControl();
+  oneShots();
+  producers();
+  return kobuki::test::summary();
+}
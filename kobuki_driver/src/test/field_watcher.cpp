@@ -0,0 +1,183 @@
+/**
+ * @file /kobuki_driver/src/test/field_watcher.cpp
+ *
+ * @brief Checks the conditions of the field watcher.
+ *
+ * Feeds frames through the watcher as the decode stage would and checks when
+ * each condition is met, what the events carry, that replaced events are
+ * counted, and that waiting subscribers are woken by events, timeouts and
+ * unsubscribing. Returns non zero if a check fails.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <kobuki_driver/field_watcher.hpp>
+#include "test_check.hpp"
+
+/*****************************************************************************
+** Globals
+*****************************************************************************/
+
+namespace {
+using kobuki::test::check;
+
+/*
+ * Stands in for the decode stage.
+ */
+class Stream {
+public:
+  Stream(kobuki::FieldWatcher &watcher) : watcher(watcher) {
+    core_sensors.battery = 160;
+    core_sensors.charger = 0;
+    gp_input.digital_input = 0;
+  }
+
+  void battery(const uint8_t &raw) {
+    core_sensors.battery = raw;
+    send(1u << kobuki::Header::CoreSensors);
+  }
+
+  void analog(const uint16_t &raw, const bool &present = true) {
+    gp_input.analog_input[0] = raw;
+    send(present ? (1u << kobuki::Header::GpInput) : (1u << kobuki::Header::CoreSensors));
+  }
+
+  void send(const uint32_t &payloads) {
+    ++info.sequence;
+    watcher.update(info, payloads, core_sensors, current, gp_input);
+  }
+
+  kobuki::FrameInfo info;
+
+private:
+  kobuki::FieldWatcher &watcher;
+  kobuki::CoreSensors::Data core_sensors;
+  kobuki::Current::Data current;
+  kobuki::GpInput::Data gp_input;
+};
+
+/*
+ * Feeds the analog values through a fresh subscription, returns the frames
+ * (1 based, after the one setting the reference) the condition was met in.
+ */
+std::vector<unsigned int> met(const kobuki::FieldWatcher::Condition &condition, const std::vector<uint16_t> &values) {
+  kobuki::FieldWatcher watcher;
+  Stream stream(watcher);
+  int id = watcher.subscribe(kobuki::FieldWatcher::AnalogInput0, condition, 2000.0);
+  std::vector<unsigned int> frames;
+  kobuki::FieldWatcher::Event event;
+  for (unsigned int i = 0; i < values.size(); ++i) {
+    stream.analog(values[i]);
+    if ( watcher.poll(id, event) ) { frames.push_back(i); }
+  }
+  return frames;
+}
+
+void conditions() {
+  const uint16_t raw[] = { 1990, 2000, 2010, 2020, 2000, 1990, 2005, 1980 };
+  std::vector<uint16_t> values(raw, raw + sizeof(raw) / sizeof(raw[0]));
+  std::vector<unsigned int> rises = met(kobuki::FieldWatcher::RisesAbove, values);
+  check(rises.size() == 2 && rises[0] == 2 && rises[1] == 6, "RisesAbove is met going above the threshold, not on it");
+  std::vector<unsigned int> falls = met(kobuki::FieldWatcher::FallsBelow, values);
+  check(falls.size() == 2 && falls[0] == 5 && falls[1] == 7, "FallsBelow is met going below it, also from on it");
+  std::vector<unsigned int> crosses = met(kobuki::FieldWatcher::Crosses, values);
+  check(crosses.size() == 4, "Crosses is met both ways");
+}
+
+void changes() {
+  kobuki::FieldWatcher watcher;
+  Stream stream(watcher);
+  kobuki::FieldWatcher::Event event;
+  int id = watcher.subscribe(kobuki::FieldWatcher::BatteryVoltage, kobuki::FieldWatcher::ChangedBy, 0.2);
+  stream.battery(160); // sets the reference
+  stream.battery(161);
+  check(!watcher.poll(id, event), "ChangedBy is not met by less than the threshold");
+  stream.battery(162);
+  check(watcher.poll(id, event) && event.field == kobuki::FieldWatcher::BatteryVoltage
+        && std::abs(event.value - 16.2) < 1e-9 && std::abs(event.previous - 16.0) < 1e-9 && event.info.sequence == 3,
+        "but is by the threshold, the event in volts and carrying the frame's info");
+  stream.battery(161);
+  stream.battery(163);
+  check(!watcher.poll(id, event), "and measures from the last value reported");
+  stream.battery(164);
+  check(watcher.poll(id, event) && std::abs(event.previous - 16.2) < 1e-9, "not from the previous frame");
+
+  stream.battery(170);
+  stream.battery(180);
+  check(watcher.poll(id, event) && std::abs(event.value - 18.0) < 1e-9 && watcher.missed(id) == 1,
+        "an uncollected event is replaced by the newer one and counted as missed");
+
+  int analog = watcher.subscribe(kobuki::FieldWatcher::AnalogInput0, kobuki::FieldWatcher::ChangedBy, 0.0);
+  stream.analog(100);
+  stream.analog(500, false);
+  check(!watcher.poll(analog, event), "fields are only checked in frames that carry them");
+  stream.analog(101);
+  check(watcher.poll(analog, event), "a threshold under one raw unit is met by any change");
+
+  stream.battery(190);
+  watcher.unsubscribe(id);
+  int again = watcher.subscribe(kobuki::FieldWatcher::BatteryVoltage, kobuki::FieldWatcher::RisesAbove, 20.0);
+  check(again == id && !watcher.poll(again, event) && watcher.missed(again) == 0,
+        "a reused slot starts without the last subscription's event");
+}
+
+void waiting() {
+  kobuki::FieldWatcher watcher;
+  Stream stream(watcher);
+  kobuki::FieldWatcher::Event event;
+  int id = watcher.subscribe(kobuki::FieldWatcher::BatteryVoltage, kobuki::FieldWatcher::FallsBelow, 14.0);
+  stream.battery(150);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  check(!watcher.wait(id, 0.05, event) && std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(50),
+        "wait() gives up after the timeout");
+
+  bool woken = false;
+  std::thread subscriber([&]() { woken = watcher.wait(id, 5.0, event); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  stream.battery(139);
+  subscriber.join();
+  check(woken && std::abs(event.value - 13.9) < 1e-9, "wait() is woken by the condition being met");
+
+  bool cancelled = true;
+  std::thread cancelling([&]() { cancelled = !watcher.wait(id, 5.0, event); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  start = std::chrono::steady_clock::now();
+  watcher.unsubscribe(id);
+  cancelling.join();
+  check(cancelled && std::chrono::steady_clock::now() - start < std::chrono::seconds(1), "and returns false when unsubscribed");
+}
+
+void limits() {
+  kobuki::FieldWatcher watcher;
+  std::vector<int> ids;
+  for (unsigned int i = 0; i < kobuki::FieldWatcher::max_subscriptions; ++i) {
+    ids.push_back(watcher.subscribe(kobuki::FieldWatcher::AnalogInput1, kobuki::FieldWatcher::ChangedBy, 1.0));
+  }
+  check(ids.back() >= 0 && watcher.subscribe(kobuki::FieldWatcher::AnalogInput1, kobuki::FieldWatcher::ChangedBy) == -1,
+        "subscriptions are refused once all slots are taken");
+  watcher.unsubscribe(ids[5]);
+  check(watcher.subscribe(kobuki::FieldWatcher::AnalogInput1, kobuki::FieldWatcher::ChangedBy) == ids[5],
+        "until one is given back");
+  check(watcher.subscribe(kobuki::FieldWatcher::NumberOfFields, kobuki::FieldWatcher::ChangedBy) == -1, "unknown fields are refused");
+}
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  conditions();
+  changes();
+  waiting();
+  limits();
+  return kobuki::test::summary();
+}
@@ -0,0 +1,120 @@
+/**
+ * @file /kobuki_driver/src/test/firmware_clock.cpp
+ *
+ * @brief Checks the firmware to host clock mapping.
+ *
+ * Feeds the estimator a simulated 50Hz stream from a drifting firmware clock
+ * delivered with usb like jitter and spikes, and checks that the time stamps
+ * are unwrapped (also across long gaps) and mapped to within a millisecond of
+ * when the frames were really stamped. Returns non zero if a check fails.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cmath>
+#include <cstdio>
+#include <kobuki_driver/modules/firmware_clock.hpp>
+#include "test_check.hpp"
+
+/*****************************************************************************
+** Globals
+*****************************************************************************/
+
+namespace {
+using kobuki::test::check;
+
+const int64_t period = 20; // [ms]
+const double drift = 100.0e-6; // host clock runs this much faster [s/s]
+const kobuki::MonotonicTime host_offset = 5000000000LL; // host time when the firmware started [ns]
+
+/*
+ * The robot, as seen from the host.
+ */
+class Stream {
+public:
+  Stream() : firmware_time(1000), random(12345) {}
+
+  /*
+   * Host time at which the firmware stamped a frame [ns].
+   */
+  kobuki::MonotonicTime stampedAt(const int64_t &time) const {
+    return host_offset + static_cast<kobuki::MonotonicTime>(static_cast<double>(time) * 1.0e6 * (1.0 + drift));
+  }
+
+  /*
+   * Next frame: its 16 bit time stamp and when it arrives (at least 0.3ms
+   * after the stamp, usually up to 5ms, one in fifty up to 30ms).
+   */
+  void next(uint16_t &time_stamp, kobuki::MonotonicTime &receive_time, kobuki::MonotonicTime &stamp_time) {
+    firmware_time += period;
+    random = random * 1103515245u + 12345u;
+    unsigned int jitter = (random >> 8) % 4700;
+    if ( (random >> 24) % 50 == 0 ) { jitter += 25000; }
+    time_stamp = static_cast<uint16_t>(firmware_time);
+    stamp_time = stampedAt(firmware_time);
+    receive_time = stamp_time + (300 + jitter) * 1000LL;
+  }
+
+  void skip(const int64_t &milliseconds) { firmware_time += milliseconds; }
+
+  int64_t firmware_time; // [ms], never wraps
+  unsigned int random;
+};
+
+/*
+ * Runs the stream through the clock, returns the largest error of the
+ * estimates over the last half of the frames [ns].
+ */
+kobuki::MonotonicTime run(Stream &stream, kobuki::FirmwareClock &clock, const unsigned int &frames,
+                          bool &never_late, bool &unwrapped) {
+  kobuki::MonotonicTime worst = 0;
+  for (unsigned int i = 0; i < frames; ++i) {
+    uint16_t time_stamp;
+    kobuki::MonotonicTime receive_time, stamp_time;
+    stream.next(time_stamp, receive_time, stamp_time);
+    kobuki::MonotonicTime estimate = clock.update(time_stamp, receive_time);
+    never_late = never_late && estimate <= receive_time;
+    unwrapped = unwrapped && clock.firmwareTime() == stream.firmware_time; // the stream starts below the first wrap
+    if ( i >= frames / 2 ) {
+      kobuki::MonotonicTime error = estimate - stamp_time;
+      if ( error < 0 ) { error = -error; }
+      if ( error > worst ) { worst = error; }
+    }
+  }
+  return worst;
+}
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  Stream stream;
+  kobuki::FirmwareClock clock;
+  bool never_late = true, unwrapped = true;
+
+  kobuki::MonotonicTime worst = run(stream, clock, 6000, never_late, unwrapped); // 2 minutes, wraps once
+  check(clock.isSynchronised(), "synchronises");
+  check(unwrapped && stream.firmware_time > 65536, "unwraps the 16 bit time stamp");
+  check(never_late, "never stamps a frame after it was received");
+  check(worst < 1000000, "maps frames to within 1ms of when they were stamped, despite 5-30ms of jitter");
+  std::printf("       (worst error %.3fms)\n", static_cast<double>(worst) * 1.0e-6);
+  check(std::abs(clock.drift() - drift) < 10.0e-6, "estimates the drift to within 10ppm");
+  std::printf("       (drift %.1fppm, actual %.1fppm)\n", clock.drift() * 1.0e6, drift * 1.0e6);
+
+  stream.skip(150000); // a usb stall hiding two wraps of the counter
+  worst = run(stream, clock, 3000, never_late, unwrapped);
+  check(unwrapped, "recovers wraps hidden in a long gap from the host clock");
+  check(worst < 1000000, "and stays within 1ms after it");
+
+  stream.firmware_time = 0; // the firmware restarts
+  run(stream, clock, 1, never_late, unwrapped);
+  check(!clock.isSynchronised() && clock.firmwareTime() == period, "starts over when the firmware restarts");
+
+  return kobuki::test::summary();
+}
@@ -0,0 +1,101 @@
+/**
+ * @file /kobuki_driver/src/test/frame_history.cpp
+ *
+ * @brief Checks the time indexed frame history.
+ *
+ * Lookups by time find the right frames, interpolation goes the short way
+ * round the encoder and heading wraps, and frames that have been overwritten
+ * are no longer found. Returns non zero if a check fails.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cmath>
+#include <vector>
+#include <ecl/geometry/angle.hpp>
+#include <kobuki_driver/frame_history.hpp>
+#include "test_check.hpp"
+
+/*****************************************************************************
+** Globals
+*****************************************************************************/
+
+namespace {
+using kobuki::test::check;
+
+const kobuki::MonotonicTime start = 1000000000LL; // [ns]
+const kobuki::MonotonicTime period = 20000000LL;  // [ns]
+
+/*
+ * Frame i: stamped at start + i periods, the encoders 10 ticks a frame from
+ * just below their wrap and the heading 0.1 degrees a frame from just below
+ * +180 degrees.
+ */
+kobuki::Frame frame(const unsigned int &i) {
+  kobuki::Frame frame;
+  frame.info.sequence = i + 1;
+  frame.info.host_time = start + i * period;
+  frame.payloads = 0;
+  frame.core_sensors.left_encoder = static_cast<uint16_t>(65500 + 10 * i);
+  frame.core_sensors.right_encoder = static_cast<uint16_t>(65500 - 10 * i);
+  int angle = 17900 + 10 * static_cast<int>(i); // [hundredths of a degree]
+  if ( angle > 18000 ) { angle -= 36000; }
+  frame.inertia.angle = static_cast<int16_t>(angle);
+  return frame;
+}
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  kobuki::FrameHistory history(6);
+  check(history.capacity() == 8, "capacity is rounded up to a power of two");
+  kobuki::FrameHistory::Sample sample;
+  kobuki::Frame found;
+  check(history.size() == 0 && !history.at(start, sample) && !history.nearest(start, found), "an empty history finds nothing");
+
+  for (unsigned int i = 0; i < 20; ++i) { history.add(frame(i)); }
+  check(history.size() == 7, "keeps all but the slot due to be overwritten next");
+
+  check(history.nearest(start + 15 * period + period / 3, found) && found.info.sequence == 16, "nearest() rounds down to the closer frame");
+  check(history.nearest(start + 15 * period + 2 * period / 3, found) && found.info.sequence == 17, "and up to it");
+  check(history.nearest(start, found) && found.info.sequence == 14, "and clamps to the oldest frame kept");
+  check(history.nearest(start + 100 * period, found) && found.info.sequence == 20, "and to the newest");
+
+  // frame 15: left 65650 -> 114, right 65350; frame 16: left 124, right 65340
+  check(history.at(start + 15 * period + period / 2, sample)
+        && std::abs(sample.left_encoder - 119.0) < 1e-6 && std::abs(sample.right_encoder - 65345.0) < 1e-6,
+        "at() interpolates the encoders");
+  // frame 10 is at 180.0 degrees, frame 11 at -179.9
+  history.resize(16);
+  for (unsigned int i = 2; i < 12; ++i) { history.add(frame(i)); }
+  check(history.at(start + 10 * period + period / 2, sample) && std::abs(sample.heading - ecl::wrap_angle(180.05 * ecl::pi / 180.0)) < 1e-6,
+        "and takes the heading the short way round across +-180 degrees");
+  // frames 3 and 4 wrap the left encoder from 65530 to 4
+  check(history.at(start + 3 * period + period / 2, sample) && std::abs(sample.left_encoder - 65535.0) < 1e-6,
+        "and the encoders across their wrap");
+  check(history.at(start + 11 * period, sample), "the newest frame's time can be looked up");
+  check(!history.at(start + 11 * period + 1, sample) && !history.at(start + 2 * period - 1, sample), "there is no extrapolation");
+
+  std::vector<kobuki::Frame> frames;
+  frames.reserve(16);
+  check(history.range(start + 7 * period, start + 9 * period, frames) == 3
+        && frames[0].info.sequence == 8 && frames[2].info.sequence == 10, "range() includes both ends, oldest first");
+
+  for (unsigned int i = 12; i < 20; ++i) { history.add(frame(i)); }
+  check(history.range(start, start + 100 * period, frames) == 15 && frames[0].info.sequence == 6,
+        "overwritten frames are no longer found");
+
+  history.resize(0);
+  history.add(frame(0));
+  check(history.capacity() == 0 && history.size() == 0 && !history.at(start, sample) && !history.nearest(start, found)
+        && history.range(start, start + 100 * period, frames) == 0, "a history of capacity 0 keeps nothing");
+
+  return kobuki::test::summary();
+}
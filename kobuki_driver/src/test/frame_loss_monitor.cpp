@@ -0,0 +1,91 @@
+/**
+ * @file /kobuki_driver/src/test/frame_loss_monitor.cpp
+ *
+ * @brief Checks the frame loss accounting.
+ *
+ * Runs a simulated stream with single frames and bursts missing through the
+ * monitor and checks the totals, the per frame periods, the longest gap and
+ * the last minute's figures, and that restarts are not taken for losses.
+ * Returns non zero if a check fails.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cmath>
+#include <cstdio>
+#include <kobuki_driver/frame_loss_monitor.hpp>
+#include "test_check.hpp"
+
+/*****************************************************************************
+** Globals
+*****************************************************************************/
+
+namespace {
+using kobuki::test::check;
+
+const kobuki::MonotonicTime host_start = 7000000000LL; // [ns]
+
+kobuki::MonotonicTime hostTime(const int64_t &firmware_time) {
+  return host_start + firmware_time * 1000000LL;
+}
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  kobuki::FrameLossMonitor monitor;
+  const unsigned int slots = 90 * 50; // 90s of stream
+  kobuki::MonotonicTime now = hostTime(1000 + 20 * static_cast<int64_t>(slots) + 500);
+  int64_t first_second = now / 1000000000LL - 59; // the minute is the current second and the 59 before it
+  unsigned long sent = 0, dropped = 0, received_last_minute = 0, dropped_last_minute = 0;
+  bool periods_right = true;
+  unsigned int expected_periods = 1;
+  for (unsigned int i = 0; i < slots; ++i) {
+    bool lost = (i % 100 == 50) || (i >= 3000 && i < 3005); // one in a hundred, and a burst of five
+    ++sent;
+    if ( lost ) {
+      ++dropped;
+      ++expected_periods;
+      continue;
+    }
+    int64_t firmware_time = 1000 + 20 * static_cast<int64_t>(i) + ((i % 7 == 0) ? 3 : 0); // a little jitter
+    unsigned int periods = monitor.update(firmware_time, hostTime(firmware_time));
+    if ( i > 0 && periods != expected_periods ) { periods_right = false; }
+    if ( hostTime(firmware_time) / 1000000000LL >= first_second ) { // losses go with the frame that reveals them
+      ++received_last_minute;
+      dropped_last_minute += expected_periods - 1;
+    }
+    expected_periods = 1;
+  }
+  check(periods_right, "each frame reports the stream periods since the one before");
+  check(monitor.received() == sent - dropped && monitor.lost() == dropped, "the totals count every frame decoded and lost");
+  check(monitor.maximumGap() >= 6 * 20 && monitor.maximumGap() <= 6 * 20 + 3, "the longest gap is the burst");
+  check(monitor.lostLastMinute(now) == dropped_last_minute && monitor.receivedLastMinute(now) == received_last_minute
+        && received_last_minute < sent - dropped, "the last minute's figures leave older frames out");
+  double rate = static_cast<double>(dropped_last_minute) / static_cast<double>(received_last_minute + dropped_last_minute);
+  check(std::abs(monitor.lossRate(now) - rate) < 1e-9, "and give the loss rate");
+  std::printf("       (%s)\n", monitor.toString(now).c_str());
+  check(monitor.receivedLastMinute(now + 120 * 1000000000LL) == 0 && monitor.lossRate(now + 120 * 1000000000LL) == 0.0,
+        "a minute without frames reads as nothing received, nothing lost");
+
+  unsigned long lost = monitor.lost();
+  monitor.resync();
+  monitor.update(200, now + 1000000000LL); // the firmware restarted
+  check(monitor.lost() == lost, "the step across a resync is not counted as lost frames");
+  monitor.update(220, now + 1020000000LL);
+  monitor.update(100000, now + 1040000000LL); // a clock jump, far longer than a counter wrap
+  monitor.update(99980, now + 1060000000LL);  // and backwards
+  check(monitor.lost() == lost, "nor are implausible steps");
+
+  monitor.reset();
+  check(monitor.received() == 0 && monitor.lost() == 0 && monitor.maximumGap() == 0 && monitor.receivedLastMinute(now) == 0,
+        "reset() clears everything");
+
+  return kobuki::test::summary();
+}
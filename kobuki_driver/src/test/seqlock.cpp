@@ -0,0 +1,94 @@
+/**
+ * @file /kobuki_driver/src/test/seqlock.cpp
+ *
+ * @brief Checks the seqlock the frames are published through.
+ *
+ * Values that are not a whole number of words survive the trip, and readers
+ * racing a writer only ever see whole values, never older than one they
+ * already saw. Returns non zero if a check fails.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <kobuki_driver/seqlock.hpp>
+#include "test_check.hpp"
+
+/*****************************************************************************
+** Globals
+*****************************************************************************/
+
+namespace {
+using kobuki::test::check;
+
+struct Odd {
+  uint32_t a, b, c; // 12 bytes, the last word is only half used
+};
+
+/*
+ * Every field holds the same count, so a torn copy shows up as a mismatch.
+ */
+struct Snapshot {
+  unsigned long count;
+  unsigned long fields[15];
+};
+
+void values() {
+  kobuki::Seqlock<Odd> lock;
+  Odd initial = lock.load();
+  check(initial.a == 0 && initial.b == 0 && initial.c == 0, "starts out value initialised");
+  Odd odd = { 1, 0xdeadbeef, 3 };
+  lock.store(odd);
+  Odd copy = lock.load();
+  check(copy.a == 1 && copy.b == 0xdeadbeef && copy.c == 3, "a value that is not a whole number of words comes back unchanged");
+}
+
+void readers() {
+  const unsigned long number_of_stores = 1000000;
+  const unsigned int number_of_readers = 3;
+  kobuki::Seqlock<Snapshot> lock;
+  std::atomic<bool> done(false);
+  std::atomic<unsigned int> torn(0), backwards(0);
+  std::vector<std::thread> threads;
+  for (unsigned int r = 0; r < number_of_readers; ++r) {
+    threads.push_back(std::thread([&]() {
+      unsigned long newest = 0;
+      while ( !done.load(std::memory_order_acquire) ) {
+        Snapshot snapshot = lock.load();
+        for (unsigned int i = 0; i < 15; ++i) {
+          if ( snapshot.fields[i] != snapshot.count ) { ++torn; break; }
+        }
+        if ( snapshot.count < newest ) { ++backwards; }
+        newest = snapshot.count;
+      }
+    }));
+  }
+  Snapshot snapshot;
+  for (unsigned long n = 1; n <= number_of_stores; ++n) {
+    snapshot.count = n;
+    for (unsigned int i = 0; i < 15; ++i) { snapshot.fields[i] = n; }
+    lock.store(snapshot);
+  }
+  done.store(true, std::memory_order_release);
+  for (unsigned int r = 0; r < threads.size(); ++r) { threads[r].join(); }
+  check(torn == 0, "readers racing the writer never see a torn value");
+  check(backwards == 0, "nor one older than a value they already saw");
+  check(lock.load().count == number_of_stores, "the last store is what remains");
+}
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  values();
+  readers();
+  return kobuki::test::summary();
+}
@@ -0,0 +1,179 @@
+/**
+ * @file /kobuki_driver/src/test/server_protocol.cpp
+ *
+ * @brief Checks the encoding of the kobuki server's messages.
+ *
+ * Frames go through encodeFrame(), a MessageStream fed a byte at a time and
+ * decodeFrame(), and must come out as they went in, sub-payloads that were
+ * not sent keeping their previous values. Short or oversized messages must
+ * be refused. Returns non zero if a check fails.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cstring>
+#include <kobuki_driver/server_protocol.hpp>
+#include "test_check.hpp"
+
+/*****************************************************************************
+** Globals
+*****************************************************************************/
+
+namespace {
+using kobuki::test::check;
+
+const unsigned int buffer_size = sizeof(kobuki::protocol::MessageHeader) + kobuki::protocol::max_body_size;
+
+/*
+ * A frame with every field set from the seed.
+ */
+kobuki::Frame filled(const unsigned int &seed) {
+  kobuki::Frame frame;
+  frame.info.sequence = 1000 + seed;
+  frame.info.periods = 1 + seed % 3;
+  frame.info.receive_time = 123456789 + seed;
+  frame.info.host_time = 123456000 + seed;
+  frame.info.firmware_time = 65536 + seed;
+  frame.payloads = 0;
+  frame.core_sensors.time_stamp = static_cast<uint16_t>(seed);
+  frame.core_sensors.bumper = static_cast<uint8_t>(seed + 1);
+  frame.core_sensors.wheel_drop = static_cast<uint8_t>(seed + 2);
+  frame.core_sensors.cliff = static_cast<uint8_t>(seed + 3);
+  frame.core_sensors.left_encoder = static_cast<uint16_t>(seed + 4);
+  frame.core_sensors.right_encoder = static_cast<uint16_t>(seed + 5);
+  frame.core_sensors.left_pwm = static_cast<char>(seed + 6);
+  frame.core_sensors.right_pwm = static_cast<char>(seed + 7);
+  frame.core_sensors.buttons = static_cast<uint8_t>(seed + 8);
+  frame.core_sensors.charger = static_cast<uint8_t>(seed + 9);
+  frame.core_sensors.battery = static_cast<uint8_t>(seed + 10);
+  frame.core_sensors.over_current = static_cast<uint8_t>(seed + 11);
+  frame.digital_input = static_cast<uint16_t>(seed + 12);
+  for (unsigned int i = 0; i < 4; ++i) { frame.analog_input[i] = static_cast<uint16_t>(seed + 13 + i); }
+  frame.three_axis_gyro.frame_id = static_cast<unsigned char>(seed + 17);
+  frame.three_axis_gyro.followed_data_length = 6;
+  for (unsigned int i = 0; i < MAX_DATA_SIZE; ++i) { frame.three_axis_gyro.data[i] = static_cast<unsigned short>(seed + 18 + i); }
+  frame.hardware_version = seed + 50;
+  frame.firmware_version = seed + 51;
+  return frame;
+}
+
+bool sameCoreSensors(const kobuki::Frame &a, const kobuki::Frame &b) {
+  return a.core_sensors.time_stamp == b.core_sensors.time_stamp && a.core_sensors.bumper == b.core_sensors.bumper
+      && a.core_sensors.wheel_drop == b.core_sensors.wheel_drop && a.core_sensors.cliff == b.core_sensors.cliff
+      && a.core_sensors.left_encoder == b.core_sensors.left_encoder && a.core_sensors.right_encoder == b.core_sensors.right_encoder
+      && a.core_sensors.left_pwm == b.core_sensors.left_pwm && a.core_sensors.right_pwm == b.core_sensors.right_pwm
+      && a.core_sensors.buttons == b.core_sensors.buttons && a.core_sensors.charger == b.core_sensors.charger
+      && a.core_sensors.battery == b.core_sensors.battery && a.core_sensors.over_current == b.core_sensors.over_current;
+}
+
+bool sameGpInput(const kobuki::Frame &a, const kobuki::Frame &b) {
+  return a.digital_input == b.digital_input && std::memcmp(a.analog_input, b.analog_input, sizeof(a.analog_input)) == 0;
+}
+
+/*
+ * Compares only the samples the gyro says it holds.
+ */
+bool sameGyro(const kobuki::Frame &a, const kobuki::Frame &b) {
+  if ( a.three_axis_gyro.frame_id != b.three_axis_gyro.frame_id
+    || a.three_axis_gyro.followed_data_length != b.three_axis_gyro.followed_data_length ) {
+    return false;
+  }
+  for (unsigned int i = 0; i < a.three_axis_gyro.followed_data_length; ++i) {
+    if ( a.three_axis_gyro.data[i] != b.three_axis_gyro.data[i] ) { return false; }
+  }
+  return true;
+}
+
+bool sameInfo(const kobuki::Frame &a, const kobuki::Frame &b) {
+  return a.info.sequence == b.info.sequence && a.info.periods == b.info.periods
+      && a.info.receive_time == b.info.receive_time && a.info.host_time == b.info.host_time
+      && a.info.firmware_time == b.info.firmware_time && a.payloads == b.payloads;
+}
+
+void fixedBodies() {
+  unsigned char buffer[buffer_size];
+  kobuki::protocol::VelocityData velocity = { 0.25, -1.5 };
+  unsigned int size = kobuki::protocol::encode(kobuki::protocol::SetBaseControl, velocity, buffer);
+  check(size == sizeof(kobuki::protocol::MessageHeader) + sizeof(velocity), "a fixed size message is a header and its body");
+
+  kobuki::protocol::MessageStream stream;
+  std::memcpy(stream.space(), buffer, size);
+  stream.commit(size);
+  kobuki::protocol::MessageHeader header;
+  const unsigned char *body = NULL;
+  kobuki::protocol::VelocityData decoded = { 0.0, 0.0 };
+  bool received = stream.next(header, body);
+  if ( received ) { std::memcpy(&decoded, body, sizeof(decoded)); }
+  check(received && header.type == kobuki::protocol::SetBaseControl && header.length == sizeof(velocity)
+        && decoded.linear == 0.25 && decoded.angular == -1.5, "and comes back out of a stream unchanged");
+  check(!stream.next(header, body), "leaving nothing behind");
+}
+
+void frames() {
+  unsigned char buffer[buffer_size];
+  kobuki::Frame sent = filled(1);
+  sent.payloads = (1u << kobuki::Header::CoreSensors) | (1u << kobuki::Header::ThreeAxisGyro) | (1u << kobuki::Header::GpInput);
+  unsigned int size = kobuki::protocol::encodeFrame(sent, kobuki::protocol::RobotAlive | kobuki::protocol::InControl, buffer);
+  check(size < sizeof(kobuki::protocol::MessageHeader) + sizeof(kobuki::Frame), "a frame is sent with only the sub-payloads it holds");
+
+  kobuki::protocol::MessageStream stream;
+  kobuki::protocol::MessageHeader header;
+  const unsigned char *body = NULL;
+  bool early = false;
+  for (unsigned int i = 0; i < size; ++i) { // a byte at a time, as a slow socket might deliver it
+    early = early || stream.next(header, body);
+    *stream.space() = buffer[i];
+    stream.commit(1);
+  }
+  check(!early, "no message comes out of the stream before its last byte");
+  bool received = stream.next(header, body);
+  check(received && header.type == kobuki::protocol::FrameData
+        && header.flags == (kobuki::protocol::RobotAlive | kobuki::protocol::InControl), "then the frame does, with its flags");
+
+  kobuki::Frame last = filled(7); // what the client had from earlier frames
+  kobuki::Frame decoded = last;
+  bool valid = received && kobuki::protocol::decodeFrame(body, header.length, decoded);
+  check(valid, "the frame decodes");
+  check(sameInfo(sent, decoded), "its info and payload mask come through");
+  check(sameCoreSensors(sent, decoded) && sameGyro(sent, decoded) && sameGpInput(sent, decoded),
+        "and so do the sub-payloads it holds");
+  check(decoded.hardware_version == last.hardware_version && decoded.firmware_version == last.firmware_version,
+        "the others keep the values of earlier frames");
+
+  decoded = last;
+  check(!kobuki::protocol::decodeFrame(body, header.length - 1, decoded), "a truncated frame is refused");
+  unsigned char padded[buffer_size + 1];
+  std::memcpy(padded, body, header.length);
+  padded[header.length] = 0;
+  check(!kobuki::protocol::decodeFrame(padded, header.length + 1, decoded), "and so is one with bytes left over");
+}
+
+void corruption() {
+  kobuki::protocol::MessageStream stream;
+  kobuki::protocol::MessageHeader header;
+  header.type = kobuki::protocol::FrameData;
+  header.flags = 0;
+  header.length = kobuki::protocol::max_body_size + 1;
+  std::memcpy(stream.space(), &header, sizeof(header));
+  stream.commit(sizeof(header));
+  const unsigned char *body = NULL;
+  check(!stream.next(header, body) && stream.corrupt(), "a message longer than any of ours marks the stream corrupt");
+  stream.clear();
+  check(!stream.corrupt() && stream.spaceLeft() > kobuki::protocol::max_body_size, "until it is cleared");
+}
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  fixedBodies();
+  frames();
+  corruption();
+  return kobuki::test::summary();
+}
@@ -0,0 +1,134 @@
+/**
+ * @file /kobuki_driver/src/test/shared_frame_ring.cpp
+ *
+ * @brief Checks the shared memory frame ring.
+ *
+ * A reader follows the writer frame by frame, is told when the writer laps
+ * it and how many frames it lost, and a fast writer racing a reader never
+ * hands over a torn frame. Returns non zero if a check fails.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <kobuki_driver/shared_frame_ring.hpp>
+#include "test_check.hpp"
+
+/*****************************************************************************
+** Globals
+*****************************************************************************/
+
+namespace {
+using kobuki::test::check;
+
+/*
+ * Frame n, with fields far apart in the frame all derived from n so that a
+ * torn copy shows.
+ */
+kobuki::Frame frame(const uint64_t &n) {
+  kobuki::Frame frame;
+  frame.info.sequence = n;
+  frame.payloads = 0;
+  frame.core_sensors.time_stamp = static_cast<uint16_t>(n);
+  frame.hardware_version = static_cast<uint32_t>(n);
+  frame.udid[2] = static_cast<uint32_t>(~n);
+  return frame;
+}
+
+bool whole(const kobuki::Frame &frame) {
+  return frame.core_sensors.time_stamp == static_cast<uint16_t>(frame.info.sequence)
+      && frame.hardware_version == static_cast<uint32_t>(frame.info.sequence)
+      && frame.udid[2] == static_cast<uint32_t>(~frame.info.sequence);
+}
+
+void following(const std::string &name) {
+  kobuki::SharedFrameWriter writer;
+  kobuki::SharedFrameReader reader;
+  std::string error;
+  check(!reader.open(name, error), "a reader cannot open a ring nobody publishes");
+  check(writer.open(name, 8, error), "the writer creates the ring");
+  kobuki::SharedFrameWriter second;
+  check(!second.open(name, 8, error), "a second writer is refused while the first is alive");
+  check(reader.open(name, error) && reader.writerAlive(), "a reader attaches and sees the writer alive");
+
+  kobuki::Frame read;
+  check(reader.read(read) == kobuki::SharedFrameReader::NoNewFrame, "a reader starts with the next frame published");
+  for (uint64_t n = 1; n <= 3; ++n) { writer.write(frame(n)); }
+  bool in_order = true;
+  for (uint64_t n = 1; n <= 3; ++n) {
+    in_order = reader.read(read) == kobuki::SharedFrameReader::FrameRead && read.info.sequence == n && in_order;
+  }
+  check(in_order, "and reads the frames in order");
+  check(reader.read(read) == kobuki::SharedFrameReader::NoNewFrame && reader.available() == 0, "until it catches up");
+
+  for (uint64_t n = 4; n <= 23; ++n) { writer.write(frame(n)); }
+  check(reader.available() == 20, "frames written meanwhile are waiting");
+  // 8 slots, the one the writer fills next is kept clear: frames 17-23 are left
+  check(reader.read(read) == kobuki::SharedFrameReader::Overrun && read.info.sequence == 17,
+        "a lapped reader is told so and gets the oldest frame left");
+  check(reader.overruns() == 1 && reader.framesLost() == 13, "and the frames it lost are counted");
+  check(reader.read(read) == kobuki::SharedFrameReader::FrameRead && read.info.sequence == 18, "then it carries on from there");
+
+  writer.write(frame(24));
+  check(reader.latest(read) && read.info.sequence == 24 && reader.available() == 0 && reader.framesLost() == 13,
+        "latest() skips to the newest frame without counting the skipped ones as lost");
+
+  writer.close();
+  check(!reader.writerAlive(), "a reader sees the writer go");
+}
+
+void racing(const std::string &name) {
+  const uint64_t number_of_frames = 200000;
+  kobuki::SharedFrameWriter writer;
+  kobuki::SharedFrameReader reader;
+  std::string error;
+  if ( !writer.open(name, 16, error) || !reader.open(name, error) ) {
+    check(false, error.c_str());
+    return;
+  }
+  std::thread writing([&writer, number_of_frames]() {
+    for (uint64_t n = 1; n <= number_of_frames; ++n) {
+      writer.write(frame(n));
+      if ( n % 4 == 0 ) { std::this_thread::yield(); } // keeps the reader mostly up with it, lapped now and then
+    }
+  });
+  uint64_t expected = 1, received = 0;
+  bool intact = true;
+  kobuki::Frame read;
+  while ( expected <= number_of_frames ) {
+    kobuki::SharedFrameReader::Result result = reader.read(read);
+    if ( result == kobuki::SharedFrameReader::NoNewFrame ) { continue; }
+    if ( !whole(read) || read.info.sequence < expected || (result == kobuki::SharedFrameReader::FrameRead && read.info.sequence != expected) ) {
+      intact = false;
+      break;
+    }
+    expected = read.info.sequence + 1;
+    ++received;
+  }
+  writing.join();
+  check(intact, "a reader racing the writer only gets whole frames, in order");
+  check(received + reader.framesLost() == number_of_frames, "and every frame is either read or counted as lost");
+  std::printf("       (read %lu, lost %lu in %lu overruns)\n", static_cast<unsigned long>(received),
+              reader.framesLost(), reader.overruns());
+}
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  std::ostringstream name;
+  name << "/kobuki_shared_frame_ring_check_" << getpid();
+  following(name.str());
+  racing(name.str());
+  return kobuki::test::summary();
+}
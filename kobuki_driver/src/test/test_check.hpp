@@ -0,0 +1,60 @@
+/**
+ * @file /kobuki_driver/src/test/test_check.hpp
+ *
+ * @brief Pass/fail bookkeeping shared by the checks.
+ *
+ * Each check prints one line per expectation and returns non zero from main
+ * if any failed, so that ctest reports it.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki_core/hydro-devel/kobuki_driver/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_TEST_CHECK_HPP_
+#define KOBUKI_TEST_CHECK_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cstdio>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+namespace test {
+
+/*****************************************************************************
+** Interface
+*****************************************************************************/
+
+inline unsigned int &failures() {
+  static unsigned int count = 0;
+  return count;
+}
+
+/**
+ * @brief Report one expectation, counting it if it failed.
+ */
+inline void check(const bool &passed, const char *what) {
+  std::printf("[%s] %s\n", passed ? " ok " : "FAIL", what);
+  if ( !passed ) { ++failures(); }
+}
+
+/**
+ * @brief Print the number of failed expectations, the exit code for main.
+ */
+inline int summary() {
+  std::printf("%u failure(s)\n", failures());
+  return failures() == 0 ? 0 : 1;
+}
+
+} // namespace test
+} // namespace kobuki
+
+#endif /* KOBUKI_TEST_CHECK_HPP_ */
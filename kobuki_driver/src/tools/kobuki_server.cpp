@@ -0,0 +1,77 @@
+/**
+  * @file /kobuki_driver/src/tools/kobuki_server.cpp
+  *
+  * @brief Owns the kobuki and shares it with KobukiClient's in other processes.
+ **/
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <ecl/time.hpp>
+#include <ecl/command_line.hpp>
+#include "kobuki_driver/kobuki.hpp"
+#include "kobuki_driver/kobuki_server.hpp"
+
+/*****************************************************************************
+** Signal Handler
+*****************************************************************************/
+
+bool shutdown_req = false;
+void signalHandler(int signum) {
+  shutdown_req = true;
+}
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char** argv)
+{
+  ecl::CmdLine cmd_line("kobuki_server program", ' ', "0.1");
+  ecl::ValueArg<std::string> device_port("d", "device_port", "Path to device file of serial port to open, connected to the kobuki", false, "/dev/kobuki", "string");
+  ecl::ValueArg<std::string> socket_path("s", "socket", "Path of the unix domain socket to serve clients on", false, "/tmp/kobuki.sock", "string");
+  ecl::ValueArg<double> command_timeout("t", "command_timeout", "Seconds after which a client's velocity lapses", false, 0.5, "double");
+  cmd_line.add(device_port);
+  cmd_line.add(socket_path);
+  cmd_line.add(command_timeout);
+  cmd_line.parse(argc, argv);
+
+  signal(SIGINT, signalHandler);
+
+  kobuki::Parameters parameters;
+  parameters.sigslots_namespace = "/kobuki";
+  parameters.device_port = device_port.getValue();
+  kobuki::Kobuki kobuki;
+  try {
+    kobuki.init(parameters);
+  } catch ( ecl::StandardException &e ) {
+    std::cout << e.what();
+    return 1;
+  }
+  kobuki.enable();
+
+  kobuki::KobukiServer server(kobuki);
+  std::string error;
+  if ( !server.start(socket_path.getValue(), error, command_timeout.getValue()) ) {
+    std::cout << "Kobuki Server : " << error << std::endl;
+    return 1;
+  }
+  std::cout << "Kobuki Server : serving " << device_port.getValue() << " on " << socket_path.getValue() << std::endl;
+
+  ecl::Sleep sleep(1);
+  unsigned int clients = 0;
+  while (!shutdown_req) {
+    sleep();
+    if ( server.clients() != clients ) {
+      clients = server.clients();
+      std::cout << "Kobuki Server : " << clients << " client(s) [frames dropped: " << server.framesDropped() << "]" << std::endl;
+    }
+  }
+  server.stop();
+  kobuki.disable();
+  return 0;
+}
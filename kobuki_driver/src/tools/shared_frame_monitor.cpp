@@ -0,0 +1,58 @@
+/**
+  * @file /kobuki_driver/src/tools/shared_frame_monitor.cpp
+  *
+  * @brief Follows the frames a driver publishes to shared memory.
+  *
+  * Start the driver with Parameters::shared_memory_name set, then run this
+  * with the same name alongside it.
+ **/
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <ecl/time.hpp>
+#include <ecl/command_line.hpp>
+#include "kobuki_driver/shared_frame_ring.hpp"
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char** argv)
+{
+  ecl::CmdLine cmd_line("shared_frame_monitor program", ' ', "0.1");
+  ecl::UnlabeledValueArg<std::string> name("name", "Shared memory name the driver publishes to", false, "/kobuki_frames", "string");
+  cmd_line.add(name);
+  cmd_line.parse(argc, argv);
+
+  kobuki::SharedFrameReader reader;
+  std::string error;
+  if ( !reader.open(name.getValue(), error) ) {
+    std::cerr << "Could not open " << name.getValue() << " [" << error << "]" << std::endl;
+    return 1;
+  }
+
+  kobuki::Frame frame;
+  unsigned long frames_read = 0;
+  while ( reader.writerAlive() ) {
+    kobuki::SharedFrameReader::Result result;
+    while ( (result = reader.read(frame)) != kobuki::SharedFrameReader::NoNewFrame ) {
+      if ( result == kobuki::SharedFrameReader::Overrun ) {
+        std::cout << "Overrun, " << reader.framesLost() << " frames lost so far" << std::endl;
+      }
+      if ( ++frames_read % 50 == 0 ) {
+        std::cout << "Frame " << frame.info.sequence
+                  << " [time: " << frame.core_sensors.time_stamp
+                  << "][encoders: " << frame.core_sensors.left_encoder << ", " << frame.core_sensors.right_encoder
+                  << "][battery: " << static_cast<int>(frame.core_sensors.battery) << "]" << std::endl;
+      }
+    }
+    ecl::MilliSleep()(5);
+  }
+  std::cout << "The driver stopped publishing after " << frames_read << " frames ("
+            << reader.overruns() << " overruns, " << reader.framesLost() << " frames lost)." << std::endl;
+  return 0;
+}